@@ -25,12 +25,23 @@ extern "C" {
 #include <stdarg.h>
 #include <string.h>
 #include <stdio.h>
+#include <math.h>
+#include <ctype.h>
 #ifdef TFX_DEBUG
 #include <assert.h>
 #else
 #define assert(op) (void)(op);
 #endif
 
+// frustum culling tests four bounds at a time where possible
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define TFX_CULL_SSE
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define TFX_CULL_NEON
+#include <arm_neon.h>
+#endif
+
 // needed on msvc
 #if defined(_MSC_VER) && !defined(snprintf)
 #define snprintf _snprintf
@@ -42,7 +53,8 @@ extern "C" {
 #endif
 
 #ifndef TFX_UNIFORM_BUFFER_SIZE
-// by default, allow up to 4MB of uniform updates per frame.
+// initial size of the per-frame arena holding uniform updates and draw
+// uniform lists, 4MB by default. it grows to fit the largest frame seen.
 #define TFX_UNIFORM_BUFFER_SIZE 1024*1024*4
 #endif
 
@@ -51,6 +63,37 @@ extern "C" {
 #define TFX_TRANSIENT_BUFFER_SIZE 1024*1024*4
 #endif
 
+#ifndef TFX_TRANSIENT_REGIONS
+// with persistent mapping, one transient region per frame in flight.
+#define TFX_TRANSIENT_REGIONS 3
+#endif
+
+#ifndef TFX_MAX_ENCODERS
+// main thread + 7 workers.
+#define TFX_MAX_ENCODERS 8
+#endif
+
+#ifndef TFX_MAX_UNIFORM_BLOCKS
+// uniform blocks get binding points 0..N-1, in the order they are declared.
+#define TFX_MAX_UNIFORM_BLOCKS 4
+#endif
+
+#ifndef TFX_VAO_CACHE_SIZE
+// vertex array objects kept around for (buffers, format, offset) combinations,
+// least recently used is recycled first.
+#define TFX_VAO_CACHE_SIZE 64
+#endif
+
+#ifndef TFX_MAX_ATTRIBS
+// vertex + instance attributes, GL guarantees at least 16.
+#define TFX_MAX_ATTRIBS 16
+#endif
+
+#ifndef TFX_ENCODER_UNIFORM_CHUNK
+// encoders grab arena space from the frame in chunks of this size.
+#define TFX_ENCODER_UNIFORM_CHUNK 1024*64
+#endif
+
 // The following code is public domain, from https://github.com/nothings/stb
 //////////////////////////////////////////////////////////////////////////////
 #ifdef __cplusplus
@@ -113,6 +156,78 @@ static void * stb__sbgrowf(void *arr, int increment, int itemsize)
 #endif // STB_STRETCHY_BUFFER_H_INCLUDED
 //////////////////////////////////////////////////////////////////////////////
 
+// reset a stretchy buffer's count, but keep its storage around.
+#define sb_reset(a) ((a) ? stb__sbn(a) = 0 : 0)
+// drop the last n items, keeping storage.
+#define sb_pop(a, n) ((a) ? stb__sbn(a) -= (n) : 0)
+
+// returns the value before the add.
+#ifdef _MSC_VER
+#include <intrin.h>
+#define tfx_atomic_add(ptr, v) (uint32_t)_InterlockedExchangeAdd((volatile long*)(ptr), (long)(v))
+#define tfx_atomic_load(ptr) (uint32_t)_InterlockedCompareExchange((volatile long*)(ptr), 0, 0)
+#define tfx_atomic_store(ptr, v) _InterlockedExchange((volatile long*)(ptr), (long)(v))
+#define tfx_atomic_fence() MemoryBarrier()
+#else
+#define tfx_atomic_add(ptr, v) __atomic_fetch_add((ptr), (v), __ATOMIC_ACQ_REL)
+#define tfx_atomic_load(ptr) __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#define tfx_atomic_store(ptr, v) __atomic_store_n((ptr), (v), __ATOMIC_RELEASE)
+#define tfx_atomic_fence() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#endif
+
+// just enough threading to hand frames to a render thread.
+#ifdef _WIN32
+#include <windows.h>
+typedef CRITICAL_SECTION tfx_mutex;
+typedef CONDITION_VARIABLE tfx_cond;
+typedef DWORD tfx_thread_id;
+#define tfx_mutex_init(m) InitializeCriticalSection(m)
+#define tfx_mutex_destroy(m) DeleteCriticalSection(m)
+#define tfx_mutex_lock(m) EnterCriticalSection(m)
+#define tfx_mutex_unlock(m) LeaveCriticalSection(m)
+#define tfx_cond_init(c) InitializeConditionVariable(c)
+#define tfx_cond_destroy(c) (void)(c)
+#define tfx_cond_wait(c, m) SleepConditionVariableCS(c, m, INFINITE)
+#define tfx_cond_broadcast(c) WakeAllConditionVariable(c)
+#define tfx_thread_self() GetCurrentThreadId()
+#define tfx_thread_equal(a, b) ((a) == (b))
+#else
+#include <pthread.h>
+typedef pthread_mutex_t tfx_mutex;
+typedef pthread_cond_t tfx_cond;
+typedef pthread_t tfx_thread_id;
+#define tfx_mutex_init(m) pthread_mutex_init(m, NULL)
+#define tfx_mutex_destroy(m) pthread_mutex_destroy(m)
+#define tfx_mutex_lock(m) pthread_mutex_lock(m)
+#define tfx_mutex_unlock(m) pthread_mutex_unlock(m)
+#define tfx_cond_init(c) pthread_cond_init(c, NULL)
+#define tfx_cond_destroy(c) pthread_cond_destroy(c)
+#define tfx_cond_wait(c, m) pthread_cond_wait(c, m)
+#define tfx_cond_broadcast(c) pthread_cond_broadcast(c)
+#define tfx_thread_self() pthread_self()
+#define tfx_thread_equal(a, b) pthread_equal(a, b)
+#endif
+
+// monotonic clock for the stats, in nanoseconds.
+#ifdef _WIN32
+static uint64_t tfx_time_ns() {
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER now;
+	if (freq.QuadPart == 0) {
+		QueryPerformanceFrequency(&freq);
+	}
+	QueryPerformanceCounter(&now);
+	return (uint64_t)((double)now.QuadPart * 1000000000.0 / (double)freq.QuadPart);
+}
+#else
+#include <time.h>
+static uint64_t tfx_time_ns() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+#endif
+
 static char *tfx_strdup(const char *src) {
 	size_t len = strlen(src) + 1;
 	char *s = malloc(len);
@@ -133,7 +248,70 @@ static char *tfx_strdup(const char *src) {
 #define TFX_ERROR(msg, ...) tfx_printf(TFX_SEVERITY_ERROR, msg, __VA_ARGS__)
 #define TFX_FATAL(msg, ...) tfx_printf(TFX_SEVERITY_FATAL, msg, __VA_ARGS__)
 
-#define VIEW_MAX 256
+// frame timeline. zones go into a fixed ring from any thread without locks;
+// each zone's seq is written last, so tfx_trace_dump can skip the ones that
+// are torn or already overwritten.
+#define TFX_TRACE_ZONES 4096
+#define TFX_TRACE_NAME 32
+
+// rows in the timeline. these are roles, not threads: without a render
+// thread the submit and render zones come from the same thread.
+enum {
+	TFX_TRACE_SUBMIT = 0,
+	TFX_TRACE_RENDER,
+	TFX_TRACE_GPU,
+	TFX_TRACE_LANES
+};
+
+typedef struct tfx_trace_zone {
+	char name[TFX_TRACE_NAME];
+	uint64_t start;
+	uint64_t end;
+	uint32_t lane;
+	// write index + 1, 0 while being written
+	uint32_t seq;
+} tfx_trace_zone;
+
+static struct {
+	tfx_trace_zone zones[TFX_TRACE_ZONES];
+	uint32_t head;
+	bool enabled;
+} g_trace;
+
+// returns 0 when tracing is off, so the matching trace_end is free.
+static uint64_t trace_begin() {
+	return g_trace.enabled ? tfx_time_ns() : 0;
+}
+
+static void trace_zone(uint32_t lane, const char *name, uint64_t start, uint64_t end) {
+	if (!g_trace.enabled) {
+		return;
+	}
+	uint32_t idx = tfx_atomic_add(&g_trace.head, 1);
+	tfx_trace_zone *zone = &g_trace.zones[idx % TFX_TRACE_ZONES];
+	tfx_atomic_store(&zone->seq, 0);
+	tfx_atomic_fence();
+
+	// names go straight into the json, so keep them free of escapes.
+	int i = 0;
+	for (; i < TFX_TRACE_NAME - 1 && name[i]; i++) {
+		char c = name[i];
+		zone->name[i] = (c == '"' || c == '\\' || (unsigned char)c < 0x20) ? '_' : c;
+	}
+	zone->name[i] = '\0';
+	zone->start = start;
+	zone->end = end;
+	zone->lane = lane;
+	tfx_atomic_store(&zone->seq, idx + 1);
+}
+
+static void trace_end(uint32_t lane, const char *name, uint64_t start) {
+	if (start != 0) {
+		trace_zone(lane, name, start, tfx_time_ns());
+	}
+}
+
+#define VIEW_MAX TFX_MAX_VIEWS
 
 // view flags
 enum {
@@ -147,7 +325,12 @@ enum {
 	TFX_VIEW_DEPTH_TEST_EQ = 1 << 4,
 
 	// scissor test
-	TFX_VIEW_SCISSOR       = 1 << 5
+	TFX_VIEW_SCISSOR       = 1 << 5,
+
+	// has a projection, draws with bounds are frustum culled
+	TFX_VIEW_FRUSTUM       = 1 << 6,
+	// culling turned off with tfx_view_set_culling
+	TFX_VIEW_NO_CULL       = 1 << 7
 };
 
 typedef struct tfx_draw {
@@ -155,7 +338,12 @@ typedef struct tfx_draw {
 	uint64_t flags;
 
 	tfx_program program;
+	// uniforms that were already set before the previous draw, shared
 	tfx_uniform *uniforms;
+	uint32_t uniform_count;
+	// uniforms set since the previous draw, uploaded after the above
+	tfx_uniform *draw_uniforms;
+	uint32_t draw_uniform_count;
 
 	tfx_texture textures[8];
 	tfx_buffer ssbos[8];
@@ -165,6 +353,19 @@ typedef struct tfx_draw {
 
 	tfx_buffer ibo;
 	bool use_ibo;
+	bool ibo_32bit;
+	size_t ibo_offset;
+
+	tfx_buffer instance_vbo;
+	bool use_instance_vbo;
+	size_t instance_offset;
+	// 0 = not instanced, drawn once
+	uint32_t instances;
+
+	// user commands from tfx_submit_indirect
+	tfx_buffer indirect;
+	uint32_t indirect_offset;
+	uint32_t indirect_count;
 
 	tfx_vertex_format tvb_fmt;
 	bool use_tvb;
@@ -175,6 +376,19 @@ typedef struct tfx_draw {
 	size_t offset;
 	uint32_t indices;
 	uint32_t depth;
+	// world space position from submit_at. depth is worked out from it and
+	// the view's transform when the frame is sorted, not on the encoder's
+	// thread, which may not read the views.
+	float depth_pos[3];
+	bool depth_at;
+
+	// world space center (xyz), box half extents (xyz) and sphere radius.
+	float bounds[7];
+	bool use_bounds;
+	tfx_occlusion occlusion;
+
+	// set when this draw stands in for a bundle, its uniforms being the patch.
+	tfx_bundle *bundle;
 
 	// for compute jobs
 	uint32_t threads_x;
@@ -191,8 +405,6 @@ typedef struct tfx_view {
 	tfx_canvas  canvas;
 	int canvas_layer;
 
-	tfx_draw    *draws;
-	tfx_draw    *jobs;
 	tfx_blit_op *blits;
 
 	int   clear_color;
@@ -200,11 +412,80 @@ typedef struct tfx_view {
 
 	tfx_rect scissor_rect;
 
+	tfx_sort_mode sort_mode;
+
 	float view[16];
 	float proj_left[16];
 	float proj_right[16];
 } tfx_view;
 
+struct tfx_encoder {
+	tfx_draw tmp_draw;
+
+	// latest value of every uniform updated this frame, where each uniform id
+	// sits in that list (or -1), and the submit it was last set for.
+	tfx_uniform *uniforms;
+	int32_t *uniform_slots;
+	uint32_t *uniform_serials;
+	uint32_t serial;
+
+	// slots set since the last submit, and the ones set before that one.
+	uint32_t *fresh;
+	uint32_t *last_fresh;
+
+	// everything not set since the last submit, shared by draws until a
+	// uniform stops being set for every draw.
+	tfx_uniform *sticky;
+	uint32_t sticky_count;
+
+	// this encoder's slice of the frame arena
+	uint8_t *ub_cursor;
+	uint8_t *ub_end;
+
+	// which of the frame's draw lists this encoder records into
+	uint32_t index;
+	bool active;
+
+	// recording into a bundle instead of the frame
+	tfx_bundle *bundle;
+
+	// time spent in submit calls this frame
+	uint64_t submit_ns;
+
+	// while capturing, the view (plus 0x100 for jobs) of each submit in the
+	// order they were made.
+	uint16_t *capture_log;
+};
+
+struct tfx_bundle {
+	tfx_encoder encoder;
+	tfx_draw *draws;
+	// uniform data for the recorded draws, never moved once allocated.
+	uint8_t **chunks;
+};
+
+// a draw to translate, and any bundle replay uniforms that go on top of it.
+typedef struct tfx_draw_ref {
+	tfx_draw *draw;
+	tfx_draw *patch;
+	// where this draw's uniform blocks were packed in the frame's buffer
+	uint32_t block_offsets[TFX_MAX_UNIFORM_BLOCKS];
+	// set on the first of a run of draws merged into one multi-draw: how
+	// many there are and where their commands start.
+	uint32_t batch;
+	uint32_t command;
+} tfx_draw_ref;
+
+// DrawElementsIndirectCommand. the arrays version is the same, minus
+// base_vertex, and is written with base_instance in its place.
+typedef struct tfx_indirect_command {
+	uint32_t count;
+	uint32_t instances;
+	uint32_t first;
+	int32_t base_vertex;
+	uint32_t base_instance;
+} tfx_indirect_command;
+
 #define TFX_VIEW_CLEAR_MASK      (TFX_VIEW_CLEAR_COLOR | TFX_VIEW_CLEAR_DEPTH)
 #define TFX_VIEW_DEPTH_TEST_MASK (TFX_VIEW_DEPTH_TEST_LT | TFX_VIEW_DEPTH_TEST_GT | TFX_VIEW_DEPTH_TEST_EQ)
 
@@ -234,6 +515,14 @@ static tfx_glext available_exts[] = {
 	{ "GL_ARB_instanced_arrays", false },
 	{ "GL_ARB_seamless_cube_map", false },
 	{ "GL_EXT_texture_filter_anisotropic", false },
+	{ "GL_ARB_uniform_buffer_object", false },
+	{ "GL_ARB_buffer_storage", false },
+	{ "GL_EXT_buffer_storage", false },
+	{ "GL_ARB_multi_draw_indirect", false },
+	{ "GL_ARB_occlusion_query2", false },
+	{ "GL_NV_conditional_render", false },
+	{ "GL_ARB_timer_query", false },
+	{ "GL_EXT_disjoint_timer_query", false },
 	{ NULL, false }
 };
 
@@ -282,6 +571,15 @@ PFNGLDRAWBUFFERSPROC tfx_glDrawBuffers;
 PFNGLREADBUFFERPROC tfx_glReadBuffer;
 PFNGLCHECKFRAMEBUFFERSTATUSPROC tfx_glCheckFramebufferStatus;
 PFNGLGETUNIFORMLOCATIONPROC tfx_glGetUniformLocation;
+PFNGLGETACTIVEUNIFORMPROC tfx_glGetActiveUniform;
+PFNGLGETACTIVEUNIFORMBLOCKNAMEPROC tfx_glGetActiveUniformBlockName;
+PFNGLGETACTIVEUNIFORMBLOCKIVPROC tfx_glGetActiveUniformBlockiv;
+PFNGLUNIFORMBLOCKBINDINGPROC tfx_glUniformBlockBinding;
+PFNGLBINDBUFFERRANGEPROC tfx_glBindBufferRange;
+PFNGLBUFFERSTORAGEPROC tfx_glBufferStorage;
+PFNGLFENCESYNCPROC tfx_glFenceSync;
+PFNGLCLIENTWAITSYNCPROC tfx_glClientWaitSync;
+PFNGLDELETESYNCPROC tfx_glDeleteSync;
 PFNGLRELEASESHADERCOMPILERPROC tfx_glReleaseShaderCompiler;
 PFNGLGENVERTEXARRAYSPROC tfx_glGenVertexArrays;
 PFNGLBINDVERTEXARRAYPROC tfx_glBindVertexArray;
@@ -316,6 +614,23 @@ PFNGLDISABLEVERTEXATTRIBARRAYPROC tfx_glDisableVertexAttribArray;
 PFNGLACTIVETEXTUREPROC tfx_glActiveTexture;
 PFNGLDRAWELEMENTSINSTANCEDPROC tfx_glDrawElementsInstanced;
 PFNGLDRAWARRAYSINSTANCEDPROC tfx_glDrawArraysInstanced;
+PFNGLVERTEXATTRIBDIVISORPROC tfx_glVertexAttribDivisor;
+PFNGLDRAWELEMENTSINSTANCEDBASEVERTEXPROC tfx_glDrawElementsInstancedBaseVertex;
+PFNGLDRAWARRAYSINDIRECTPROC tfx_glDrawArraysIndirect;
+PFNGLDRAWELEMENTSINDIRECTPROC tfx_glDrawElementsIndirect;
+PFNGLMULTIDRAWARRAYSINDIRECTPROC tfx_glMultiDrawArraysIndirect;
+PFNGLMULTIDRAWELEMENTSINDIRECTPROC tfx_glMultiDrawElementsIndirect;
+PFNGLGENQUERIESPROC tfx_glGenQueries;
+PFNGLDELETEQUERIESPROC tfx_glDeleteQueries;
+PFNGLBEGINQUERYPROC tfx_glBeginQuery;
+PFNGLENDQUERYPROC tfx_glEndQuery;
+PFNGLGETQUERYOBJECTUIVPROC tfx_glGetQueryObjectuiv;
+PFNGLBEGINCONDITIONALRENDERPROC tfx_glBeginConditionalRender;
+PFNGLENDCONDITIONALRENDERPROC tfx_glEndConditionalRender;
+PFNGLQUERYCOUNTERPROC tfx_glQueryCounter;
+PFNGLBLITFRAMEBUFFERPROC tfx_glBlitFramebuffer;
+PFNGLGETQUERYOBJECTUI64VPROC tfx_glGetQueryObjectui64v;
+PFNGLGETINTEGER64VPROC tfx_glGetInteger64v;
 PFNGLDRAWELEMENTSPROC tfx_glDrawElements;
 PFNGLDRAWARRAYSPROC tfx_glDrawArrays;
 PFNGLDELETEVERTEXARRAYSPROC tfx_glDeleteVertexArrays;
@@ -372,6 +687,18 @@ void load_em_up(void* (*get_proc_address)(const char*)) {
 	tfx_glReadBuffer = get_proc_address("glReadBuffer");
 	tfx_glCheckFramebufferStatus = get_proc_address("glCheckFramebufferStatus");
 	tfx_glGetUniformLocation = get_proc_address("glGetUniformLocation");
+	tfx_glGetActiveUniform = get_proc_address("glGetActiveUniform");
+	tfx_glGetActiveUniformBlockName = get_proc_address("glGetActiveUniformBlockName");
+	tfx_glGetActiveUniformBlockiv = get_proc_address("glGetActiveUniformBlockiv");
+	tfx_glUniformBlockBinding = get_proc_address("glUniformBlockBinding");
+	tfx_glBindBufferRange = get_proc_address("glBindBufferRange");
+	tfx_glBufferStorage = get_proc_address("glBufferStorage");
+	if (!tfx_glBufferStorage) {
+		tfx_glBufferStorage = get_proc_address("glBufferStorageEXT");
+	}
+	tfx_glFenceSync = get_proc_address("glFenceSync");
+	tfx_glClientWaitSync = get_proc_address("glClientWaitSync");
+	tfx_glDeleteSync = get_proc_address("glDeleteSync");
 	tfx_glReleaseShaderCompiler = get_proc_address("glReleaseShaderCompiler");
 	tfx_glGenVertexArrays = get_proc_address("glGenVertexArrays");
 	tfx_glBindVertexArray = get_proc_address("glBindVertexArray");
@@ -406,6 +733,44 @@ void load_em_up(void* (*get_proc_address)(const char*)) {
 	tfx_glActiveTexture = get_proc_address("glActiveTexture");
 	tfx_glDrawElementsInstanced = get_proc_address("glDrawElementsInstanced");
 	tfx_glDrawArraysInstanced = get_proc_address("glDrawArraysInstanced");
+	tfx_glVertexAttribDivisor = get_proc_address("glVertexAttribDivisor");
+	if (!tfx_glVertexAttribDivisor) {
+		tfx_glVertexAttribDivisor = get_proc_address("glVertexAttribDivisorARB");
+	}
+	tfx_glDrawElementsInstancedBaseVertex = get_proc_address("glDrawElementsInstancedBaseVertex");
+	if (!tfx_glDrawElementsInstancedBaseVertex) {
+		tfx_glDrawElementsInstancedBaseVertex = get_proc_address("glDrawElementsInstancedBaseVertexOES");
+	}
+	tfx_glDrawArraysIndirect = get_proc_address("glDrawArraysIndirect");
+	tfx_glDrawElementsIndirect = get_proc_address("glDrawElementsIndirect");
+	tfx_glMultiDrawArraysIndirect = get_proc_address("glMultiDrawArraysIndirect");
+	tfx_glMultiDrawElementsIndirect = get_proc_address("glMultiDrawElementsIndirect");
+	tfx_glGenQueries = get_proc_address("glGenQueries");
+	tfx_glDeleteQueries = get_proc_address("glDeleteQueries");
+	tfx_glBeginQuery = get_proc_address("glBeginQuery");
+	tfx_glEndQuery = get_proc_address("glEndQuery");
+	tfx_glGetQueryObjectuiv = get_proc_address("glGetQueryObjectuiv");
+	tfx_glBeginConditionalRender = get_proc_address("glBeginConditionalRender");
+	if (!tfx_glBeginConditionalRender) {
+		tfx_glBeginConditionalRender = get_proc_address("glBeginConditionalRenderNV");
+	}
+	tfx_glEndConditionalRender = get_proc_address("glEndConditionalRender");
+	if (!tfx_glEndConditionalRender) {
+		tfx_glEndConditionalRender = get_proc_address("glEndConditionalRenderNV");
+	}
+	tfx_glBlitFramebuffer = get_proc_address("glBlitFramebuffer");
+	tfx_glQueryCounter = get_proc_address("glQueryCounter");
+	if (!tfx_glQueryCounter) {
+		tfx_glQueryCounter = get_proc_address("glQueryCounterEXT");
+	}
+	tfx_glGetQueryObjectui64v = get_proc_address("glGetQueryObjectui64v");
+	if (!tfx_glGetQueryObjectui64v) {
+		tfx_glGetQueryObjectui64v = get_proc_address("glGetQueryObjectui64vEXT");
+	}
+	tfx_glGetInteger64v = get_proc_address("glGetInteger64v");
+	if (!tfx_glGetInteger64v) {
+		tfx_glGetInteger64v = get_proc_address("glGetInteger64vEXT");
+	}
 	tfx_glDrawElements = get_proc_address("glDrawElements");
 	tfx_glDrawArrays = get_proc_address("glDrawArrays");
 	tfx_glDeleteVertexArrays = get_proc_address("glDeleteVertexArrays");
@@ -418,6 +783,80 @@ void load_em_up(void* (*get_proc_address)(const char*)) {
 
 static tfx_platform_data g_platform_data;
 
+typedef enum tfx_rt_state {
+	TFX_RT_IDLE = 0,
+	// handed over by tfx_frame, waiting for the render thread
+	TFX_RT_SUBMITTED,
+	TFX_RT_RENDERING
+} tfx_rt_state;
+
+typedef struct tfx_rt_call {
+	void (*fn)(void *arg);
+	void *arg;
+	bool done;
+} tfx_rt_call;
+
+// render thread mode. the app thread records frame N+1 while the render
+// thread (which owns the GL context) executes frame N. anything else that
+// touches GL is forwarded to the render thread with rt_call.
+static struct {
+	bool enabled;
+	bool quit;
+	bool has_thread;
+	tfx_thread_id thread;
+	tfx_mutex lock;
+	tfx_cond cond;
+	tfx_rt_state state;
+	// only the app thread makes calls, so there's at most one.
+	tfx_rt_call *call;
+	// stats from the last frame the render thread finished
+	tfx_stats stats;
+} g_rt;
+
+// true if GL work needs to be forwarded to the render thread.
+static bool rt_remote() {
+	if (!g_rt.enabled) {
+		return false;
+	}
+	tfx_mutex_lock(&g_rt.lock);
+	bool remote = !g_rt.has_thread || !tfx_thread_equal(g_rt.thread, tfx_thread_self());
+	tfx_mutex_unlock(&g_rt.lock);
+	return remote;
+}
+
+// run fn on the render thread and wait for it. the frame in flight is
+// finished first, so calls keep the same order relative to frames as they
+// would have without a render thread.
+static void rt_call(void (*fn)(void*), void *arg) {
+	tfx_rt_call call;
+	call.fn = fn;
+	call.arg = arg;
+	call.done = false;
+
+	tfx_mutex_lock(&g_rt.lock);
+	while (g_rt.state != TFX_RT_IDLE || g_rt.call != NULL) {
+		tfx_cond_wait(&g_rt.cond, &g_rt.lock);
+	}
+	g_rt.call = &call;
+	tfx_cond_broadcast(&g_rt.cond);
+	while (!call.done) {
+		tfx_cond_wait(&g_rt.cond, &g_rt.lock);
+	}
+	tfx_mutex_unlock(&g_rt.lock);
+}
+
+// wait for the render thread to be done with the frame in flight.
+static void rt_wait_idle() {
+	if (!g_rt.enabled) {
+		return;
+	}
+	tfx_mutex_lock(&g_rt.lock);
+	while (g_rt.state != TFX_RT_IDLE) {
+		tfx_cond_wait(&g_rt.cond, &g_rt.lock);
+	}
+	tfx_mutex_unlock(&g_rt.lock);
+}
+
 static void tfx_printf(tfx_severity severity, const char *fmt, ...) {
 	va_list args;
 	va_start(args, fmt);
@@ -437,10 +876,19 @@ static void tfx_printb(tfx_severity severity, const char *k, bool v) {
 	tfx_printf(severity, "TinyFX %s: %s", k, v ? "true" : "false");
 }
 
+static void get_caps_thunk(void *arg) {
+	*(tfx_caps*)arg = tfx_get_caps();
+}
+
 tfx_caps tfx_get_caps() {
 	tfx_caps caps;
 	memset(&caps, 0, sizeof(tfx_caps));
 
+	if (rt_remote()) {
+		rt_call(get_caps_thunk, &caps);
+		return caps;
+	}
+
 	if (tfx_glGetStringi) {
 		GLint ext_count = 0;
 		CHECK(tfx_glGetIntegerv(GL_NUM_EXTENSIONS, &ext_count));
@@ -495,9 +943,11 @@ tfx_caps tfx_get_caps() {
 	}
 
 	bool gl30 = g_platform_data.context_version >= 30 && !g_platform_data.use_gles;
+	bool gl31 = g_platform_data.context_version >= 31 && !g_platform_data.use_gles;
 	bool gl32 = g_platform_data.context_version >= 32 && !g_platform_data.use_gles;
 	bool gl33 = g_platform_data.context_version >= 33 && !g_platform_data.use_gles;
 	bool gl43 = g_platform_data.context_version >= 43 && !g_platform_data.use_gles;
+	bool gl44 = g_platform_data.context_version >= 44 && !g_platform_data.use_gles;
 	bool gl46 = g_platform_data.context_version >= 46 && !g_platform_data.use_gles;
 	bool gles30 = g_platform_data.context_version >= 30 && g_platform_data.use_gles;
 	bool gles31 = g_platform_data.context_version >= 31 && g_platform_data.use_gles;
@@ -511,11 +961,26 @@ tfx_caps tfx_get_caps() {
 	caps.instancing = available_exts[7].supported || gl33 || gles30;
 	caps.seamless_cubemap = available_exts[8].supported || gl32;
 	caps.anisotropic_filtering = available_exts[9].supported || gl46;
+	caps.uniform_buffers = available_exts[10].supported || gl31 || gles30;
+	caps.buffer_storage = available_exts[11].supported || available_exts[12].supported || gl44;
+	caps.multi_draw_indirect = available_exts[13].supported || gl43;
+	caps.occlusion_query = available_exts[14].supported || gl33 || gles30;
+	caps.conditional_render = available_exts[15].supported || gl30;
+	caps.timer_query = available_exts[16].supported || available_exts[17].supported || gl33;
 
 	return caps;
 }
 
+static void dump_caps_thunk(void *arg) {
+	tfx_dump_caps();
+}
+
 void tfx_dump_caps() {
+	if (rt_remote()) {
+		rt_call(dump_caps_thunk, NULL);
+		return;
+	}
+
 	tfx_caps caps = tfx_get_caps();
 
 	// I am told by the docs that this can be 0.
@@ -565,17 +1030,15 @@ void tfx_dump_caps() {
 	tfx_printb(TFX_SEVERITY_INFO, "compute", caps.compute);
 	tfx_printb(TFX_SEVERITY_INFO, "fp canvas", caps.float_canvas);
 	tfx_printb(TFX_SEVERITY_INFO, "multisample", caps.multisample);
+	tfx_printb(TFX_SEVERITY_INFO, "uniform buffers", caps.uniform_buffers);
+	tfx_printb(TFX_SEVERITY_INFO, "buffer storage", caps.buffer_storage);
+	tfx_printb(TFX_SEVERITY_INFO, "multi-draw indirect", caps.multi_draw_indirect);
 }
 
 // this is all definitely not the simplest way to deal with maps for uniform
-// caches, but it's the simplest way I know which handles collisions.
+// names, but it's the simplest way I know which handles collisions.
 #define TFX_HASHSIZE 101
 
-typedef struct tfx_set {
-	struct tfx_set *next;
-	const char *key;
-} tfx_set;
-
 static unsigned tfx_hash(const char *s) {
 	unsigned hashval;
 	for (hashval = 0; *s != '\0'; s++)
@@ -583,53 +1046,10 @@ static unsigned tfx_hash(const char *s) {
 	return hashval % TFX_HASHSIZE;
 }
 
-static unsigned tfx_nohash(unsigned id) {
-	return id % TFX_HASHSIZE;
-}
-
-static bool tfx_slookup(tfx_set **hashtab, const char *s) {
-#ifdef TFX_DEBUG
-	assert(s);
-#endif
-	struct tfx_set *np;
-	for (np = hashtab[tfx_hash(s)]; np != NULL; np = np->next) {
-		if (strcmp(s, np->key) == 0) {
-			return true;
-		}
-		//TFX_WARN("collision\n");
-	}
-	return false;
-}
-
-static void tfx_sset(tfx_set **hashtab, const char *name) {
-	if (tfx_slookup(hashtab, name)) {
-		return;
-	}
-
-	unsigned hashval = tfx_hash(name);
-	tfx_set *np = malloc(sizeof(tfx_set));
-	np->key = name;
-	np->next = hashtab[hashval];
-	hashtab[hashval] = np;
-}
-
-static tfx_set **tfx_set_new() {
-	return calloc(sizeof(tfx_set*), TFX_HASHSIZE);
-}
-
-static void tfx_set_delete(tfx_set **hashtab) {
-	for (int i = 0; i < TFX_HASHSIZE; i++) {
-		if (hashtab[i] != NULL) {
-			free(hashtab[i]);
-		}
-	}
-	free(hashtab);
-}
-
 typedef struct tfx_locmap {
 	struct tfx_locmap *next;
 	const char *key;
-	GLuint value; // uniform location
+	GLint value; // uniform id
 } tfx_locmap;
 
 static tfx_locmap *tfx_loclookup(tfx_locmap **hashtab, const char *s) {
@@ -646,7 +1066,7 @@ static tfx_locmap *tfx_loclookup(tfx_locmap **hashtab, const char *s) {
 	return NULL;
 }
 
-static tfx_locmap* tfx_locset(tfx_locmap **hashtab, const char *name, GLuint value) {
+static tfx_locmap* tfx_locset(tfx_locmap **hashtab, const char *name, GLint value) {
 	tfx_locmap *found = tfx_loclookup(hashtab, name);
 	if (found) {
 		return NULL;
@@ -667,448 +1087,2274 @@ static tfx_locmap **tfx_locmap_new() {
 
 static void tfx_locmap_delete(tfx_locmap **hashtab) {
 	for (int i = 0; i < TFX_HASHSIZE; i++) {
-		if (hashtab[i] != NULL) {
-			free(hashtab[i]);
+		tfx_locmap *np = hashtab[i];
+		while (np != NULL) {
+			tfx_locmap *next = np->next;
+			free(np);
+			np = next;
 		}
 	}
 	free(hashtab);
 }
 
-typedef struct tfx_shadermap {
-	struct tfx_shadermap *next;
-	GLint key; // shader program
-	tfx_locmap **value;
-} tfx_shadermap;
-
-static tfx_shadermap *tfx_proglookup(tfx_shadermap **hashtab, GLint program) {
-#ifdef TFX_DEBUG
-	assert(program);
-#endif
-	struct tfx_shadermap *np;
-	for (np = hashtab[tfx_nohash(program)]; np != NULL; np = np->next) {
-		if (program == np->key) {
-			return np;
-		}
-		//TFX_WARN("collision\n");
+// std140 uniform blocks. members are laid out as they're declared, the
+// contents are only touched by the GL thread.
+typedef struct tfx_uniform_block {
+	char *name;
+	uint32_t size;
+	uint32_t *members;
+	uint32_t *member_offsets;
+	// as declared, for captures to declare them again
+	tfx_uniform_type *member_types;
+	int *member_counts;
+
+	// current contents, and where they were last packed this frame.
+	uint8_t *image;
+	uint32_t image_size;
+	uint32_t packed_offset;
+	bool packed;
+} tfx_uniform_block;
+
+static tfx_uniform_block g_blocks[TFX_MAX_UNIFORM_BLOCKS];
+static int g_block_count = 0;
+
+// uniform names are interned into small ids, so that draws can find their
+// locations in a program with a plain array lookup.
+static char **g_uniform_names = NULL;
+static tfx_locmap **g_uniform_ids = NULL;
+
+static uint32_t uniform_intern(const char *name) {
+	if (!g_uniform_ids) {
+		g_uniform_ids = tfx_locmap_new();
 	}
-	return NULL;
-}
-
-static tfx_shadermap* tfx_progset(tfx_shadermap **hashtab, GLint program) {
-	tfx_shadermap *found = tfx_proglookup(hashtab, program);
+	tfx_locmap *found = tfx_loclookup(g_uniform_ids, name);
 	if (found) {
-		return found;
-	}
-
-	unsigned hashval = tfx_nohash(program);
-	tfx_shadermap *np = malloc(sizeof(tfx_shadermap));
-	np->key = program;
-	np->next = hashtab[hashval];
-	np->value = tfx_locmap_new();
-	hashtab[hashval] = np;
-	return np;
-}
-
-static tfx_shadermap **tfx_progmap_new() {
-	return calloc(sizeof(tfx_shadermap*), TFX_HASHSIZE);
-}
-
-static void tfx_progmap_delete(tfx_shadermap **hashtab) {
-	for (int i = 0; i < TFX_HASHSIZE; i++) {
-		if (hashtab[i] != NULL) {
-			tfx_locmap_delete(hashtab[i]->value);
-			free(hashtab[i]);
-		}
+		return (uint32_t)found->value;
 	}
-	free(hashtab);
+	char *key = tfx_strdup(name);
+	uint32_t id = (uint32_t)sb_count(g_uniform_names);
+	sb_push(g_uniform_names, key);
+	tfx_locset(g_uniform_ids, key, (GLint)id);
+	return id;
 }
 
-// uniforms updated this frame
-static tfx_uniform *g_uniforms = NULL;
-static uint8_t *g_uniform_buffer = NULL;
-static uint8_t *g_ub_cursor = NULL;
-static tfx_shadermap **g_uniform_map = NULL;
-
 static tfx_view g_views[VIEW_MAX];
 
+typedef struct tfx_texture_upload {
+	tfx_texture *texture;
+	void *data;
+} tfx_texture_upload;
+
+// everything recorded for one frame. with a render thread there are two of
+// these, one being recorded while the other is executed.
+typedef struct tfx_frame_data {
+	// per encoder and view
+	tfx_draw *draws[TFX_MAX_ENCODERS][VIEW_MAX];
+	tfx_draw *jobs[TFX_MAX_ENCODERS][VIEW_MAX];
+	uint32_t encoder_count;
+
+	// g_views, or a copy of it taken at submit with a render thread.
+	tfx_view *views;
+	tfx_view *view_storage;
+
+	// linear allocator for uniform data and draw uniform lists.
+	uint8_t *arena;
+	uint32_t arena_size;
+	// keeps counting past arena_size, so it ends up as the high-water mark.
+	uint32_t arena_offset;
+	// heap chunks handed out once the arena was full, freed on reset.
+	uint8_t **arena_overflow;
+	tfx_mutex arena_lock;
+
+	// points into the mapped transient buffer when persistently mapped,
+	// otherwise a copy uploaded when the frame is rendered.
+	uint8_t *transient_data;
+	uint32_t transient_offset;
+	// where transient_data sits in the GL buffer
+	uint32_t transient_base;
+
+	tfx_texture_upload *texture_updates;
+
+	// summed over the encoders' submit calls
+	uint64_t submit_ns;
+} tfx_frame_data;
+
+static tfx_frame_data g_frames[2];
+static tfx_frame_data *g_submit_frame = &g_frames[0];
+static tfx_frame_data *g_render_frame = &g_frames[0];
+
+// encoder 0 is used by the tfx_set_*/tfx_submit functions.
+static tfx_encoder g_encoders[TFX_MAX_ENCODERS];
+static uint32_t g_encoder_count = 1;
+
+// draws from every encoder (and replayed bundles), gathered and sorted for
+// every view before translating any of them.
+static tfx_draw_ref *g_frame_draws = NULL;
+static tfx_draw_ref *g_frame_jobs = NULL;
+
+typedef struct tfx_view_range {
+	uint32_t first_draw;
+	uint32_t draws;
+	uint32_t first_job;
+	uint32_t jobs;
+} tfx_view_range;
+
+static tfx_view_range g_view_ranges[VIEW_MAX];
+
+// sort scratch, kept around between frames.
+static uint64_t *g_sort_keys = NULL;
+static uint64_t *g_sort_tmp_keys = NULL;
+static uint32_t *g_sort_values = NULL;
+static uint32_t *g_sort_tmp_values = NULL;
+static tfx_draw_ref *g_sort_refs = NULL;
+
+// cull scratch: bounds of a view's draws split into one array per component
+// (cx, cy, cz, ex, ey, ez, r), each padded to a multiple of 4.
+static float *g_cull_soa = NULL;
+static uint8_t *g_cull_visible = NULL;
+
+// with buffer storage, transient data is written straight into a
+// persistently mapped buffer, split into a region per frame in flight and
+// guarded by fences. otherwise it is orphaned and re-uploaded every frame.
 static struct {
-	uint8_t *data;
-	uint32_t offset;
 	tfx_buffer buf;
+	uint8_t *mapped;
+	GLsync fences[TFX_TRANSIENT_REGIONS];
+	// frames rendered, and the region the next recorded frame writes to.
+	uint32_t frame;
+	uint32_t next_region;
 } g_transient_buffer;
 
-static tfx_caps g_caps;
+// every uniform block update of the frame, uploaded in one go.
+static struct {
+	GLuint gl_id;
+	uint32_t capacity;
+	uint32_t align;
+	uint8_t *staging;
+} g_block_buffer;
+
+// everything a vertex array object captures, but where instance data starts:
+// transient instance data moves around the ring every frame, so that is
+// re-pointed on a hit instead of costing a VAO per offset.
+typedef struct tfx_vao_key {
+	GLuint vbo;
+	GLuint ibo;
+	GLuint instance_vbo;
+	uint32_t offset;
+	tfx_vertex_format format;
+	tfx_vertex_format instance_format;
+} tfx_vao_key;
+
+typedef struct tfx_vao_entry {
+	tfx_vao_key key;
+	uint32_t hash;
+	uint32_t last_used;
+	GLuint gl_id;
+	// where the instance attributes point now, and from which location
+	size_t instance_offset;
+	int instance_first;
+	uint32_t divisors[TFX_MAX_ATTRIBS];
+} tfx_vao_entry;
 
-// fallback printf
-static void basic_log(const char *msg, tfx_severity level) {
-	printf("%s\n", msg);
+static struct {
+	tfx_vao_entry entries[TFX_VAO_CACHE_SIZE];
+	int count;
+	uint32_t tick;
+	// entry of the last lookup
+	int last;
+} g_vao_cache;
+
+// shadow of the GL binding and enable state used to render a frame, so
+// redundant calls never reach the driver. anything outside render_frame
+// (resource creation, the app, draw callbacks) may change GL state behind its
+// back, so it is forgotten at the start of each frame and after callbacks.
+#define TFX_GL_UNKNOWN 0xffffffff
+
+typedef enum tfx_gl_cap {
+	TFX_GL_SCISSOR_TEST = 0,
+	TFX_GL_DEPTH_TEST,
+	TFX_GL_BLEND,
+	TFX_GL_CULL_FACE,
+	TFX_GL_MULTISAMPLE,
+	TFX_GL_CAP_COUNT
+} tfx_gl_cap;
+
+typedef enum tfx_gl_buffer_target {
+	TFX_GL_ARRAY_BUFFER = 0,
+	TFX_GL_UNIFORM_BUFFER,
+	TFX_GL_DRAW_INDIRECT_BUFFER,
+	TFX_GL_SHADER_STORAGE_BUFFER,
+	TFX_GL_BUFFER_TARGET_COUNT
+} tfx_gl_buffer_target;
+
+static const GLenum g_gl_caps[TFX_GL_CAP_COUNT] = {
+	GL_SCISSOR_TEST, GL_DEPTH_TEST, GL_BLEND, GL_CULL_FACE, GL_MULTISAMPLE
+};
+
+static const GLenum g_gl_buffer_targets[TFX_GL_BUFFER_TARGET_COUNT] = {
+	GL_ARRAY_BUFFER, GL_UNIFORM_BUFFER, GL_DRAW_INDIRECT_BUFFER, GL_SHADER_STORAGE_BUFFER
+};
+
+// calls the shadow let through and dropped this frame
+typedef struct tfx_gl_counts {
+	uint32_t changes;
+	uint32_t skipped;
+	uint32_t program_binds;
+	uint32_t texture_binds;
+	uint32_t buffer_binds;
+} tfx_gl_counts;
+
+static struct {
+	GLuint program;
+	GLuint vao;
+	GLuint framebuffer;
+	GLuint buffers[TFX_GL_BUFFER_TARGET_COUNT];
+	GLuint storage[8];
+	uint32_t active_texture;
+	// 2D and cube map per unit
+	GLuint textures[8][2];
+	uint32_t enabled[TFX_GL_CAP_COUNT];
+	GLint scissor[4];
+	GLint viewport[4];
+	GLenum blend_src, blend_dst;
+	GLenum depth_func;
+	GLenum front_face;
+	uint32_t depth_mask;
+	uint32_t color_mask;
+	// kept when state is forgotten
+	tfx_gl_counts counts;
+} g_gl;
+
+static void gl_forget() {
+	tfx_gl_counts counts = g_gl.counts;
+	memset(&g_gl, 0xff, sizeof(g_gl));
+	g_gl.counts = counts;
 }
 
-static void tvb_reset() {
-	g_transient_buffer.offset = 0;
+// true if the shadowed value needs setting, and records it.
+static bool gl_update(uint32_t *shadow, uint32_t value) {
+	if (*shadow == value) {
+		g_gl.counts.skipped++;
+		return false;
+	}
+	*shadow = value;
+	g_gl.counts.changes++;
+	return true;
+}
 
-	if (!g_transient_buffer.buf.gl_id) {
-		GLuint id;
-		CHECK(tfx_glGenBuffers(1, &id));
-		CHECK(tfx_glBindBuffer(GL_ARRAY_BUFFER, id));
-		CHECK(tfx_glBufferData(GL_ARRAY_BUFFER, TFX_TRANSIENT_BUFFER_SIZE, NULL, GL_DYNAMIC_DRAW));
-		g_transient_buffer.buf.gl_id = id;
+static void gl_use_program(GLuint program) {
+	if (gl_update(&g_gl.program, program)) {
+		g_gl.counts.program_binds++;
+		CHECK(tfx_glUseProgram(program));
 	}
 }
 
-void tfx_set_platform_data(tfx_platform_data pd) {
-	// supported: GL > 3, 2.1, ES 2.0, ES 3.0+
-	assert(0
-		|| (pd.context_version >= 30)
-		|| (pd.use_gles && pd.context_version == 20)
-		|| (!pd.use_gles && pd.context_version == 21)
-	);
-	if (pd.info_log == NULL) {
-		pd.info_log = &basic_log;
+static void gl_bind_vertex_array(GLuint vao) {
+	if (gl_update(&g_gl.vao, vao)) {
+		CHECK(tfx_glBindVertexArray(vao));
 	}
-	memcpy(&g_platform_data, &pd, sizeof(tfx_platform_data));
 }
 
-// null format = index buffer
-tfx_transient_buffer tfx_transient_buffer_new(tfx_vertex_format *fmt, uint16_t num_verts) {
-	// transient index buffers aren't supported yet
-	assert(fmt != NULL);
-	assert(fmt->stride > 0);
+static void gl_bind_framebuffer(GLuint fbo) {
+	if (gl_update(&g_gl.framebuffer, fbo)) {
+		CHECK(tfx_glBindFramebuffer(GL_FRAMEBUFFER, fbo));
+	}
+}
 
-	tfx_transient_buffer buf;
-	memset(&buf, 0, sizeof(tfx_transient_buffer));
-	buf.data = g_transient_buffer.data + g_transient_buffer.offset;
-	buf.num = num_verts;
-	buf.offset = g_transient_buffer.offset;
-	uint32_t stride = sizeof(uint16_t);
-	if (fmt) {
-		buf.has_format = true;
-		buf.format = *fmt;
-		stride = fmt->stride;
+static void gl_bind_buffer(tfx_gl_buffer_target target, GLuint buffer) {
+	if (gl_update(&g_gl.buffers[target], buffer)) {
+		g_gl.counts.buffer_binds++;
+		CHECK(tfx_glBindBuffer(g_gl_buffer_targets[target], buffer));
 	}
-	g_transient_buffer.offset += (uint32_t)(num_verts * stride);
-	g_transient_buffer.offset += g_transient_buffer.offset % 4; // align, in case the stride is weird
-	return buf;
 }
 
-// null format = available indices (uint16)
-uint32_t tfx_transient_buffer_get_available(tfx_vertex_format *fmt) {
-	assert(fmt->stride > 0);
-	uint32_t avail = TFX_TRANSIENT_BUFFER_SIZE;
-	avail -= g_transient_buffer.offset;
-	uint32_t stride = sizeof(uint16_t);
-	if (fmt) {
-		stride = fmt->stride;
+static void gl_bind_storage(GLuint index, GLuint buffer) {
+	if (gl_update(&g_gl.storage[index], buffer)) {
+		g_gl.counts.buffer_binds++;
+		CHECK(tfx_glBindBufferBase(GL_SHADER_STORAGE_BUFFER, index, buffer));
+		// binding an indexed target binds the generic one too
+		g_gl.buffers[TFX_GL_SHADER_STORAGE_BUFFER] = buffer;
 	}
-	avail /= (uint32_t)stride;
-	return avail;
 }
 
-static tfx_program *g_programs = NULL;
-static tfx_texture *g_textures = NULL;
-static tfx_reset_flags g_flags = TFX_RESET_NONE;
-static float g_max_aniso = 0.0f;
+static void gl_bind_texture(uint32_t unit, GLenum target, GLuint texture) {
+	GLuint *shadow = &g_gl.textures[unit][target == GL_TEXTURE_CUBE_MAP ? 1 : 0];
+	if (*shadow == texture) {
+		g_gl.counts.skipped++;
+		return;
+	}
+	if (gl_update(&g_gl.active_texture, unit)) {
+		CHECK(tfx_glActiveTexture(GL_TEXTURE0 + unit));
+	}
+	*shadow = texture;
+	g_gl.counts.changes++;
+	g_gl.counts.texture_binds++;
+	CHECK(tfx_glBindTexture(target, texture));
+}
 
-void tfx_reset(uint16_t width, uint16_t height, tfx_reset_flags flags) {
-	if (g_platform_data.gl_get_proc_address != NULL) {
-		load_em_up(g_platform_data.gl_get_proc_address);
+static void gl_set_enabled(tfx_gl_cap cap, bool enabled) {
+	if (gl_update(&g_gl.enabled[cap], enabled)) {
+		if (enabled) {
+			CHECK(tfx_glEnable(g_gl_caps[cap]));
+		}
+		else {
+			CHECK(tfx_glDisable(g_gl_caps[cap]));
+		}
 	}
+}
 
+static bool gl_update_rect(GLint *shadow, GLint x, GLint y, GLint w, GLint h) {
+	if (shadow[0] == x && shadow[1] == y && shadow[2] == w && shadow[3] == h) {
+		g_gl.counts.skipped++;
+		return false;
+	}
+	shadow[0] = x;
+	shadow[1] = y;
+	shadow[2] = w;
+	shadow[3] = h;
+	g_gl.counts.changes++;
+	return true;
+}
 
-	g_caps = tfx_get_caps();
-	// we require these, unless/until backporting for pre-compute HW.
-	assert(g_caps.instancing);
-	assert(g_caps.compute);
+static void gl_scissor(GLint x, GLint y, GLint w, GLint h) {
+	if (gl_update_rect(g_gl.scissor, x, y, w, h)) {
+		CHECK(tfx_glScissor(x, y, w, h));
+	}
+}
 
-	g_flags = TFX_RESET_NONE;
-	if (g_caps.anisotropic_filtering && (flags & TFX_RESET_MAX_ANISOTROPY) == TFX_RESET_MAX_ANISOTROPY) {
-		g_flags |= TFX_RESET_MAX_ANISOTROPY;
+static void gl_viewport(GLint x, GLint y, GLint w, GLint h) {
+	if (gl_update_rect(g_gl.viewport, x, y, w, h)) {
+		CHECK(tfx_glViewport(x, y, w, h));
 	}
+}
 
-	memset(&g_backbuffer, 0, sizeof(tfx_canvas));
-	g_backbuffer.allocated = 1;
-	g_backbuffer.gl_fbo = 0;
-	g_backbuffer.width = width;
-	g_backbuffer.height = height;
+static void gl_blend_func(GLenum src, GLenum dst) {
+	if (g_gl.blend_src == src && g_gl.blend_dst == dst) {
+		g_gl.counts.skipped++;
+		return;
+	}
+	g_gl.blend_src = src;
+	g_gl.blend_dst = dst;
+	g_gl.counts.changes++;
+	CHECK(tfx_glBlendFunc(src, dst));
+}
 
-	if (!g_uniform_buffer) {
-		g_uniform_buffer = (uint8_t*)malloc(TFX_UNIFORM_BUFFER_SIZE);
-		memset(g_uniform_buffer, 0, TFX_UNIFORM_BUFFER_SIZE);
-		g_ub_cursor = g_uniform_buffer;
+static void gl_depth_func(GLenum func) {
+	if (gl_update(&g_gl.depth_func, func)) {
+		CHECK(tfx_glDepthFunc(func));
 	}
+}
 
-	if (!g_transient_buffer.data) {
-		g_transient_buffer.data = (uint8_t*)malloc(TFX_TRANSIENT_BUFFER_SIZE);
-		memset(g_transient_buffer.data, 0xfc, TFX_TRANSIENT_BUFFER_SIZE);
-		tvb_reset();
+static void gl_front_face(GLenum mode) {
+	if (gl_update(&g_gl.front_face, mode)) {
+		CHECK(tfx_glFrontFace(mode));
 	}
+}
 
-	if (!g_uniform_map) {
-		g_uniform_map = tfx_progmap_new();
+static void gl_depth_mask(bool write) {
+	if (gl_update(&g_gl.depth_mask, write)) {
+		CHECK(tfx_glDepthMask(write));
 	}
+}
 
-	// update every already loaded texture's anisotropy to max (typically 16) or 0
-	if (g_caps.anisotropic_filtering) {
-		g_max_aniso = 0.0f;
-		GLenum GL_TEXTURE_MAX_ANISOTROPY_EXT = 0x84FE;
-		if ((g_flags & TFX_RESET_MAX_ANISOTROPY) == TFX_RESET_MAX_ANISOTROPY) {
-			GLenum GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT = 0x84FF;
-			CHECK(tfx_glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &g_max_aniso));
-		}
-		int nt = sb_count(g_textures);
-		for (int i = 0; i < nt; i++) {
-			tfx_texture *tex = &g_textures[i];
-			for (unsigned j = 0; j < tex->gl_count; j++) {
-				GLenum fmt = GL_TEXTURE_2D;
-				if ((tex->flags & TFX_TEXTURE_CUBE) == TFX_TEXTURE_CUBE) {
-					fmt = GL_TEXTURE_CUBE_MAP;
-				}
-				CHECK(tfx_glBindTexture(fmt, tex->gl_ids[j]));
-				CHECK(tfx_glTexParameterf(fmt, GL_TEXTURE_MAX_ANISOTROPY_EXT, g_max_aniso));
-			}
-		}
+static void gl_color_mask(bool r, bool g, bool b, bool a) {
+	if (gl_update(&g_gl.color_mask, r | (g << 1) | (b << 2) | (a << 3))) {
+		CHECK(tfx_glColorMask(r, g, b, a));
 	}
+}
 
-#ifdef _MSC_VER
-	if (g_caps.memory_info) {
-		GLint memory;
-		// GPU_MEMORY_INFO_TOTAL_AVAILABLE_MEMORY_NVX    
-		CHECK(tfx_glGetIntegerv(0x9048, &memory));
-		char buf[64];
-		snprintf(buf, 64, "VRAM: %dMiB\n", memory / 1024);
-		OutputDebugString(buf);
+static void vao_cache_clear() {
+	for (int i = 0; i < g_vao_cache.count; i++) {
+		tfx_glDeleteVertexArrays(1, &g_vao_cache.entries[i].gl_id);
 	}
-#endif
-
-	memset(&g_views, 0, sizeof(tfx_view)*VIEW_MAX);
+	memset(&g_vao_cache, 0, sizeof(g_vao_cache));
+	g_gl.vao = TFX_GL_UNKNOWN;
 }
 
-void tfx_shutdown() {
-	tfx_frame();
-
-	// TODO: clean up all GL objects, allocs, etc.
-	free(g_uniform_buffer);
-	g_uniform_buffer = NULL;
-
-	free(g_transient_buffer.data);
-	g_transient_buffer.data = NULL;
+#define TFX_MAX_OCCLUSION 1024
+// queries a handle may have in flight before new ones are held back
+#define TFX_OCCLUSION_LATENCY 4
+
+typedef struct tfx_occlusion_slot {
+	// oldest first
+	GLuint queries[TFX_OCCLUSION_LATENCY];
+	uint32_t pending;
+	// from the newest result read back, true until there is one
+	bool visible;
+	bool active;
+} tfx_occlusion_slot;
+
+// occlusion handles, the pool of idle query objects and the unit box drawn
+// as a proxy for hidden draws.
+static struct {
+	tfx_occlusion_slot slots[TFX_MAX_OCCLUSION];
+	uint32_t used;
+	GLuint *free_queries;
+	GLuint program;
+	GLint clip_loc;
+	GLint center_loc;
+	GLint extent_loc;
+	tfx_buffer vbo;
+	tfx_buffer ibo;
+} g_occlusion;
 
-	if (g_transient_buffer.buf.gl_id) {
-		tfx_glDeleteBuffers(1, &g_transient_buffer.buf.gl_id);
+static void occlusion_clear() {
+	for (uint32_t i = 0; i < g_occlusion.used; i++) {
+		tfx_occlusion_slot *slot = &g_occlusion.slots[i];
+		if (slot->pending > 0) {
+			tfx_glDeleteQueries(slot->pending, slot->queries);
+		}
 	}
-
-	if (g_uniform_map) {
-		tfx_progmap_delete(g_uniform_map);
-		g_uniform_map = NULL;
+	int nq = sb_count(g_occlusion.free_queries);
+	if (nq > 0) {
+		tfx_glDeleteQueries(nq, g_occlusion.free_queries);
 	}
-
-	// this can happen if you shutdown before calling frame()
-	if (g_uniforms) {
-		sb_free(g_uniforms);
-		g_uniforms = NULL;
+	sb_free(g_occlusion.free_queries);
+	if (g_occlusion.program) {
+		tfx_glDeleteProgram(g_occlusion.program);
+		tfx_glDeleteBuffers(1, &g_occlusion.vbo.gl_id);
+		tfx_glDeleteBuffers(1, &g_occlusion.ibo.gl_id);
 	}
+	memset(&g_occlusion, 0, sizeof(g_occlusion));
+}
 
-	int nt = sb_count(g_textures);
-	while (nt-- > 0) {
-		tfx_texture_free(&g_textures[nt]);
-	}
+// frames of timestamps in flight, read back when a slot comes around again
+#define TFX_TIMER_FRAMES 4
+// a mark before resource updates, one per view and one at the end
+#define TFX_TIMER_MARKS (VIEW_MAX + 2)
 
-	tfx_glUseProgram(0);
-	int np = sb_count(g_programs);
-	for (int i = 0; i < np; i++) {
-		tfx_glDeleteProgram(g_programs[i]);
+// GPU timestamps taken as each view starts, so a view's time runs until the
+// next mark. views with nothing to draw are skipped without any GL work.
+static struct {
+	struct {
+		GLuint queries[TFX_TIMER_MARKS];
+		// view each mark starts, -1 for anything else
+		int16_t views[TFX_TIMER_MARKS];
+		uint32_t allocated;
+		uint32_t count;
+		bool pending;
+	} frames[TFX_TIMER_FRAMES];
+	uint32_t current;
+	bool recording;
+	float frame_ms;
+	float view_ms[VIEW_MAX];
+} g_timers;
+
+static void timers_clear() {
+	for (int i = 0; i < TFX_TIMER_FRAMES; i++) {
+		if (g_timers.frames[i].allocated > 0) {
+			tfx_glDeleteQueries(g_timers.frames[i].allocated, g_timers.frames[i].queries);
+		}
 	}
-	g_programs = NULL;
+	memset(&g_timers, 0, sizeof(g_timers));
+}
 
-#ifdef TFX_LEAK_CHECK
-	stb_leakcheck_dumpmem();
-#endif
+// commands for the frame's merged draws, see build_batches.
+static struct {
+	GLuint gl_id;
+	uint32_t capacity;
+	tfx_indirect_command *commands;
+} g_indirect_buffer;
+
+static tfx_caps g_caps;
+static bool g_blit_warned = false;
+
+// fallback printf
+static void basic_log(const char *msg, tfx_severity level) {
+	printf("%s\n", msg);
 }
 
-static bool g_shaderc_allocated = false;
+static void tvb_reset() {
+	if (!g_transient_buffer.buf.gl_id) {
+		GLuint id;
+		CHECK(tfx_glGenBuffers(1, &id));
+		CHECK(tfx_glBindBuffer(GL_ARRAY_BUFFER, id));
+		if (g_caps.buffer_storage && tfx_glBufferStorage && tfx_glFenceSync) {
+			GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			GLsizeiptr size = (GLsizeiptr)TFX_TRANSIENT_BUFFER_SIZE * TFX_TRANSIENT_REGIONS;
+			CHECK(tfx_glBufferStorage(GL_ARRAY_BUFFER, size, NULL, flags));
+			g_transient_buffer.mapped = (uint8_t*)CHECK(tfx_glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags));
+		}
+		else {
+			CHECK(tfx_glBufferData(GL_ARRAY_BUFFER, TFX_TRANSIENT_BUFFER_SIZE, NULL, GL_STREAM_DRAW));
+		}
+		g_transient_buffer.buf.gl_id = id;
+		g_transient_buffer.frame = 0;
+		// frame 0 is recorded into region 0, and with a render thread frame 1
+		// is recorded before frame 0 is rendered.
+		g_transient_buffer.next_region = 1 % TFX_TRANSIENT_REGIONS;
+	}
+}
 
-static void push_group(unsigned id, const char *label) {
-	if (tfx_glPushDebugGroup) {
-		CHECK(tfx_glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, id, strlen(label), label));
+// point a frame's transient allocations at the region it records into.
+static void tvb_assign(tfx_frame_data *frame, uint32_t region) {
+	frame->transient_offset = 0;
+	if (g_transient_buffer.mapped) {
+		frame->transient_base = region * TFX_TRANSIENT_BUFFER_SIZE;
+		frame->transient_data = g_transient_buffer.mapped + frame->transient_base;
+	}
+	else if (!frame->transient_data) {
+		frame->transient_base = 0;
+		frame->transient_data = (uint8_t*)malloc(TFX_TRANSIENT_BUFFER_SIZE);
+		memset(frame->transient_data, 0xfc, TFX_TRANSIENT_BUFFER_SIZE);
 	}
 }
 
-static void pop_group() {
-	if (tfx_glPopDebugGroup) {
-		CHECK(tfx_glPopDebugGroup());
+// after a frame is submitted: fence its region, and make sure the GPU is done
+// with the region the next frame to be recorded is getting.
+static void tvb_advance() {
+	if (!g_transient_buffer.mapped) {
+		return;
+	}
+	uint32_t frame = g_transient_buffer.frame++;
+	GLsync *fence = &g_transient_buffer.fences[frame % TFX_TRANSIENT_REGIONS];
+	if (*fence) {
+		CHECK(tfx_glDeleteSync(*fence));
 	}
+	*fence = CHECK(tfx_glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+
+	// with a render thread, the frame after this one is already recording.
+	uint32_t next = frame + (g_rt.enabled ? 2 : 1);
+	GLsync *wait = &g_transient_buffer.fences[next % TFX_TRANSIENT_REGIONS];
+	if (*wait) {
+		GLenum status;
+		do {
+			status = CHECK(tfx_glClientWaitSync(*wait, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000));
+		} while (status == GL_TIMEOUT_EXPIRED);
+		CHECK(tfx_glDeleteSync(*wait));
+		*wait = 0;
+	}
+	g_transient_buffer.next_region = next % TFX_TRANSIENT_REGIONS;
 }
 
-static GLuint load_shader(GLenum type, const char *shaderSrc) {
-	g_shaderc_allocated = true;
+// null backend: stands in for the driver when there's no GPU. it hands out
+// object ids, answers queries plausibly and counts every call, so the CPU
+// side of tinyfx can run and be measured anywhere. uniforms are found by
+// scanning the shader source for declarations.
+#define TFX_NULL_GL(X) \
+	X(glActiveTexture) X(glAttachShader) X(glBeginConditionalRender) \
+	X(glBeginQuery) X(glBindAttribLocation) X(glBindBuffer) \
+	X(glBindBufferBase) X(glBindBufferRange) X(glBindFragDataLocation) \
+	X(glBindFramebuffer) X(glBindRenderbuffer) X(glBindTexture) \
+	X(glBindVertexArray) X(glBlendFunc) X(glBlitFramebuffer) \
+	X(glBufferData) X(glBufferStorage) X(glBufferSubData) \
+	X(glCheckFramebufferStatus) X(glClear) X(glClearColor) \
+	X(glClearDepthf) X(glClientWaitSync) X(glColorMask) \
+	X(glCompileShader) X(glCreateProgram) X(glCreateShader) \
+	X(glDeleteBuffers) X(glDeleteProgram) X(glDeleteQueries) \
+	X(glDeleteShader) X(glDeleteSync) X(glDeleteTextures) \
+	X(glDeleteVertexArrays) X(glDepthFunc) X(glDepthMask) \
+	X(glDisable) X(glDisableVertexAttribArray) X(glDispatchCompute) \
+	X(glDrawArrays) X(glDrawArraysIndirect) X(glDrawArraysInstanced) \
+	X(glDrawBuffers) X(glDrawElements) X(glDrawElementsIndirect) \
+	X(glDrawElementsInstanced) X(glDrawElementsInstancedBaseVertex) X(glEnable) \
+	X(glEnableVertexAttribArray) X(glEndConditionalRender) X(glEndQuery) \
+	X(glFenceSync) X(glFramebufferRenderbuffer) X(glFramebufferTexture) \
+	X(glFramebufferTexture2D) X(glFrontFace) X(glGenBuffers) \
+	X(glGenFramebuffers) X(glGenQueries) X(glGenRenderbuffers) \
+	X(glGenTextures) X(glGenVertexArrays) X(glGenerateMipmap) \
+	X(glGetActiveUniform) X(glGetActiveUniformBlockName) X(glGetActiveUniformBlockiv) \
+	X(glGetError) X(glGetFloatv) X(glGetInteger64v) \
+	X(glGetIntegerv) X(glGetProgramInfoLog) X(glGetProgramiv) \
+	X(glGetQueryObjectui64v) X(glGetQueryObjectuiv) X(glGetShaderInfoLog) \
+	X(glGetShaderiv) X(glGetString) X(glGetStringi) \
+	X(glGetUniformLocation) X(glLinkProgram) X(glMapBufferRange) \
+	X(glMemoryBarrier) X(glMultiDrawArraysIndirect) X(glMultiDrawElementsIndirect) \
+	X(glPixelStorei) X(glPopDebugGroup) X(glPushDebugGroup) \
+	X(glQueryCounter) X(glReadBuffer) X(glReleaseShaderCompiler) \
+	X(glRenderbufferStorage) X(glScissor) X(glShaderSource) \
+	X(glTexImage2D) X(glTexParameterf) X(glTexParameteri) \
+	X(glTexSubImage2D) X(glUniform1fv) X(glUniform1iv) \
+	X(glUniform2fv) X(glUniform3fv) X(glUniform4fv) \
+	X(glUniformBlockBinding) X(glUniformMatrix2fv) X(glUniformMatrix3fv) \
+	X(glUniformMatrix4fv) X(glUnmapBuffer) X(glUseProgram) \
+	X(glVertexAttribDivisor) X(glVertexAttribPointer) X(glViewport)
 
-	GLuint shader = CHECK(tfx_glCreateShader(type));
-	if (!shader) {
-		TFX_FATAL("%s", "Something has gone horribly wrong, and we can't make shaders.");
-		return 0;
-	}
+enum {
+#define TFX_NULL_ENUM(fn) TFX_NULL_##fn,
+	TFX_NULL_GL(TFX_NULL_ENUM)
+#undef TFX_NULL_ENUM
+	TFX_NULL_FUNCS
+};
 
-	CHECK(tfx_glShaderSource(shader, 1, &shaderSrc, NULL));
-	CHECK(tfx_glCompileShader(shader));
+static const char *null_names[TFX_NULL_FUNCS] = {
+#define TFX_NULL_NAME(fn) #fn,
+	TFX_NULL_GL(TFX_NULL_NAME)
+#undef TFX_NULL_NAME
+};
 
-	GLint compiled;
-	CHECK(tfx_glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled));
-	if (!compiled) {
-		GLint infoLen = 0;
-		CHECK(tfx_glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &infoLen));
-		if (infoLen > 0) {
-			char* infoLog = (char*)malloc(sizeof(char) * infoLen);
-			CHECK(tfx_glGetShaderInfoLog(shader, infoLen, NULL, infoLog));
-			TFX_ERROR("Error compiling shader:\n%s", infoLog);
-#ifdef _MSC_VER
-			OutputDebugString(infoLog);
-#endif
-			free(infoLog);
-		}
-		CHECK(tfx_glDeleteShader(shader));
-		assert(compiled);
-		return 0;
-	}
+typedef struct tfx_null_uniform {
+	char name[64];
+	GLenum type;
+	GLint size;
+} tfx_null_uniform;
+
+// one for every id handed out. which fields matter depends on the type.
+typedef struct tfx_null_object {
+	char *source;
+	GLuint *shaders;
+	tfx_null_uniform *uniforms;
+	tfx_null_uniform *blocks;
+	uint8_t *data;
+	GLsizeiptr size;
+	uint64_t timestamp;
+	bool live;
+} tfx_null_object;
 
-	return shader;
-}
+static struct {
+	uint64_t calls[TFX_NULL_FUNCS];
+	tfx_null_object *objects;
+	// deleted ids, handed out again before the table grows
+	GLuint *free_ids;
+	struct {
+		GLenum target;
+		GLuint buffer;
+	} bound[8];
+	uintptr_t syncs;
+} g_null;
+
+static const char *null_exts[] = {
+	"GL_KHR_debug",
+	"GL_EXT_texture_filter_anisotropic",
+	NULL
+};
 
-const char *legacy_vs_prepend = ""
-	"#ifndef GL_ES\n"
-	"#define lowp\n"
-	"#define mediump\n"
-	"#define highp\n"
-	"#else\n"
-	"precision highp float;\n"
-	"#define in attribute\n"
-	"#define out varying\n"
-	"#endif\n"
-	"#pragma optionNV(strict on)\n"
-	"#define main _pain\n"
-	"#define tfx_viewport_count 1\n"
-	"#define VERTEX 1\n"
-	"#line 1\n"
-;
-const char *legacy_fs_prepend = ""
-	"#ifndef GL_ES\n"
-	"#define lowp\n"
-	"#define mediump\n"
-	"#define highp\n"
-	"#else\n"
-	"precision mediump float;\n"
-	"#define in varying\n"
-	"#endif\n"
-	"#pragma optionNV(strict on)\n"
-	"#define PIXEL 1\n"
-	"#line 1\n"
-;
-const char *vs_prepend = ""
-	"#ifdef GL_ES\n"
-	"precision highp float;\n"
-	"#endif\n"
-	"#define main _pain\n"
-	"#define tfx_viewport_count 1\n"
-	"#define VERTEX 1\n"
-	"#line 1\n"
-;
-const char *fs_prepend = ""
-	"#ifdef GL_ES\n"
-	"precision mediump float;\n"
-	"#endif\n"
-	"#define PIXEL 1\n"
-	"#line 1\n"
-;
+static const char *null_gles_exts[] = {
+	"GL_KHR_debug",
+	"GL_EXT_texture_filter_anisotropic",
+	"GL_EXT_buffer_storage",
+	"GL_EXT_disjoint_timer_query",
+	NULL
+};
 
-const char *vs_append = ""
-	"#undef main\n"
-	"void main() {\n"
-	"	_pain();\n"
-	// TODO: enable extensions if GL < 4.1, add gl_Layer support for
-	// single pass cube/shadow cascade rendering
-	"#if 0\n"
-	"	gl_ViewportIndex = gl_InstanceID % tfx_viewport_count;\n"
-	"#endif\n"
-	"}\n"
-;
+#define NULL_CALL(fn) g_null.calls[TFX_NULL_##fn]++
 
-static char *sappend(const char *left, const char *right) {
-	size_t ls = strlen(left);
-	size_t rs = strlen(right);
-	char *ss = (char*)malloc(ls+rs+1);
-	memcpy(ss, left, ls);
-	memcpy(ss+ls, right, rs);
-	ss[ls+rs] = '\0';
-	return ss;
+static const char **null_ext_list() {
+	return g_platform_data.use_gles ? null_gles_exts : null_exts;
 }
 
-tfx_program tfx_program_new(const char *_vss, const char *_fss, const char *attribs[]) {
-	char *vss1, *fss1;
-	if (g_platform_data.context_version < 30) {
-		vss1 = sappend(legacy_vs_prepend, _vss);
-		fss1 = sappend(legacy_fs_prepend, _fss);
+static GLuint null_new_object() {
+	// id 0 is never handed out
+	if (sb_count(g_null.objects) == 0) {
+		tfx_null_object *zero = sb_add(g_null.objects, 1);
+		memset(zero, 0, sizeof(tfx_null_object));
+	}
+	GLuint id;
+	int n = sb_count(g_null.free_ids);
+	if (n > 0) {
+		id = g_null.free_ids[n - 1];
+		sb_pop(g_null.free_ids, 1);
 	}
 	else {
-		vss1 = sappend(vs_prepend, _vss);
-		fss1 = sappend(fs_prepend, _fss);
+		sb_add(g_null.objects, 1);
+		id = (GLuint)(sb_count(g_null.objects) - 1);
 	}
+	tfx_null_object *obj = &g_null.objects[id];
+	memset(obj, 0, sizeof(tfx_null_object));
+	obj->live = true;
+	return id;
+}
 
-	char version[64];
-	int gl_major = g_platform_data.context_version / 10;
-	int gl_minor = g_platform_data.context_version % 10;
-	const char *suffix = " core";
-	// post GL3/GLES3, versions are sane, just fix suffix.
-	if (g_platform_data.use_gles && g_platform_data.context_version >= 30) {
-		suffix = " es";
-	}
-	// GL and GLES2 use GLSL 1xx versions
-	else if (g_platform_data.context_version < 30) {
-		suffix = "";
-		gl_major = 1;
-		// GL 2.1 -> GLSL 120
-		if (!g_platform_data.use_gles) {
-			gl_minor = 2;
-		}
+static tfx_null_object *null_object(GLuint id) {
+	if (id == 0 || id >= (GLuint)sb_count(g_null.objects)) {
+		return NULL;
 	}
-	snprintf(version, 64, "#version %d%d0%s\n", gl_major, gl_minor, suffix);
-
-	char *vss2 = sappend(vss1, vs_append);
-	free(vss1);
+	return &g_null.objects[id];
+}
 
-	char *vss = sappend(version, vss2);
-	char *fss = sappend(version, fss1);
-	free(vss2);
-	free(fss1);
+static void null_object_free(tfx_null_object *obj) {
+	free(obj->source);
+	free(obj->data);
+	sb_free(obj->shaders);
+	sb_free(obj->uniforms);
+	sb_free(obj->blocks);
+	memset(obj, 0, sizeof(tfx_null_object));
+}
 
-	GLuint vs = load_shader(GL_VERTEX_SHADER, vss);
-	GLuint fs = load_shader(GL_FRAGMENT_SHADER, fss);
-	GLuint program = CHECK(tfx_glCreateProgram());
-	if (!program) {
-		return 0;
+static void null_gen(GLsizei n, GLuint *ids) {
+	for (GLsizei i = 0; i < n; i++) {
+		ids[i] = null_new_object();
 	}
+}
 
-	free(vss);
-	free(fss);
+static void null_delete(GLsizei n, const GLuint *ids) {
+	for (GLsizei i = 0; i < n; i++) {
+		tfx_null_object *obj = null_object(ids[i]);
+		// deleting twice mustn't put the id on the free list twice
+		if (obj && obj->live) {
+			null_object_free(obj);
+			sb_push(g_null.free_ids, ids[i]);
+		}
+	}
+}
 
-	CHECK(tfx_glAttachShader(program, vs));
-	CHECK(tfx_glAttachShader(program, fs));
+static GLuint *null_binding(GLenum target) {
+	for (int i = 0; i < 8; i++) {
+		if (g_null.bound[i].target == target || g_null.bound[i].target == 0) {
+			g_null.bound[i].target = target;
+			return &g_null.bound[i].buffer;
+		}
+	}
+	return &g_null.bound[7].buffer;
+}
 
-	const char **it = attribs;
-	int i = 0;
-	while (*it != NULL) {
-		CHECK(tfx_glBindAttribLocation(program, i, *it));
-		i++;
-		it++;
+static void null_clear() {
+	int n = sb_count(g_null.objects);
+	for (int i = 0; i < n; i++) {
+		null_object_free(&g_null.objects[i]);
 	}
+	sb_free(g_null.objects);
+	sb_free(g_null.free_ids);
+	memset(&g_null, 0, sizeof(g_null));
+}
 
-	// TODO: accept frag data binding array
-	if (tfx_glBindFragDataLocation) {
-		//CHECK(tfx_glBindFragDataLocation(program, 0, "out_color"));
+// next identifier or punctuation character, skipping comments and
+// preprocessor lines. tok is empty at the end of the source.
+static const char *null_token(const char *p, char *tok, int size) {
+	while (*p) {
+		if (isspace((unsigned char)*p)) {
+			p++;
+		}
+		else if (p[0] == '/' && p[1] == '/') {
+			while (*p && *p != '\n') p++;
+		}
+		else if (p[0] == '/' && p[1] == '*') {
+			p += 2;
+			while (*p && !(p[0] == '*' && p[1] == '/')) p++;
+			p += *p ? 2 : 0;
+		}
+		else if (*p == '#') {
+			while (*p && *p != '\n') p++;
+		}
+		else {
+			break;
+		}
+	}
+	int len = 0;
+	if (isalnum((unsigned char)*p) || *p == '_') {
+		while (isalnum((unsigned char)*p) || *p == '_') {
+			if (len < size - 1) {
+				tok[len++] = *p;
+			}
+			p++;
+		}
 	}
+	else if (*p) {
+		tok[len++] = *p++;
+	}
+	tok[len] = '\0';
+	return p;
+}
 
-	CHECK(tfx_glLinkProgram(program));
+static GLenum null_uniform_type(const char *type) {
+	static const struct { const char *name; GLenum type; } types[] = {
+		{ "float", GL_FLOAT }, { "vec2", GL_FLOAT_VEC2 }, { "vec3", GL_FLOAT_VEC3 }, { "vec4", GL_FLOAT_VEC4 },
+		{ "int", GL_INT }, { "ivec2", GL_INT_VEC2 }, { "ivec3", GL_INT_VEC3 }, { "ivec4", GL_INT_VEC4 },
+		{ "uint", GL_UNSIGNED_INT }, { "bool", GL_BOOL },
+		{ "mat2", GL_FLOAT_MAT2 }, { "mat3", GL_FLOAT_MAT3 }, { "mat4", GL_FLOAT_MAT4 },
+		{ "samplerCube", GL_SAMPLER_CUBE }, { "sampler2DShadow", GL_SAMPLER_2D_SHADOW },
+	};
+	for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+		if (strcmp(types[i].name, type) == 0) {
+			return types[i].type;
+		}
+	}
+	if (strncmp(type, "image", 5) == 0) {
+		return GL_IMAGE_2D;
+	}
+	return GL_SAMPLER_2D;
+}
 
-	GLint linked;
+static void null_add_uniform(tfx_null_uniform **list, const char *name, GLenum type, GLint size) {
+	int n = sb_count(*list);
+	for (int i = 0; i < n; i++) {
+		if (strcmp((*list)[i].name, name) == 0) {
+			return;
+		}
+	}
+	tfx_null_uniform u;
+	snprintf(u.name, sizeof(u.name), "%s", name);
+	u.type = type;
+	u.size = size > 0 ? size : 1;
+	sb_push(*list, u);
+}
+
+// pick `uniform [precision] type name[N], ...;` and `uniform Block { ... };`
+// out of a shader. both sides of an #if are seen, which is close enough.
+static void null_parse_uniforms(tfx_null_object *prog, const char *src) {
+	char tok[64], type[64], name[64];
+	const char *p = src;
+	while (true) {
+		p = null_token(p, tok, sizeof(tok));
+		if (!tok[0]) {
+			break;
+		}
+		if (strcmp(tok, "uniform") != 0) {
+			continue;
+		}
+		do {
+			p = null_token(p, type, sizeof(type));
+		} while (!strcmp(type, "lowp") || !strcmp(type, "mediump") || !strcmp(type, "highp"));
+		p = null_token(p, name, sizeof(name));
+		if (strcmp(name, "{") == 0) {
+			null_add_uniform(&prog->blocks, type, 0, 1);
+			for (int depth = 1; depth > 0 && tok[0];) {
+				p = null_token(p, tok, sizeof(tok));
+				depth += !strcmp(tok, "{") - !strcmp(tok, "}");
+			}
+			continue;
+		}
+		GLenum gl_type = null_uniform_type(type);
+		while (name[0]) {
+			GLint size = 1;
+			p = null_token(p, tok, sizeof(tok));
+			if (strcmp(tok, "[") == 0) {
+				p = null_token(p, tok, sizeof(tok));
+				size = atoi(tok);
+				while (tok[0] && strcmp(tok, "]") != 0) {
+					p = null_token(p, tok, sizeof(tok));
+				}
+				p = null_token(p, tok, sizeof(tok));
+			}
+			null_add_uniform(&prog->uniforms, name, gl_type, size);
+			name[0] = '\0';
+			if (strcmp(tok, ",") == 0) {
+				p = null_token(p, name, sizeof(name));
+			}
+		}
+	}
+}
+
+static void APIENTRY null_glActiveTexture(GLenum texture) { NULL_CALL(glActiveTexture); }
+static void APIENTRY null_glAttachShader(GLuint program, GLuint shader) {
+	NULL_CALL(glAttachShader);
+	tfx_null_object *obj = null_object(program);
+	if (obj) {
+		sb_push(obj->shaders, shader);
+	}
+}
+static void APIENTRY null_glBeginConditionalRender(GLuint id, GLenum mode) { NULL_CALL(glBeginConditionalRender); }
+static void APIENTRY null_glBeginQuery(GLenum target, GLuint id) { NULL_CALL(glBeginQuery); }
+static void APIENTRY null_glBindAttribLocation(GLuint program, GLuint index, const GLchar *name) { NULL_CALL(glBindAttribLocation); }
+static void APIENTRY null_glBindBuffer(GLenum target, GLuint buffer) {
+	NULL_CALL(glBindBuffer);
+	*null_binding(target) = buffer;
+}
+static void APIENTRY null_glBindBufferBase(GLenum target, GLuint index, GLuint buffer) {
+	NULL_CALL(glBindBufferBase);
+	*null_binding(target) = buffer;
+}
+static void APIENTRY null_glBindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size) {
+	NULL_CALL(glBindBufferRange);
+	*null_binding(target) = buffer;
+}
+static void APIENTRY null_glBindFragDataLocation(GLuint program, GLuint color, const GLchar *name) { NULL_CALL(glBindFragDataLocation); }
+static void APIENTRY null_glBindFramebuffer(GLenum target, GLuint framebuffer) { NULL_CALL(glBindFramebuffer); }
+static void APIENTRY null_glBindRenderbuffer(GLenum target, GLuint renderbuffer) { NULL_CALL(glBindRenderbuffer); }
+static void APIENTRY null_glBindTexture(GLenum target, GLuint texture) { NULL_CALL(glBindTexture); }
+static void APIENTRY null_glBindVertexArray(GLuint array) { NULL_CALL(glBindVertexArray); }
+static void APIENTRY null_glBlendFunc(GLenum sfactor, GLenum dfactor) { NULL_CALL(glBlendFunc); }
+static void APIENTRY null_glBlitFramebuffer(GLint srcX0, GLint srcY0, GLint srcX1, GLint srcY1, GLint dstX0, GLint dstY0, GLint dstX1, GLint dstY1, GLbitfield mask, GLenum filter) { NULL_CALL(glBlitFramebuffer); }
+static void APIENTRY null_glBufferData(GLenum target, GLsizeiptr size, const void *data, GLenum usage) {
+	NULL_CALL(glBufferData);
+	// storage is only made if the buffer gets mapped
+	tfx_null_object *obj = null_object(*null_binding(target));
+	if (obj && obj->size != size) {
+		free(obj->data);
+		obj->data = NULL;
+		obj->size = size;
+	}
+}
+static void APIENTRY null_glBufferStorage(GLenum target, GLsizeiptr size, const void *data, GLbitfield flags) {
+	NULL_CALL(glBufferStorage);
+	tfx_null_object *obj = null_object(*null_binding(target));
+	if (obj) {
+		free(obj->data);
+		obj->data = NULL;
+		obj->size = size;
+	}
+}
+static void APIENTRY null_glBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void *data) { NULL_CALL(glBufferSubData); }
+static GLenum APIENTRY null_glCheckFramebufferStatus(GLenum target) {
+	NULL_CALL(glCheckFramebufferStatus);
+	return GL_FRAMEBUFFER_COMPLETE;
+}
+static void APIENTRY null_glClear(GLbitfield mask) { NULL_CALL(glClear); }
+static void APIENTRY null_glClearColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha) { NULL_CALL(glClearColor); }
+static void APIENTRY null_glClearDepthf(GLfloat d) { NULL_CALL(glClearDepthf); }
+static GLenum APIENTRY null_glClientWaitSync(GLsync sync, GLbitfield flags, GLuint64 timeout) {
+	NULL_CALL(glClientWaitSync);
+	return GL_ALREADY_SIGNALED;
+}
+static void APIENTRY null_glColorMask(GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha) { NULL_CALL(glColorMask); }
+static void APIENTRY null_glCompileShader(GLuint shader) { NULL_CALL(glCompileShader); }
+static GLuint APIENTRY null_glCreateProgram(void) {
+	NULL_CALL(glCreateProgram);
+	return null_new_object();
+}
+static GLuint APIENTRY null_glCreateShader(GLenum type) {
+	NULL_CALL(glCreateShader);
+	return null_new_object();
+}
+static void APIENTRY null_glDeleteBuffers(GLsizei n, const GLuint *buffers) {
+	NULL_CALL(glDeleteBuffers);
+	null_delete(n, buffers);
+}
+static void APIENTRY null_glDeleteProgram(GLuint program) {
+	NULL_CALL(glDeleteProgram);
+	null_delete(1, &program);
+}
+static void APIENTRY null_glDeleteQueries(GLsizei n, const GLuint *ids) {
+	NULL_CALL(glDeleteQueries);
+	null_delete(n, ids);
+}
+static void APIENTRY null_glDeleteShader(GLuint shader) {
+	NULL_CALL(glDeleteShader);
+	null_delete(1, &shader);
+}
+static void APIENTRY null_glDeleteSync(GLsync sync) { NULL_CALL(glDeleteSync); }
+static void APIENTRY null_glDeleteTextures(GLsizei n, const GLuint *textures) {
+	NULL_CALL(glDeleteTextures);
+	null_delete(n, textures);
+}
+static void APIENTRY null_glDeleteVertexArrays(GLsizei n, const GLuint *arrays) {
+	NULL_CALL(glDeleteVertexArrays);
+	null_delete(n, arrays);
+}
+static void APIENTRY null_glDepthFunc(GLenum func) { NULL_CALL(glDepthFunc); }
+static void APIENTRY null_glDepthMask(GLboolean flag) { NULL_CALL(glDepthMask); }
+static void APIENTRY null_glDisable(GLenum cap) { NULL_CALL(glDisable); }
+static void APIENTRY null_glDisableVertexAttribArray(GLuint index) { NULL_CALL(glDisableVertexAttribArray); }
+static void APIENTRY null_glDispatchCompute(GLuint num_groups_x, GLuint num_groups_y, GLuint num_groups_z) { NULL_CALL(glDispatchCompute); }
+static void APIENTRY null_glDrawArrays(GLenum mode, GLint first, GLsizei count) { NULL_CALL(glDrawArrays); }
+static void APIENTRY null_glDrawArraysIndirect(GLenum mode, const void *indirect) { NULL_CALL(glDrawArraysIndirect); }
+static void APIENTRY null_glDrawArraysInstanced(GLenum mode, GLint first, GLsizei count, GLsizei instancecount) { NULL_CALL(glDrawArraysInstanced); }
+static void APIENTRY null_glDrawBuffers(GLsizei n, const GLenum *bufs) { NULL_CALL(glDrawBuffers); }
+static void APIENTRY null_glDrawElements(GLenum mode, GLsizei count, GLenum type, const void *indices) { NULL_CALL(glDrawElements); }
+static void APIENTRY null_glDrawElementsIndirect(GLenum mode, GLenum type, const void *indirect) { NULL_CALL(glDrawElementsIndirect); }
+static void APIENTRY null_glDrawElementsInstanced(GLenum mode, GLsizei count, GLenum type, const void *indices, GLsizei instancecount) { NULL_CALL(glDrawElementsInstanced); }
+static void APIENTRY null_glDrawElementsInstancedBaseVertex(GLenum mode, GLsizei count, GLenum type, const void *indices, GLsizei instancecount, GLint basevertex) { NULL_CALL(glDrawElementsInstancedBaseVertex); }
+static void APIENTRY null_glEnable(GLenum cap) { NULL_CALL(glEnable); }
+static void APIENTRY null_glEnableVertexAttribArray(GLuint index) { NULL_CALL(glEnableVertexAttribArray); }
+static void APIENTRY null_glEndConditionalRender(void) { NULL_CALL(glEndConditionalRender); }
+static void APIENTRY null_glEndQuery(GLenum target) { NULL_CALL(glEndQuery); }
+static GLsync APIENTRY null_glFenceSync(GLenum condition, GLbitfield flags) {
+	NULL_CALL(glFenceSync);
+	return (GLsync)++g_null.syncs;
+}
+static void APIENTRY null_glFramebufferRenderbuffer(GLenum target, GLenum attachment, GLenum renderbuffertarget, GLuint renderbuffer) { NULL_CALL(glFramebufferRenderbuffer); }
+static void APIENTRY null_glFramebufferTexture(GLenum target, GLenum attachment, GLuint texture, GLint level) { NULL_CALL(glFramebufferTexture); }
+static void APIENTRY null_glFramebufferTexture2D(GLenum target, GLenum attachment, GLenum textarget, GLuint texture, GLint level) { NULL_CALL(glFramebufferTexture2D); }
+static void APIENTRY null_glFrontFace(GLenum mode) { NULL_CALL(glFrontFace); }
+static void APIENTRY null_glGenBuffers(GLsizei n, GLuint *buffers) {
+	NULL_CALL(glGenBuffers);
+	null_gen(n, buffers);
+}
+static void APIENTRY null_glGenFramebuffers(GLsizei n, GLuint *framebuffers) {
+	NULL_CALL(glGenFramebuffers);
+	null_gen(n, framebuffers);
+}
+static void APIENTRY null_glGenQueries(GLsizei n, GLuint *ids) {
+	NULL_CALL(glGenQueries);
+	null_gen(n, ids);
+}
+static void APIENTRY null_glGenRenderbuffers(GLsizei n, GLuint *renderbuffers) {
+	NULL_CALL(glGenRenderbuffers);
+	null_gen(n, renderbuffers);
+}
+static void APIENTRY null_glGenTextures(GLsizei n, GLuint *textures) {
+	NULL_CALL(glGenTextures);
+	null_gen(n, textures);
+}
+static void APIENTRY null_glGenVertexArrays(GLsizei n, GLuint *arrays) {
+	NULL_CALL(glGenVertexArrays);
+	null_gen(n, arrays);
+}
+static void APIENTRY null_glGenerateMipmap(GLenum target) { NULL_CALL(glGenerateMipmap); }
+static void APIENTRY null_glGetActiveUniform(GLuint program, GLuint index, GLsizei bufSize, GLsizei *length, GLint *size, GLenum *type, GLchar *name) {
+	NULL_CALL(glGetActiveUniform);
+	tfx_null_object *obj = null_object(program);
+	if (!obj || index >= (GLuint)sb_count(obj->uniforms)) {
+		return;
+	}
+	tfx_null_uniform *u = &obj->uniforms[index];
+	int len = snprintf(name, bufSize, u->size > 1 ? "%s[0]" : "%s", u->name);
+	if (length) {
+		*length = len < bufSize ? len : bufSize - 1;
+	}
+	*size = u->size;
+	*type = u->type;
+}
+static void APIENTRY null_glGetActiveUniformBlockName(GLuint program, GLuint uniformBlockIndex, GLsizei bufSize, GLsizei *length, GLchar *uniformBlockName) {
+	NULL_CALL(glGetActiveUniformBlockName);
+	tfx_null_object *obj = null_object(program);
+	if (!obj || uniformBlockIndex >= (GLuint)sb_count(obj->blocks)) {
+		return;
+	}
+	int len = snprintf(uniformBlockName, bufSize, "%s", obj->blocks[uniformBlockIndex].name);
+	if (length) {
+		*length = len < bufSize ? len : bufSize - 1;
+	}
+}
+static void APIENTRY null_glGetActiveUniformBlockiv(GLuint program, GLuint uniformBlockIndex, GLenum pname, GLint *params) {
+	NULL_CALL(glGetActiveUniformBlockiv);
+	tfx_null_object *obj = null_object(program);
+	*params = 0;
+	if (!obj || uniformBlockIndex >= (GLuint)sb_count(obj->blocks) || pname != GL_UNIFORM_BLOCK_DATA_SIZE) {
+		return;
+	}
+	// whatever the app declared is what the "shader" has.
+	for (int b = 0; b < g_block_count; b++) {
+		if (strcmp(g_blocks[b].name, obj->blocks[uniformBlockIndex].name) == 0) {
+			*params = (GLint)((g_blocks[b].size + 15) & ~15u);
+		}
+	}
+}
+static GLenum APIENTRY null_glGetError(void) {
+	NULL_CALL(glGetError);
+	return GL_NO_ERROR;
+}
+static void APIENTRY null_glGetFloatv(GLenum pname, GLfloat *data) {
+	NULL_CALL(glGetFloatv);
+	// GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT
+	*data = pname == 0x84FF ? 16.0f : 0.0f;
+}
+static void APIENTRY null_glGetInteger64v(GLenum pname, GLint64 *data) {
+	NULL_CALL(glGetInteger64v);
+	*data = pname == GL_TIMESTAMP ? (GLint64)tfx_time_ns() : 0;
+}
+static void APIENTRY null_glGetIntegerv(GLenum pname, GLint *data) {
+	NULL_CALL(glGetIntegerv);
+	switch (pname) {
+		case GL_NUM_EXTENSIONS: {
+			const char **exts = null_ext_list();
+			*data = 0;
+			while (exts[*data]) {
+				(*data)++;
+			}
+			break;
+		}
+		case GL_MAJOR_VERSION: *data = g_platform_data.context_version / 10; break;
+		case GL_MINOR_VERSION: *data = g_platform_data.context_version % 10; break;
+		case GL_SHADER_COMPILER: *data = GL_TRUE; break;
+		case GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT: *data = 256; break;
+		default: *data = 0; break;
+	}
+}
+static void APIENTRY null_glGetProgramInfoLog(GLuint program, GLsizei bufSize, GLsizei *length, GLchar *infoLog) {
+	NULL_CALL(glGetProgramInfoLog);
+	if (bufSize > 0) {
+		infoLog[0] = '\0';
+	}
+	if (length) {
+		*length = 0;
+	}
+}
+static void APIENTRY null_glGetProgramiv(GLuint program, GLenum pname, GLint *params) {
+	NULL_CALL(glGetProgramiv);
+	tfx_null_object *obj = null_object(program);
+	*params = 0;
+	if (!obj) {
+		return;
+	}
+	switch (pname) {
+		case GL_LINK_STATUS: *params = GL_TRUE; break;
+		case GL_ACTIVE_UNIFORMS: *params = sb_count(obj->uniforms); break;
+		case GL_ACTIVE_UNIFORM_BLOCKS: *params = sb_count(obj->blocks); break;
+		case GL_ACTIVE_UNIFORM_MAX_LENGTH: {
+			int n = sb_count(obj->uniforms);
+			for (int i = 0; i < n; i++) {
+				GLint len = (GLint)strlen(obj->uniforms[i].name) + 4;
+				*params = len > *params ? len : *params;
+			}
+			break;
+		}
+		default: break;
+	}
+}
+static void APIENTRY null_glGetQueryObjectui64v(GLuint id, GLenum pname, GLuint64 *params) {
+	NULL_CALL(glGetQueryObjectui64v);
+	tfx_null_object *obj = null_object(id);
+	*params = (pname == GL_QUERY_RESULT && obj) ? obj->timestamp : 1;
+}
+static void APIENTRY null_glGetQueryObjectuiv(GLuint id, GLenum pname, GLuint *params) {
+	NULL_CALL(glGetQueryObjectuiv);
+	// results are in right away, and everything is visible.
+	*params = 1;
+}
+static void APIENTRY null_glGetShaderInfoLog(GLuint shader, GLsizei bufSize, GLsizei *length, GLchar *infoLog) {
+	NULL_CALL(glGetShaderInfoLog);
+	if (bufSize > 0) {
+		infoLog[0] = '\0';
+	}
+	if (length) {
+		*length = 0;
+	}
+}
+static void APIENTRY null_glGetShaderiv(GLuint shader, GLenum pname, GLint *params) {
+	NULL_CALL(glGetShaderiv);
+	*params = pname == GL_COMPILE_STATUS ? GL_TRUE : 0;
+}
+static const GLubyte *APIENTRY null_glGetString(GLenum name) {
+	NULL_CALL(glGetString);
+	static char version[64];
+	static char exts[512];
+	int v = g_platform_data.context_version;
+	switch (name) {
+		case GL_VENDOR: return (const GLubyte*)"tinyfx";
+		case GL_RENDERER: return (const GLubyte*)"tinyfx null";
+		case GL_VERSION:
+			snprintf(version, sizeof(version), "%s%d.%d tinyfx null", g_platform_data.use_gles ? "OpenGL ES " : "", v / 10, v % 10);
+			return (const GLubyte*)version;
+		case GL_SHADING_LANGUAGE_VERSION:
+			snprintf(version, sizeof(version), "%s%d.%d0", g_platform_data.use_gles ? "OpenGL ES GLSL ES " : "", v / 10, v % 10);
+			return (const GLubyte*)version;
+		case GL_EXTENSIONS: {
+			const char **list = null_ext_list();
+			exts[0] = '\0';
+			for (int i = 0; list[i]; i++) {
+				strcat(exts, list[i]);
+				strcat(exts, " ");
+			}
+			return (const GLubyte*)exts;
+		}
+		default: return NULL;
+	}
+}
+static const GLubyte *APIENTRY null_glGetStringi(GLenum name, GLuint index) {
+	NULL_CALL(glGetStringi);
+	const char **list = null_ext_list();
+	for (GLuint i = 0; list[i]; i++) {
+		if (i == index) {
+			return (const GLubyte*)list[i];
+		}
+	}
+	return NULL;
+}
+static GLint APIENTRY null_glGetUniformLocation(GLuint program, const GLchar *name) {
+	NULL_CALL(glGetUniformLocation);
+	tfx_null_object *obj = null_object(program);
+	int n = obj ? sb_count(obj->uniforms) : 0;
+	for (int i = 0; i < n; i++) {
+		size_t len = strlen(obj->uniforms[i].name);
+		if (strncmp(obj->uniforms[i].name, name, len) == 0 && (name[len] == '\0' || name[len] == '[')) {
+			return i;
+		}
+	}
+	return -1;
+}
+static void APIENTRY null_glLinkProgram(GLuint program) {
+	NULL_CALL(glLinkProgram);
+	tfx_null_object *obj = null_object(program);
+	if (!obj) {
+		return;
+	}
+	sb_free(obj->uniforms);
+	sb_free(obj->blocks);
+	obj->uniforms = NULL;
+	obj->blocks = NULL;
+	int n = sb_count(obj->shaders);
+	for (int i = 0; i < n; i++) {
+		tfx_null_object *shader = null_object(obj->shaders[i]);
+		if (shader && shader->source) {
+			null_parse_uniforms(obj, shader->source);
+		}
+	}
+}
+static void *APIENTRY null_glMapBufferRange(GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access) {
+	NULL_CALL(glMapBufferRange);
+	tfx_null_object *obj = null_object(*null_binding(target));
+	if (!obj || offset + length > obj->size) {
+		return NULL;
+	}
+	if (!obj->data) {
+		obj->data = malloc(obj->size);
+	}
+	return obj->data + offset;
+}
+static void APIENTRY null_glMemoryBarrier(GLbitfield barriers) { NULL_CALL(glMemoryBarrier); }
+static void APIENTRY null_glMultiDrawArraysIndirect(GLenum mode, const void *indirect, GLsizei drawcount, GLsizei stride) { NULL_CALL(glMultiDrawArraysIndirect); }
+static void APIENTRY null_glMultiDrawElementsIndirect(GLenum mode, GLenum type, const void *indirect, GLsizei drawcount, GLsizei stride) { NULL_CALL(glMultiDrawElementsIndirect); }
+static void APIENTRY null_glPixelStorei(GLenum pname, GLint param) { NULL_CALL(glPixelStorei); }
+static void APIENTRY null_glPopDebugGroup(void) { NULL_CALL(glPopDebugGroup); }
+static void APIENTRY null_glPushDebugGroup(GLenum source, GLuint id, GLsizei length, const GLchar *message) { NULL_CALL(glPushDebugGroup); }
+static void APIENTRY null_glQueryCounter(GLuint id, GLenum target) {
+	NULL_CALL(glQueryCounter);
+	tfx_null_object *obj = null_object(id);
+	if (obj) {
+		obj->timestamp = tfx_time_ns();
+	}
+}
+static void APIENTRY null_glReadBuffer(GLenum src) { NULL_CALL(glReadBuffer); }
+static void APIENTRY null_glReleaseShaderCompiler(void) { NULL_CALL(glReleaseShaderCompiler); }
+static void APIENTRY null_glRenderbufferStorage(GLenum target, GLenum internalformat, GLsizei width, GLsizei height) { NULL_CALL(glRenderbufferStorage); }
+static void APIENTRY null_glScissor(GLint x, GLint y, GLsizei width, GLsizei height) { NULL_CALL(glScissor); }
+static void APIENTRY null_glShaderSource(GLuint shader, GLsizei count, const GLchar *const*string, const GLint *length) {
+	NULL_CALL(glShaderSource);
+	tfx_null_object *obj = null_object(shader);
+	if (!obj) {
+		return;
+	}
+	size_t total = 0;
+	for (GLsizei i = 0; i < count; i++) {
+		total += (length && length[i] >= 0) ? (size_t)length[i] : strlen(string[i]);
+	}
+	free(obj->source);
+	obj->source = malloc(total + 1);
+	total = 0;
+	for (GLsizei i = 0; i < count; i++) {
+		size_t len = (length && length[i] >= 0) ? (size_t)length[i] : strlen(string[i]);
+		memcpy(obj->source + total, string[i], len);
+		total += len;
+	}
+	obj->source[total] = '\0';
+}
+static void APIENTRY null_glTexImage2D(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const void *pixels) { NULL_CALL(glTexImage2D); }
+static void APIENTRY null_glTexParameterf(GLenum target, GLenum pname, GLfloat param) { NULL_CALL(glTexParameterf); }
+static void APIENTRY null_glTexParameteri(GLenum target, GLenum pname, GLint param) { NULL_CALL(glTexParameteri); }
+static void APIENTRY null_glTexSubImage2D(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height, GLenum format, GLenum type, const void *pixels) { NULL_CALL(glTexSubImage2D); }
+static void APIENTRY null_glUniform1fv(GLint location, GLsizei count, const GLfloat *value) { NULL_CALL(glUniform1fv); }
+static void APIENTRY null_glUniform1iv(GLint location, GLsizei count, const GLint *value) { NULL_CALL(glUniform1iv); }
+static void APIENTRY null_glUniform2fv(GLint location, GLsizei count, const GLfloat *value) { NULL_CALL(glUniform2fv); }
+static void APIENTRY null_glUniform3fv(GLint location, GLsizei count, const GLfloat *value) { NULL_CALL(glUniform3fv); }
+static void APIENTRY null_glUniform4fv(GLint location, GLsizei count, const GLfloat *value) { NULL_CALL(glUniform4fv); }
+static void APIENTRY null_glUniformBlockBinding(GLuint program, GLuint uniformBlockIndex, GLuint uniformBlockBinding) { NULL_CALL(glUniformBlockBinding); }
+static void APIENTRY null_glUniformMatrix2fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value) { NULL_CALL(glUniformMatrix2fv); }
+static void APIENTRY null_glUniformMatrix3fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value) { NULL_CALL(glUniformMatrix3fv); }
+static void APIENTRY null_glUniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value) { NULL_CALL(glUniformMatrix4fv); }
+static GLboolean APIENTRY null_glUnmapBuffer(GLenum target) {
+	NULL_CALL(glUnmapBuffer);
+	return GL_TRUE;
+}
+static void APIENTRY null_glUseProgram(GLuint program) { NULL_CALL(glUseProgram); }
+static void APIENTRY null_glVertexAttribDivisor(GLuint index, GLuint divisor) { NULL_CALL(glVertexAttribDivisor); }
+static void APIENTRY null_glVertexAttribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void *pointer) { NULL_CALL(glVertexAttribPointer); }
+static void APIENTRY null_glViewport(GLint x, GLint y, GLsizei width, GLsizei height) { NULL_CALL(glViewport); }
+
+static void *null_get_proc_address(const char *name) {
+	static void *procs[TFX_NULL_FUNCS] = {
+#define TFX_NULL_PROC(fn) (void*)null_##fn,
+		TFX_NULL_GL(TFX_NULL_PROC)
+#undef TFX_NULL_PROC
+	};
+	for (int i = 0; i < TFX_NULL_FUNCS; i++) {
+		if (strcmp(null_names[i], name) == 0) {
+			return procs[i];
+		}
+	}
+	return NULL;
+}
+
+int tfx_null_get_calls(tfx_gl_call_count *calls, int max) {
+	int n = 0;
+	for (int i = 0; i < TFX_NULL_FUNCS; i++) {
+		if (g_null.calls[i] == 0) {
+			continue;
+		}
+		if (n < max) {
+			calls[n].name = null_names[i];
+			calls[n].count = g_null.calls[i];
+		}
+		n++;
+	}
+	return n;
+}
+
+void tfx_null_reset_calls() {
+	memset(g_null.calls, 0, sizeof(g_null.calls));
+}
+
+void tfx_set_platform_data(tfx_platform_data pd) {
+	// the null backend plays whatever version it's asked to.
+	if (pd.use_null_backend && pd.context_version == 0) {
+		pd.context_version = 45;
+	}
+	// supported: GL > 3, 2.1, ES 2.0, ES 3.0+
+	assert(0
+		|| (pd.context_version >= 30)
+		|| (pd.use_gles && pd.context_version == 20)
+		|| (!pd.use_gles && pd.context_version == 21)
+	);
+	if (pd.info_log == NULL) {
+		pd.info_log = &basic_log;
+	}
+	memcpy(&g_platform_data, &pd, sizeof(tfx_platform_data));
+
+	if (pd.use_render_thread && !g_rt.enabled) {
+		memset(&g_rt, 0, sizeof(g_rt));
+		tfx_mutex_init(&g_rt.lock);
+		tfx_cond_init(&g_rt.cond);
+		g_rt.enabled = true;
+	}
+	else if (pd.use_render_thread) {
+		tfx_mutex_lock(&g_rt.lock);
+		g_rt.quit = false;
+		tfx_mutex_unlock(&g_rt.lock);
+	}
+}
+
+static tfx_transient_buffer transient_alloc(tfx_vertex_format *fmt, uint32_t num, bool index_32bit) {
+	tfx_transient_buffer buf;
+	memset(&buf, 0, sizeof(tfx_transient_buffer));
+	uint32_t stride = index_32bit ? sizeof(uint32_t) : sizeof(uint16_t);
+	if (fmt) {
+		assert(fmt->stride > 0);
+		buf.has_format = true;
+		buf.format = *fmt;
+		stride = (uint32_t)fmt->stride;
+	}
+	buf.index_32bit = index_32bit;
+	// align, in case the stride is weird. this also keeps indices aligned.
+	uint32_t size = num * stride;
+	size += (4 - size % 4) % 4;
+
+	// safe to call from any thread recording with an encoder
+	uint32_t offset = tfx_atomic_add(&g_submit_frame->transient_offset, size);
+	assert(offset + size <= TFX_TRANSIENT_BUFFER_SIZE);
+
+	buf.data = g_submit_frame->transient_data + offset;
+	buf.num = num;
+	buf.offset = g_submit_frame->transient_base + offset;
+	return buf;
+}
+
+// null format = index buffer
+tfx_transient_buffer tfx_transient_buffer_new(tfx_vertex_format *fmt, uint16_t num_verts) {
+	return transient_alloc(fmt, num_verts, false);
+}
+
+tfx_transient_buffer tfx_transient_index_buffer_new(uint32_t num_indices, bool use_32bit) {
+	return transient_alloc(NULL, num_indices, use_32bit);
+}
+
+// null format = available indices (uint16)
+uint32_t tfx_transient_buffer_get_available(tfx_vertex_format *fmt) {
+	uint32_t avail = TFX_TRANSIENT_BUFFER_SIZE;
+	avail -= g_submit_frame->transient_offset;
+	uint32_t stride = sizeof(uint16_t);
+	if (fmt) {
+		assert(fmt->stride > 0);
+		stride = (uint32_t)fmt->stride;
+	}
+	avail /= (uint32_t)stride;
+	return avail;
+}
+
+// captures: a magic and version, then chunks of a tag, a payload size and the
+// payload, all in native byte order. resources are numbered from 1 in the
+// order their chunks appear, which is how frames refer to them.
+#define TFX_FOURCC(a, b, c, d) ((uint32_t)(a) | ((uint32_t)(b) << 8) | ((uint32_t)(c) << 16) | ((uint32_t)(d) << 24))
+#define TFX_CAPTURE_MAGIC TFX_FOURCC('T', 'F', 'X', 'C')
+#define TFX_CAPTURE_VERSION 1
+
+enum {
+	TFX_CHUNK_BLOCK   = TFX_FOURCC('B', 'L', 'C', 'K'),
+	TFX_CHUNK_PROGRAM = TFX_FOURCC('P', 'R', 'O', 'G'),
+	TFX_CHUNK_BUFFER  = TFX_FOURCC('B', 'U', 'F', 'F'),
+	TFX_CHUNK_TEXTURE = TFX_FOURCC('T', 'E', 'X', 'R'),
+	TFX_CHUNK_CANVAS  = TFX_FOURCC('C', 'N', 'V', 'S'),
+	TFX_CHUNK_UNIFORM = TFX_FOURCC('U', 'N', 'I', 'F'),
+	TFX_CHUNK_FRAME   = TFX_FOURCC('F', 'R', 'A', 'M')
+};
+
+// how a resource was created, kept from creation with TFX_RESET_CAPTURE.
+typedef struct tfx_capture_record {
+	uint32_t tag;
+	// program handle, buffer or texture id, or canvas fbo. 0 once freed.
+	uint32_t id;
+	tfx_canvas canvas;
+	uint8_t *payload;
+	// number in the capture being written, 0 if it isn't in there.
+	uint32_t index;
+} tfx_capture_record;
+
+// only touched by whoever creates resources and by tfx_frame. with a render
+// thread the resources are created there, but the app thread waits for it.
+static struct {
+	bool enabled;
+	tfx_capture_record *records;
+
+	FILE *file;
+	uint32_t written;
+	uint32_t frames_left;
+	// submits are logged from the first frame recorded after tfx_capture.
+	bool recording;
+	// uniform ids defined in the file so far, and chunks defining new ones.
+	uint8_t *defined;
+	uint8_t *defs;
+	uint8_t *scratch;
+	uint32_t missing;
+	uint32_t callbacks;
+} g_capture;
+
+static void cap_put(uint8_t **out, const void *data, size_t size) {
+	if (size > 0) {
+		memcpy(sb_add(*out, (int)size), data, size);
+	}
+}
+
+static void cap_u8(uint8_t **out, uint8_t v) {
+	sb_push(*out, v);
+}
+
+static void cap_u32(uint8_t **out, uint32_t v) {
+	cap_put(out, &v, sizeof(uint32_t));
+}
+
+static void cap_f32(uint8_t **out, float v) {
+	cap_put(out, &v, sizeof(float));
+}
+
+// length including the terminator, 0 for NULL.
+static void cap_str(uint8_t **out, const char *s) {
+	uint32_t len = s ? (uint32_t)strlen(s) + 1 : 0;
+	cap_u32(out, len);
+	cap_put(out, s, len);
+}
+
+static void cap_format(uint8_t **out, const tfx_vertex_format *fmt) {
+	cap_u8(out, fmt->count);
+	cap_u8(out, fmt->component_mask);
+	cap_u32(out, (uint32_t)fmt->stride);
+	for (int i = 0; i < fmt->count; i++) {
+		const tfx_vertex_component *vc = &fmt->components[i];
+		cap_u32(out, (uint32_t)vc->offset);
+		cap_u8(out, (uint8_t)vc->size);
+		cap_u8(out, vc->normalized);
+		cap_u8(out, (uint8_t)vc->type);
+		cap_u32(out, vc->divisor);
+	}
+}
+
+static void capture_chunk(uint32_t tag, const uint8_t *payload, uint32_t size) {
+	uint32_t header[2] = { tag, size };
+	fwrite(header, sizeof(header), 1, g_capture.file);
+	if (size > 0) {
+		fwrite(payload, size, 1, g_capture.file);
+	}
+}
+
+static void capture_write_record(tfx_capture_record *rec) {
+	capture_chunk(rec->tag, rec->payload, (uint32_t)sb_count(rec->payload));
+	rec->index = ++g_capture.written;
+}
+
+static tfx_capture_record *capture_record(uint32_t tag, uint32_t id) {
+	tfx_capture_record rec;
+	memset(&rec, 0, sizeof(tfx_capture_record));
+	rec.tag = tag;
+	rec.id = id;
+	sb_push(g_capture.records, rec);
+	return &sb_last(g_capture.records);
+}
+
+// resources made while a capture is being written go straight in.
+static void capture_commit(tfx_capture_record *rec) {
+	if (g_capture.file) {
+		capture_write_record(rec);
+	}
+}
+
+static void capture_program(tfx_program program, const char *vss, const char *fss, const char *attribs[], const char *css) {
+	if (!g_capture.enabled || !program) {
+		return;
+	}
+	tfx_capture_record *rec = capture_record(TFX_CHUNK_PROGRAM, program);
+	cap_u8(&rec->payload, css != NULL);
+	if (css) {
+		cap_str(&rec->payload, css);
+	}
+	else {
+		cap_str(&rec->payload, vss);
+		cap_str(&rec->payload, fss);
+		uint32_t na = 0;
+		while (attribs && attribs[na]) {
+			na++;
+		}
+		cap_u32(&rec->payload, na);
+		for (uint32_t i = 0; i < na; i++) {
+			cap_str(&rec->payload, attribs[i]);
+		}
+	}
+	capture_commit(rec);
+}
+
+static void capture_buffer(tfx_buffer *buf, void *data, size_t size, tfx_buffer_usage usage) {
+	if (!g_capture.enabled) {
+		return;
+	}
+	tfx_capture_record *rec = capture_record(TFX_CHUNK_BUFFER, buf->gl_id);
+	cap_u32(&rec->payload, (uint32_t)usage);
+	cap_u32(&rec->payload, (uint32_t)size);
+	cap_u8(&rec->payload, buf->has_format);
+	if (buf->has_format) {
+		cap_format(&rec->payload, &buf->format);
+	}
+	cap_u8(&rec->payload, data != NULL);
+	if (data) {
+		cap_put(&rec->payload, data, size);
+	}
+	capture_commit(rec);
+}
+
+static uint32_t texture_bytes(uint16_t w, uint16_t h, tfx_format format) {
+	return (uint32_t)w * h * (format == TFX_FORMAT_RGB565 ? 2 : 4);
+}
+
+static void capture_texture(tfx_texture *tex, void *data) {
+	if (!g_capture.enabled) {
+		return;
+	}
+	tfx_capture_record *rec = capture_record(TFX_CHUNK_TEXTURE, tex->gl_ids[0]);
+	cap_u32(&rec->payload, tex->width);
+	cap_u32(&rec->payload, tex->height);
+	cap_u32(&rec->payload, (uint32_t)tex->format);
+	cap_u32(&rec->payload, tex->flags);
+	cap_u8(&rec->payload, data != NULL);
+	if (data) {
+		cap_put(&rec->payload, data, texture_bytes(tex->width, tex->height, tex->format));
+	}
+	capture_commit(rec);
+}
+
+static void capture_canvas(tfx_canvas *canvas, uint16_t flags) {
+	if (!g_capture.enabled || !canvas->gl_fbo) {
+		return;
+	}
+	tfx_capture_record *rec = capture_record(TFX_CHUNK_CANVAS, canvas->gl_fbo);
+	rec->canvas = *canvas;
+	cap_u32(&rec->payload, canvas->width);
+	cap_u32(&rec->payload, canvas->height);
+	cap_u32(&rec->payload, (uint32_t)canvas->format);
+	cap_u32(&rec->payload, flags);
+	capture_commit(rec);
+}
+
+static void capture_forget(uint32_t tag, uint32_t id) {
+	int n = sb_count(g_capture.records);
+	for (int i = 0; i < n; i++) {
+		tfx_capture_record *rec = &g_capture.records[i];
+		if (rec->tag == tag && rec->id == id) {
+			sb_free(rec->payload);
+			rec->payload = NULL;
+			rec->id = 0;
+		}
+	}
+}
+
+static void capture_close() {
+	if (g_capture.missing > 0) {
+		TFX_WARN("capture: %u references to resources created without TFX_RESET_CAPTURE", g_capture.missing);
+	}
+	if (g_capture.callbacks > 0) {
+		TFX_WARN("capture: %u draw callbacks dropped", g_capture.callbacks);
+	}
+	if (ferror(g_capture.file)) {
+		TFX_ERROR("%s", "capture: write failed");
+	}
+	fclose(g_capture.file);
+	g_capture.file = NULL;
+	g_capture.recording = false;
+}
+
+static void capture_clear() {
+	if (g_capture.file) {
+		capture_close();
+	}
+	int n = sb_count(g_capture.records);
+	for (int i = 0; i < n; i++) {
+		sb_free(g_capture.records[i].payload);
+	}
+	sb_free(g_capture.records);
+	sb_free(g_capture.defined);
+	sb_free(g_capture.defs);
+	sb_free(g_capture.scratch);
+	memset(&g_capture, 0, sizeof(g_capture));
+}
+
+// where the last uploaded value of a uniform is kept in shadow_data.
+typedef struct tfx_uniform_shadow {
+	uint32_t offset;
+	uint32_t capacity;
+	// bytes of the last upload, 0 if nothing has been uploaded yet.
+	uint32_t size;
+} tfx_uniform_shadow;
+
+typedef struct tfx_program_data {
+	GLuint gl_id;
+	// location for each uniform id, up to the highest one the program uses.
+	GLint *locations;
+	// program uniforms keep their values, so identical updates are skipped.
+	tfx_uniform_shadow *shadows;
+	uint8_t *shadow_data;
+	// uniform blocks used, bit per binding point
+	uint32_t block_mask;
+} tfx_program_data;
+
+// tfx_program handles are indices into this, plus one.
+static tfx_program_data *g_programs = NULL;
+static tfx_texture *g_textures = NULL;
+static tfx_reset_flags g_flags = TFX_RESET_NONE;
+static float g_max_aniso = 0.0f;
+
+typedef struct tfx_reset_args {
+	uint16_t width;
+	uint16_t height;
+	tfx_reset_flags flags;
+} tfx_reset_args;
+
+static void reset_thunk(void *arg) {
+	tfx_reset_args *args = arg;
+	tfx_reset(args->width, args->height, args->flags);
+}
+
+static void frame_data_init(tfx_frame_data *frame, bool copy_views) {
+	if (!frame->arena) {
+		frame->arena_size = TFX_UNIFORM_BUFFER_SIZE;
+		frame->arena = (uint8_t*)malloc(frame->arena_size);
+		tfx_mutex_init(&frame->arena_lock);
+	}
+	if (!frame->transient_data) {
+		tvb_assign(frame, frame == &g_frames[0] ? 0 : g_transient_buffer.next_region);
+	}
+	frame->views = g_views;
+	if (copy_views) {
+		if (!frame->view_storage) {
+			frame->view_storage = calloc(VIEW_MAX, sizeof(tfx_view));
+		}
+		frame->views = frame->view_storage;
+	}
+	frame->encoder_count = 1;
+	frame->arena_offset = 0;
+	frame->transient_offset = 0;
+}
+
+void tfx_reset(uint16_t width, uint16_t height, tfx_reset_flags flags) {
+	if (rt_remote()) {
+		tfx_reset_args args;
+		args.width = width;
+		args.height = height;
+		args.flags = flags;
+		rt_call(reset_thunk, &args);
+		return;
+	}
+
+	if (g_platform_data.use_null_backend) {
+		load_em_up(null_get_proc_address);
+	}
+	else if (g_platform_data.gl_get_proc_address != NULL) {
+		load_em_up(g_platform_data.gl_get_proc_address);
+	}
+
+
+	g_caps = tfx_get_caps();
+	// we require these, unless/until backporting for pre-compute HW.
+	assert(g_caps.instancing);
+	assert(g_caps.compute);
+
+	g_flags = TFX_RESET_NONE;
+	if (g_caps.anisotropic_filtering && (flags & TFX_RESET_MAX_ANISOTROPY) == TFX_RESET_MAX_ANISOTROPY) {
+		g_flags |= TFX_RESET_MAX_ANISOTROPY;
+	}
+	if (g_caps.timer_query && tfx_glQueryCounter && (flags & TFX_RESET_GPU_TIMERS) == TFX_RESET_GPU_TIMERS) {
+		g_flags |= TFX_RESET_GPU_TIMERS;
+	}
+	if ((flags & TFX_RESET_TRACE) == TFX_RESET_TRACE) {
+		g_flags |= TFX_RESET_TRACE;
+	}
+	g_trace.enabled = (g_flags & TFX_RESET_TRACE) != 0;
+	if ((flags & TFX_RESET_CAPTURE) == TFX_RESET_CAPTURE) {
+		g_flags |= TFX_RESET_CAPTURE;
+	}
+	g_capture.enabled = (g_flags & TFX_RESET_CAPTURE) != 0;
+
+	memset(&g_backbuffer, 0, sizeof(tfx_canvas));
+	g_backbuffer.allocated = 1;
+	g_backbuffer.gl_fbo = 0;
+	g_backbuffer.width = width;
+	g_backbuffer.height = height;
+
+	tvb_reset();
+
+	g_submit_frame = &g_frames[0];
+	g_render_frame = &g_frames[0];
+	frame_data_init(&g_frames[0], g_rt.enabled);
+	if (g_rt.enabled) {
+		frame_data_init(&g_frames[1], true);
+		g_render_frame = &g_frames[1];
+	}
+
+	if (g_caps.uniform_buffers) {
+		GLint align = 0;
+		CHECK(tfx_glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &align));
+		g_block_buffer.align = align > 0 ? (uint32_t)align : 256;
+		if (!g_block_buffer.gl_id) {
+			CHECK(tfx_glGenBuffers(1, &g_block_buffer.gl_id));
+		}
+	}
+
+	// update every already loaded texture's anisotropy to max (typically 16) or 0
+	if (g_caps.anisotropic_filtering) {
+		g_max_aniso = 0.0f;
+		GLenum GL_TEXTURE_MAX_ANISOTROPY_EXT = 0x84FE;
+		if ((g_flags & TFX_RESET_MAX_ANISOTROPY) == TFX_RESET_MAX_ANISOTROPY) {
+			GLenum GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT = 0x84FF;
+			CHECK(tfx_glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &g_max_aniso));
+		}
+		int nt = sb_count(g_textures);
+		for (int i = 0; i < nt; i++) {
+			tfx_texture *tex = &g_textures[i];
+			for (unsigned j = 0; j < tex->gl_count; j++) {
+				GLenum fmt = GL_TEXTURE_2D;
+				if ((tex->flags & TFX_TEXTURE_CUBE) == TFX_TEXTURE_CUBE) {
+					fmt = GL_TEXTURE_CUBE_MAP;
+				}
+				CHECK(tfx_glBindTexture(fmt, tex->gl_ids[j]));
+				CHECK(tfx_glTexParameterf(fmt, GL_TEXTURE_MAX_ANISOTROPY_EXT, g_max_aniso));
+			}
+		}
+	}
+
+#ifdef _MSC_VER
+	if (g_caps.memory_info) {
+		GLint memory;
+		// GPU_MEMORY_INFO_TOTAL_AVAILABLE_MEMORY_NVX    
+		CHECK(tfx_glGetIntegerv(0x9048, &memory));
+		char buf[64];
+		snprintf(buf, 64, "VRAM: %dMiB\n", memory / 1024);
+		OutputDebugString(buf);
+	}
+#endif
+
+	memset(&g_views, 0, sizeof(tfx_view)*VIEW_MAX);
+	for (int i = 0; i < VIEW_MAX; i++) {
+		g_views[i].view[0] = 1.0f;
+		g_views[i].view[5] = 1.0f;
+		g_views[i].view[10] = 1.0f;
+		g_views[i].view[15] = 1.0f;
+	}
+}
+
+static void frame_data_reset(tfx_frame_data *frame);
+static void encoder_free_uniforms(tfx_encoder *enc);
+
+static void frame_data_free(tfx_frame_data *frame) {
+	frame_data_reset(frame);
+	for (int e = 0; e < TFX_MAX_ENCODERS; e++) {
+		for (int id = 0; id < VIEW_MAX; id++) {
+			sb_free(frame->draws[e][id]);
+			sb_free(frame->jobs[e][id]);
+		}
+	}
+	if (frame->arena) {
+		free(frame->arena);
+		tfx_mutex_destroy(&frame->arena_lock);
+	}
+	sb_free(frame->arena_overflow);
+	if (!g_transient_buffer.mapped) {
+		free(frame->transient_data);
+	}
+	free(frame->view_storage);
+	sb_free(frame->texture_updates);
+	memset(frame, 0, sizeof(tfx_frame_data));
+}
+
+static void shutdown_thunk(void *arg) {
+	// TODO: clean up all GL objects, allocs, etc.
+	for (int i = 0; i < 2; i++) {
+		frame_data_free(&g_frames[i]);
+	}
+
+	if (g_transient_buffer.buf.gl_id) {
+		for (int i = 0; i < TFX_TRANSIENT_REGIONS; i++) {
+			if (g_transient_buffer.fences[i]) {
+				tfx_glDeleteSync(g_transient_buffer.fences[i]);
+			}
+		}
+		// deleting unmaps it
+		tfx_glDeleteBuffers(1, &g_transient_buffer.buf.gl_id);
+		memset(&g_transient_buffer, 0, sizeof(g_transient_buffer));
+	}
+
+	if (g_uniform_ids) {
+		tfx_locmap_delete(g_uniform_ids);
+		g_uniform_ids = NULL;
+	}
+	int nn = sb_count(g_uniform_names);
+	for (int i = 0; i < nn; i++) {
+		free(g_uniform_names[i]);
+	}
+	sb_free(g_uniform_names);
+	g_uniform_names = NULL;
+
+	for (int i = 0; i < TFX_MAX_ENCODERS; i++) {
+		tfx_encoder *enc = &g_encoders[i];
+		encoder_free_uniforms(enc);
+		sb_free(enc->capture_log);
+		memset(enc, 0, sizeof(tfx_encoder));
+	}
+	g_encoder_count = 1;
+
+	sb_free(g_frame_draws);
+	sb_free(g_frame_jobs);
+	g_frame_draws = NULL;
+	g_frame_jobs = NULL;
+
+	sb_free(g_sort_keys);
+	sb_free(g_sort_tmp_keys);
+	sb_free(g_sort_values);
+	sb_free(g_sort_tmp_values);
+	sb_free(g_sort_refs);
+	g_sort_keys = g_sort_tmp_keys = NULL;
+	g_sort_values = g_sort_tmp_values = NULL;
+	g_sort_refs = NULL;
+
+	sb_free(g_cull_soa);
+	sb_free(g_cull_visible);
+	g_cull_soa = NULL;
+	g_cull_visible = NULL;
+
+	if (g_block_buffer.gl_id) {
+		tfx_glDeleteBuffers(1, &g_block_buffer.gl_id);
+	}
+	sb_free(g_block_buffer.staging);
+	memset(&g_block_buffer, 0, sizeof(g_block_buffer));
+
+	vao_cache_clear();
+	occlusion_clear();
+	timers_clear();
+
+	if (g_indirect_buffer.gl_id) {
+		tfx_glDeleteBuffers(1, &g_indirect_buffer.gl_id);
+	}
+	sb_free(g_indirect_buffer.commands);
+	memset(&g_indirect_buffer, 0, sizeof(g_indirect_buffer));
+
+	for (int i = 0; i < g_block_count; i++) {
+		tfx_uniform_block *ub = &g_blocks[i];
+		free(ub->name);
+		free(ub->image);
+		sb_free(ub->members);
+		sb_free(ub->member_offsets);
+		sb_free(ub->member_types);
+		sb_free(ub->member_counts);
+		memset(ub, 0, sizeof(tfx_uniform_block));
+	}
+	g_block_count = 0;
+
+	int nt = sb_count(g_textures);
+	while (nt-- > 0) {
+		tfx_texture_free(&g_textures[nt]);
+	}
+
+	tfx_glUseProgram(0);
+	int np = sb_count(g_programs);
+	for (int i = 0; i < np; i++) {
+		tfx_glDeleteProgram(g_programs[i].gl_id);
+		sb_free(g_programs[i].locations);
+		sb_free(g_programs[i].shadows);
+		sb_free(g_programs[i].shadow_data);
+	}
+	sb_free(g_programs);
+	g_programs = NULL;
+
+	capture_clear();
+
+	if (g_platform_data.use_null_backend) {
+		null_clear();
+	}
+}
+
+void tfx_shutdown() {
+	tfx_frame();
+
+	if (rt_remote()) {
+		rt_call(shutdown_thunk, NULL);
+
+		// let the render thread return from tfx_render_frame for good.
+		tfx_mutex_lock(&g_rt.lock);
+		g_rt.quit = true;
+		g_rt.has_thread = false;
+		tfx_cond_broadcast(&g_rt.cond);
+		tfx_mutex_unlock(&g_rt.lock);
+	}
+	else {
+		shutdown_thunk(NULL);
+	}
+
+#ifdef TFX_LEAK_CHECK
+	stb_leakcheck_dumpmem();
+#endif
+}
+
+static bool g_shaderc_allocated = false;
+
+static void push_group(unsigned id, const char *label) {
+	if (tfx_glPushDebugGroup) {
+		CHECK(tfx_glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, id, strlen(label), label));
+	}
+}
+
+static void pop_group() {
+	if (tfx_glPopDebugGroup) {
+		CHECK(tfx_glPopDebugGroup());
+	}
+}
+
+static GLuint load_shader(GLenum type, const char *shaderSrc) {
+	g_shaderc_allocated = true;
+
+	GLuint shader = CHECK(tfx_glCreateShader(type));
+	if (!shader) {
+		TFX_FATAL("%s", "Something has gone horribly wrong, and we can't make shaders.");
+		return 0;
+	}
+
+	CHECK(tfx_glShaderSource(shader, 1, &shaderSrc, NULL));
+	CHECK(tfx_glCompileShader(shader));
+
+	GLint compiled;
+	CHECK(tfx_glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled));
+	if (!compiled) {
+		GLint infoLen = 0;
+		CHECK(tfx_glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &infoLen));
+		if (infoLen > 0) {
+			char* infoLog = (char*)malloc(sizeof(char) * infoLen);
+			CHECK(tfx_glGetShaderInfoLog(shader, infoLen, NULL, infoLog));
+			TFX_ERROR("Error compiling shader:\n%s", infoLog);
+#ifdef _MSC_VER
+			OutputDebugString(infoLog);
+#endif
+			free(infoLog);
+		}
+		CHECK(tfx_glDeleteShader(shader));
+		assert(compiled);
+		return 0;
+	}
+
+	return shader;
+}
+
+const char *legacy_vs_prepend = ""
+	"#ifndef GL_ES\n"
+	"#define lowp\n"
+	"#define mediump\n"
+	"#define highp\n"
+	"#else\n"
+	"precision highp float;\n"
+	"#define in attribute\n"
+	"#define out varying\n"
+	"#endif\n"
+	"#pragma optionNV(strict on)\n"
+	"#define main _pain\n"
+	"#define tfx_viewport_count 1\n"
+	"#define VERTEX 1\n"
+	"#line 1\n"
+;
+const char *legacy_fs_prepend = ""
+	"#ifndef GL_ES\n"
+	"#define lowp\n"
+	"#define mediump\n"
+	"#define highp\n"
+	"#else\n"
+	"precision mediump float;\n"
+	"#define in varying\n"
+	"#endif\n"
+	"#pragma optionNV(strict on)\n"
+	"#define PIXEL 1\n"
+	"#line 1\n"
+;
+const char *vs_prepend = ""
+	"#ifdef GL_ES\n"
+	"precision highp float;\n"
+	"#endif\n"
+	"#define main _pain\n"
+	"#define tfx_viewport_count 1\n"
+	"#define VERTEX 1\n"
+	"#line 1\n"
+;
+const char *fs_prepend = ""
+	"#ifdef GL_ES\n"
+	"precision mediump float;\n"
+	"#endif\n"
+	"#define PIXEL 1\n"
+	"#line 1\n"
+;
+
+const char *vs_append = ""
+	"#undef main\n"
+	"void main() {\n"
+	"	_pain();\n"
+	// TODO: enable extensions if GL < 4.1, add gl_Layer support for
+	// single pass cube/shadow cascade rendering
+	"#if 0\n"
+	"	gl_ViewportIndex = gl_InstanceID % tfx_viewport_count;\n"
+	"#endif\n"
+	"}\n"
+;
+
+static char *sappend(const char *left, const char *right) {
+	size_t ls = strlen(left);
+	size_t rs = strlen(right);
+	char *ss = (char*)malloc(ls+rs+1);
+	memcpy(ss, left, ls);
+	memcpy(ss+ls, right, rs);
+	ss[ls+rs] = '\0';
+	return ss;
+}
+
+static GLuint program_gl_id(tfx_program program) {
+	return program ? g_programs[program - 1].gl_id : 0;
+}
+
+// bytes per element of an active uniform.
+static uint32_t gl_uniform_size(GLenum type) {
+	switch (type) {
+		case GL_FLOAT_VEC2: case GL_INT_VEC2: case GL_BOOL_VEC2: return 8;
+		case GL_FLOAT_VEC3: case GL_INT_VEC3: case GL_BOOL_VEC3: return 12;
+		case GL_FLOAT_VEC4: case GL_INT_VEC4: case GL_BOOL_VEC4: return 16;
+		case GL_FLOAT_MAT2: return 16;
+		case GL_FLOAT_MAT3: return 36;
+		case GL_FLOAT_MAT4: return 64;
+		// scalars and samplers
+		case GL_FLOAT: case GL_INT: case GL_UNSIGNED_INT: case GL_BOOL: return 4;
+		default: return 64;
+	}
+}
+
+// build the uniform location table of a freshly linked program.
+static tfx_program program_add(GLuint gl_id) {
+	tfx_program_data prog;
+	prog.gl_id = gl_id;
+	prog.locations = NULL;
+	prog.shadows = NULL;
+	prog.shadow_data = NULL;
+	prog.block_mask = 0;
+
+	GLint count = 0;
+	GLint max_len = 0;
+	CHECK(tfx_glGetProgramiv(gl_id, GL_ACTIVE_UNIFORMS, &count));
+	CHECK(tfx_glGetProgramiv(gl_id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_len));
+
+	char *name = malloc(max_len + 1);
+	for (GLint i = 0; i < count; i++) {
+		GLint size;
+		GLenum type;
+		name[0] = '\0';
+		CHECK(tfx_glGetActiveUniform(gl_id, (GLuint)i, max_len + 1, NULL, &size, &type, name));
+
+		// arrays are listed by their first element
+		size_t len = strlen(name);
+		if (len > 3 && strcmp(name + len - 3, "[0]") == 0) {
+			name[len - 3] = '\0';
+		}
+
+		// members of uniform blocks have no location
+		GLint loc = CHECK(tfx_glGetUniformLocation(gl_id, name));
+		if (loc < 0) {
+			continue;
+		}
+
+		uint32_t id = uniform_intern(name);
+		while ((uint32_t)sb_count(prog.locations) <= id) {
+			tfx_uniform_shadow empty;
+			memset(&empty, 0, sizeof(tfx_uniform_shadow));
+			sb_push(prog.locations, -1);
+			sb_push(prog.shadows, empty);
+		}
+		prog.locations[id] = loc;
+
+		tfx_uniform_shadow *shadow = &prog.shadows[id];
+		shadow->offset = (uint32_t)sb_count(prog.shadow_data);
+		shadow->capacity = gl_uniform_size(type) * (uint32_t)size;
+		shadow->size = 0;
+		sb_add(prog.shadow_data, (int)shadow->capacity);
+	}
+	free(name);
+
+	GLint block_count = 0;
+	if (g_caps.uniform_buffers) {
+		CHECK(tfx_glGetProgramiv(gl_id, GL_ACTIVE_UNIFORM_BLOCKS, &block_count));
+	}
+	for (GLint i = 0; i < block_count; i++) {
+		char block_name[256];
+		CHECK(tfx_glGetActiveUniformBlockName(gl_id, (GLuint)i, 256, NULL, block_name));
+
+		int b = 0;
+		while (b < g_block_count && strcmp(g_blocks[b].name, block_name) != 0) {
+			b++;
+		}
+		if (b == g_block_count) {
+			TFX_WARN("uniform block %s has not been declared", block_name);
+			continue;
+		}
+
+		GLint data_size = 0;
+		CHECK(tfx_glGetActiveUniformBlockiv(gl_id, (GLuint)i, GL_UNIFORM_BLOCK_DATA_SIZE, &data_size));
+		uint32_t expected = (g_blocks[b].size + 15) & ~15u;
+		if ((uint32_t)data_size != expected) {
+			TFX_WARN("uniform block %s is %d bytes in the shader, but %u as declared", block_name, data_size, expected);
+		}
+
+		CHECK(tfx_glUniformBlockBinding(gl_id, (GLuint)i, (GLuint)b));
+		prog.block_mask |= 1u << b;
+	}
+
+	sb_push(g_programs, prog);
+	return (tfx_program)sb_count(g_programs);
+}
+
+typedef struct tfx_program_args {
+	const char *vss;
+	const char *fss;
+	const char **attribs;
+	tfx_program result;
+} tfx_program_args;
+
+static void program_new_thunk(void *arg) {
+	tfx_program_args *args = arg;
+	args->result = tfx_program_new(args->vss, args->fss, args->attribs);
+}
+
+static void program_cs_new_thunk(void *arg) {
+	tfx_program_args *args = arg;
+	args->result = tfx_program_cs_new(args->vss);
+}
+
+// compile and link a program with the version header and prelude for the
+// context, returns 0 on failure.
+static GLuint program_link(const char *_vss, const char *_fss, const char *attribs[]) {
+	char *vss1, *fss1;
+	if (g_platform_data.context_version < 30) {
+		vss1 = sappend(legacy_vs_prepend, _vss);
+		fss1 = sappend(legacy_fs_prepend, _fss);
+	}
+	else {
+		vss1 = sappend(vs_prepend, _vss);
+		fss1 = sappend(fs_prepend, _fss);
+	}
+
+	char version[64];
+	int gl_major = g_platform_data.context_version / 10;
+	int gl_minor = g_platform_data.context_version % 10;
+	const char *suffix = " core";
+	// post GL3/GLES3, versions are sane, just fix suffix.
+	if (g_platform_data.use_gles && g_platform_data.context_version >= 30) {
+		suffix = " es";
+	}
+	// GL and GLES2 use GLSL 1xx versions
+	else if (g_platform_data.context_version < 30) {
+		suffix = "";
+		gl_major = 1;
+		// GL 2.1 -> GLSL 120
+		if (!g_platform_data.use_gles) {
+			gl_minor = 2;
+		}
+	}
+	snprintf(version, 64, "#version %d%d0%s\n", gl_major, gl_minor, suffix);
+
+	char *vss2 = sappend(vss1, vs_append);
+	free(vss1);
+
+	char *vss = sappend(version, vss2);
+	char *fss = sappend(version, fss1);
+	free(vss2);
+	free(fss1);
+
+	GLuint vs = load_shader(GL_VERTEX_SHADER, vss);
+	GLuint fs = load_shader(GL_FRAGMENT_SHADER, fss);
+	GLuint program = CHECK(tfx_glCreateProgram());
+	if (!program) {
+		return 0;
+	}
+
+	free(vss);
+	free(fss);
+
+	CHECK(tfx_glAttachShader(program, vs));
+	CHECK(tfx_glAttachShader(program, fs));
+
+	const char **it = attribs;
+	int i = 0;
+	while (*it != NULL) {
+		CHECK(tfx_glBindAttribLocation(program, i, *it));
+		i++;
+		it++;
+	}
+
+	// TODO: accept frag data binding array
+	if (tfx_glBindFragDataLocation) {
+		//CHECK(tfx_glBindFragDataLocation(program, 0, "out_color"));
+	}
+
+	CHECK(tfx_glLinkProgram(program));
+
+	GLint linked;
+	CHECK(tfx_glGetProgramiv(program, GL_LINK_STATUS, &linked));
+	if (!linked) {
+		GLint infoLen = 0;
+		CHECK(tfx_glGetProgramiv(program, GL_INFO_LOG_LENGTH, &infoLen));
+		if (infoLen > 0) {
+			char* infoLog = (char*)malloc(infoLen);
+			CHECK(tfx_glGetProgramInfoLog(program, infoLen, NULL, infoLog));
+			TFX_ERROR("Error linking program:\n%s", infoLog);
+			free(infoLog);
+		}
+		CHECK(tfx_glDeleteProgram(program));
+		return 0;
+	}
+
+	CHECK(tfx_glDeleteShader(vs));
+	CHECK(tfx_glDeleteShader(fs));
+
+	return program;
+}
+
+tfx_program tfx_program_new(const char *_vss, const char *_fss, const char *attribs[]) {
+	if (rt_remote()) {
+		tfx_program_args args;
+		args.vss = _vss;
+		args.fss = _fss;
+		args.attribs = attribs;
+		rt_call(program_new_thunk, &args);
+		return args.result;
+	}
+
+	uint64_t zone = trace_begin();
+	GLuint program = program_link(_vss, _fss, attribs);
+	trace_end(TFX_TRACE_RENDER, "Compile Program", zone);
+	if (!program) {
+		return 0;
+	}
+	tfx_program result = program_add(program);
+	capture_program(result, _vss, _fss, attribs, NULL);
+	return result;
+}
+
+tfx_program tfx_program_cs_new(const char *css) {
+	if (rt_remote()) {
+		tfx_program_args args;
+		args.vss = css;
+		rt_call(program_cs_new_thunk, &args);
+		return args.result;
+	}
+
+	if (!g_caps.compute) {
+		return 0;
+	}
+
+	uint64_t zone = trace_begin();
+	GLuint cs = load_shader(GL_COMPUTE_SHADER, css);
+	GLuint program = CHECK(tfx_glCreateProgram());
+	if (!program) {
+		return 0;
+	}
+	CHECK(tfx_glAttachShader(program, cs));
+	CHECK(tfx_glLinkProgram(program));
+
+	GLint linked;
 	CHECK(tfx_glGetProgramiv(program, GL_LINK_STATUS, &linked));
+	trace_end(TFX_TRACE_RENDER, "Compile Compute Program", zone);
 	if (!linked) {
 		GLint infoLen = 0;
 		CHECK(tfx_glGetProgramiv(program, GL_INFO_LOG_LENGTH, &infoLen));
@@ -1118,1245 +3364,4230 @@ tfx_program tfx_program_new(const char *_vss, const char *_fss, const char *attr
 			TFX_ERROR("Error linking program:\n%s", infoLog);
 			free(infoLog);
 		}
-		CHECK(tfx_glDeleteProgram(program));
-		return 0;
+		CHECK(tfx_glDeleteProgram(program));
+		return 0;
+	}
+	CHECK(tfx_glDeleteShader(cs));
+
+	tfx_program result = program_add(program);
+	capture_program(result, NULL, NULL, NULL, css);
+	return result;
+}
+
+static void occlusion_new_thunk(void *arg) {
+	*(tfx_occlusion*)arg = tfx_occlusion_new();
+}
+
+static void occlusion_free_thunk(void *arg) {
+	tfx_occlusion_free(*(tfx_occlusion*)arg);
+}
+
+// slots belong to the render thread, which polls and collects them.
+tfx_occlusion tfx_occlusion_new() {
+	if (rt_remote()) {
+		// calls can run before the frame in flight is drawn, and it may still
+		// use a slot that's been freed but not issued a query yet.
+		rt_wait_idle();
+		tfx_occlusion occ = 0;
+		rt_call(occlusion_new_thunk, &occ);
+		return occ;
+	}
+
+	if (!g_caps.occlusion_query) {
+		return 0;
+	}
+	// slots still holding queries of a freed handle are released by the
+	// renderer before they can be reused.
+	for (uint32_t i = 0; i < TFX_MAX_OCCLUSION; i++) {
+		tfx_occlusion_slot *slot = &g_occlusion.slots[i];
+		if (slot->active || slot->pending > 0) {
+			continue;
+		}
+		slot->active = true;
+		slot->visible = true;
+		if (i >= g_occlusion.used) {
+			g_occlusion.used = i + 1;
+		}
+		return i + 1;
+	}
+	TFX_WARN("%s", "out of occlusion handles");
+	return 0;
+}
+
+void tfx_occlusion_free(tfx_occlusion occ) {
+	assert(occ > 0 && occ <= TFX_MAX_OCCLUSION);
+	if (rt_remote()) {
+		rt_call(occlusion_free_thunk, &occ);
+		return;
+	}
+	g_occlusion.slots[occ - 1].active = false;
+}
+
+tfx_vertex_format tfx_vertex_format_start() {
+	tfx_vertex_format fmt;
+	memset(&fmt, 0, sizeof(tfx_vertex_format));
+
+	return fmt;
+}
+
+void tfx_vertex_format_add(tfx_vertex_format *fmt, uint8_t slot, size_t count, bool normalized, tfx_component_type type) {
+	assert(type >= 0 && type <= TFX_TYPE_SKIP);
+
+	if (slot >= fmt->count) {
+		fmt->count = slot + 1;
+	}
+	tfx_vertex_component *component = &fmt->components[slot];
+	memset(component, 0, sizeof(tfx_vertex_component));
+	component->offset = 0;
+	component->size = count;
+	component->normalized = normalized;
+	component->type = type;
+
+	fmt->component_mask |= 1 << slot;
+}
+
+void tfx_vertex_format_set_divisor(tfx_vertex_format *fmt, uint8_t slot, uint32_t divisor) {
+	assert(slot < fmt->count);
+	fmt->components[slot].divisor = divisor;
+}
+
+size_t tfx_vertex_format_offset(tfx_vertex_format *fmt, uint8_t slot) {
+	assert(slot < 8);
+	return fmt->components[slot].offset;
+}
+
+void tfx_vertex_format_end(tfx_vertex_format *fmt) {
+	size_t stride = 0;
+	int nc = fmt->count;
+	for (int i = 0; i < nc; i++) {
+		tfx_vertex_component *vc = &fmt->components[i];
+		size_t bytes = 0;
+		switch (vc->type) {
+			case TFX_TYPE_SKIP:
+			case TFX_TYPE_UBYTE:
+			case TFX_TYPE_BYTE: bytes = 1; break;
+			case TFX_TYPE_USHORT:
+			case TFX_TYPE_SHORT: bytes = 2; break;
+			case TFX_TYPE_FLOAT: bytes = 4; break;
+			default: assert(false); break;
+		}
+		vc->offset = stride;
+		stride += vc->size * bytes;
+	}
+	fmt->stride = stride;
+}
+
+typedef struct tfx_buffer_args {
+	void *data;
+	size_t size;
+	tfx_vertex_format *format;
+	tfx_buffer_usage usage;
+	tfx_buffer result;
+} tfx_buffer_args;
+
+static void buffer_new_thunk(void *arg) {
+	tfx_buffer_args *args = arg;
+	args->result = tfx_buffer_new(args->data, args->size, args->format, args->usage);
+}
+
+tfx_buffer tfx_buffer_new(void *data, size_t size, tfx_vertex_format *format, tfx_buffer_usage usage) {
+	if (rt_remote()) {
+		tfx_buffer_args args;
+		args.data = data;
+		args.size = size;
+		args.format = format;
+		args.usage = usage;
+		rt_call(buffer_new_thunk, &args);
+		return args.result;
+	}
+
+	GLenum gl_usage = GL_STATIC_DRAW;
+	switch (usage) {
+		case TFX_USAGE_STATIC:  gl_usage = GL_STATIC_DRAW; break;
+		case TFX_USAGE_DYNAMIC: gl_usage = GL_DYNAMIC_DRAW; break;
+		case TFX_USAGE_STREAM:  gl_usage = GL_STREAM_DRAW; break;
+		default: assert(false); break;
+	}
+
+	tfx_buffer buffer;
+	memset(&buffer, 0, sizeof(tfx_buffer));
+	buffer.gl_id = 0;
+	if (format) {
+		assert(format->stride > 0);
+
+		buffer.has_format = true;
+		buffer.format = *format;
+	}
+
+	CHECK(tfx_glGenBuffers(1, &buffer.gl_id));
+	CHECK(tfx_glBindBuffer(GL_ARRAY_BUFFER, buffer.gl_id));
+
+	if (size != 0) {
+		CHECK(tfx_glBufferData(GL_ARRAY_BUFFER, size, data, gl_usage));
+	}
+
+	capture_buffer(&buffer, data, size, usage);
+
+	return buffer;
+}
+
+typedef struct tfx_texture_params {
+	GLenum format;
+	GLenum internal_format;
+	GLenum type;
+	void *update_data;
+} tfx_texture_params;
+
+typedef struct tfx_texture_args {
+	uint16_t w;
+	uint16_t h;
+	void *data;
+	tfx_format format;
+	uint16_t flags;
+	tfx_texture *texture;
+	tfx_canvas canvas;
+} tfx_texture_args;
+
+static void texture_new_thunk(void *arg) {
+	tfx_texture_args *args = arg;
+	*args->texture = tfx_texture_new(args->w, args->h, args->data, args->format, args->flags);
+}
+
+static void texture_free_thunk(void *arg) {
+	tfx_texture_args *args = arg;
+	tfx_texture_free(args->texture);
+}
+
+static void canvas_new_thunk(void *arg) {
+	tfx_texture_args *args = arg;
+	args->canvas = tfx_canvas_new(args->w, args->h, args->format, args->flags);
+}
+
+tfx_texture tfx_texture_new(uint16_t w, uint16_t h, void *data, tfx_format format, uint16_t flags) {
+	tfx_texture t;
+	memset(&t, 0, sizeof(tfx_texture));
+
+	if (rt_remote()) {
+		tfx_texture_args args;
+		args.w = w;
+		args.h = h;
+		args.data = data;
+		args.format = format;
+		args.flags = flags;
+		args.texture = &t;
+		rt_call(texture_new_thunk, &args);
+		return t;
+	}
+
+	t.width = w;
+	t.height = h;
+	t.format = format;
+	t.flags = flags;
+
+	t.gl_count = 1;
+
+	// double buffer the texture updates, to reduce stalling.
+	if ((flags & TFX_TEXTURE_CPU_WRITABLE) == TFX_TEXTURE_CPU_WRITABLE) {
+		t.gl_count = 2;
+	}
+
+	t.gl_idx = 0;
+
+	tfx_texture_params *params = calloc(1, sizeof(tfx_texture_params));
+	params->update_data = NULL;
+
+	switch (format) {
+		case TFX_FORMAT_RGB565:
+			params->format = GL_RGB;
+			params->internal_format = GL_RGB;
+			params->type = GL_UNSIGNED_SHORT_5_6_5;
+			break;
+		case TFX_FORMAT_RGBA8:
+			params->format = GL_RGBA;
+			params->internal_format = GL_RGBA;
+			params->type = GL_UNSIGNED_BYTE;
+			break;
+		default:
+			assert(false);
+			break;
+	}
+
+	t.internal = params;
+
+	CHECK(tfx_glGenTextures(t.gl_count, t.gl_ids));
+	for (unsigned i = 0; i < t.gl_count; i++) {
+		assert(t.gl_ids[i] > 0);
+
+		bool gen_mips = (flags & TFX_TEXTURE_GEN_MIPS) == TFX_TEXTURE_GEN_MIPS;
+
+		CHECK(tfx_glBindTexture(GL_TEXTURE_2D, t.gl_ids[i]));
+		if ((flags & TFX_TEXTURE_FILTER_POINT) == TFX_TEXTURE_FILTER_POINT) {
+			CHECK(tfx_glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
+			CHECK(tfx_glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, gen_mips ? GL_NEAREST_MIPMAP_NEAREST : GL_NEAREST));
+		}
+		else if ((flags & TFX_TEXTURE_FILTER_LINEAR) == TFX_TEXTURE_FILTER_LINEAR || !flags) {
+			CHECK(tfx_glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+			CHECK(tfx_glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, gen_mips ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR));
+		}
+		CHECK(tfx_glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+		CHECK(tfx_glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+
+		if ((g_flags & TFX_RESET_MAX_ANISOTROPY) == TFX_RESET_MAX_ANISOTROPY) {
+			GLenum GL_TEXTURE_MAX_ANISOTROPY_EXT = 0x84FE;
+			CHECK(tfx_glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, g_max_aniso));
+		}
+
+		CHECK(tfx_glPixelStorei(GL_UNPACK_ALIGNMENT, 1));
+		CHECK(tfx_glTexImage2D(GL_TEXTURE_2D, 0, params->internal_format, w, h, 0, params->format, params->type, data));
+		if (gen_mips && data) {
+			CHECK(tfx_glGenerateMipmap(GL_TEXTURE_2D));
+		}
+	}
+
+	sb_push(g_textures, t);
+	capture_texture(&t, data);
+
+	return t;
+}
+
+void tfx_texture_update(tfx_texture *tex, void *data) {
+	assert((tex->flags & TFX_TEXTURE_CPU_WRITABLE) == TFX_TEXTURE_CPU_WRITABLE);
+	tfx_texture_params *internal = tex->internal;
+	internal->update_data = data;
+}
+
+void tfx_texture_free(tfx_texture *tex) {
+	if (rt_remote()) {
+		tfx_texture_args args;
+		args.texture = tex;
+		rt_call(texture_free_thunk, &args);
+		return;
+	}
+
+	int nt = sb_count(g_textures);
+	for (int i = 0; i < nt; i++) {
+		tfx_texture *cached = &g_textures[i];
+		// we only need to check index 0, as these ids cannot overlap or be reused.
+		if (tex->gl_ids[0] == cached->gl_ids[0]) {
+			capture_forget(TFX_CHUNK_TEXTURE, cached->gl_ids[0]);
+			tfx_texture_params *internal = (tfx_texture_params*)cached->internal;
+			free(internal);
+			tfx_glDeleteTextures(cached->gl_count, cached->gl_ids);
+			g_textures[i] = g_textures[nt-1];
+			// this, uh, might not be right.
+			stb__sbraw(g_textures)[1] -= 1;
+		}
+	}
+}
+
+tfx_canvas mk_cube_canvas(tfx_canvas canvas, uint16_t flags) {
+	bool gen_mips = (flags & TFX_TEXTURE_GEN_MIPS) == TFX_TEXTURE_GEN_MIPS;
+
+	GLuint color_tex = 0;
+	CHECK(tfx_glGenTextures(1, &color_tex));
+	CHECK(tfx_glBindTexture(GL_TEXTURE_CUBE_MAP, color_tex));
+	CHECK(tfx_glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE));
+	CHECK(tfx_glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+	CHECK(tfx_glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+	CHECK(tfx_glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, gen_mips ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR));
+	CHECK(tfx_glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+
+	if ((g_flags & TFX_RESET_MAX_ANISOTROPY) == TFX_RESET_MAX_ANISOTROPY) {
+		GLenum GL_TEXTURE_MAX_ANISOTROPY_EXT = 0x84FE;
+		CHECK(tfx_glTexParameterf(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_ANISOTROPY_EXT, g_max_aniso));
+	}
+
+	bool hdr = (canvas.format & TFX_FORMAT_RG11B10F) == TFX_FORMAT_RG11B10F;
+	GLenum fmt = GL_RGBA8;
+	GLenum type = GL_UNSIGNED_BYTE;
+	if (hdr) {
+		fmt = GL_R11F_G11F_B10F;
+		type = GL_FLOAT;
+	}
+	GLuint size = canvas.width;
+	for (int i = 0; i < 6; i++) {
+		CHECK(tfx_glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, fmt, size, size, 0, GL_BGRA, type, NULL));
+	}
+	if (gen_mips) {
+		CHECK(tfx_glGenerateMipmap(GL_TEXTURE_CUBE_MAP));
+	}
+
+	GLuint depth_tex = 0;
+	CHECK(tfx_glGenTextures(1, &depth_tex));
+	CHECK(tfx_glBindTexture(GL_TEXTURE_CUBE_MAP, depth_tex));
+	CHECK(tfx_glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE));
+	CHECK(tfx_glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+	CHECK(tfx_glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+	CHECK(tfx_glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
+	CHECK(tfx_glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+	for (int i = 0; i < 6; i++) {
+		CHECK(tfx_glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_DEPTH_COMPONENT16, size, size, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_BYTE, NULL));
+	}
+
+	GLuint fb = 0;
+	CHECK(tfx_glGenFramebuffers(1, &fb));
+	CHECK(tfx_glBindFramebuffer(GL_FRAMEBUFFER, fb));
+	CHECK(tfx_glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, color_tex, 0));
+	CHECK(tfx_glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depth_tex, 0));
+
+	GLuint buffer = GL_COLOR_ATTACHMENT0;
+	CHECK(tfx_glDrawBuffers(1, &buffer));
+	CHECK(tfx_glReadBuffer(GL_COLOR_ATTACHMENT0));
+
+	GLenum status = CHECK(tfx_glCheckFramebufferStatus(GL_FRAMEBUFFER));
+	if (status != GL_FRAMEBUFFER_COMPLETE) {
+		assert(false);
+		// TODO: return something more error-y
+		return canvas;
+	}
+
+	int idx = 0;
+	canvas.gl_ids[idx++] = color_tex;
+	canvas.gl_ids[idx++] = depth_tex;
+	canvas.gl_fbo = fb;
+	canvas.allocated += 1;
+	canvas.mipmaps = gen_mips;
+	canvas.cube = true;
+
+	return canvas;
+}
+
+tfx_canvas tfx_canvas_new(uint16_t w, uint16_t h, tfx_format format, uint16_t flags) {
+	if (rt_remote()) {
+		tfx_texture_args args;
+		args.w = w;
+		args.h = h;
+		args.format = format;
+		args.flags = flags;
+		rt_call(canvas_new_thunk, &args);
+		return args.canvas;
+	}
+
+	tfx_canvas c;
+	memset(&c, 0, sizeof(tfx_canvas));
+
+	c.allocated = 0;
+	c.width  = w;
+	c.height = h;
+	c.format = format;
+
+	if ((flags & TFX_TEXTURE_CUBE) == TFX_TEXTURE_CUBE) {
+		c = mk_cube_canvas(c, flags);
+		capture_canvas(&c, flags);
+		return c;
+	}
+
+	GLenum color_format = 0;
+	GLenum depth_format = 0;
+	GLenum internal = 0;
+
+	switch (format) {
+		case TFX_FORMAT_RGBA8: {
+			color_format = GL_UNSIGNED_BYTE;
+			internal = GL_RGB;
+			break;
+		}
+		case TFX_FORMAT_RGB565: {
+			color_format = GL_UNSIGNED_SHORT_5_6_5;
+			internal = GL_RGB;
+			break;
+		}
+		case TFX_FORMAT_D16: {
+			depth_format = GL_DEPTH_COMPONENT16;
+			break;
+		}
+		case TFX_FORMAT_RGBA8_D16: {
+			color_format = GL_UNSIGNED_BYTE;
+			depth_format = GL_DEPTH_COMPONENT16;
+			internal = GL_RGBA;
+			break;
+		}
+		case TFX_FORMAT_RGBA8_D24: {
+			color_format = GL_UNSIGNED_BYTE;
+			depth_format = GL_DEPTH_COMPONENT24;
+			internal = GL_RGBA;
+			break;
+		}
+		case TFX_FORMAT_RGB565_D16: {
+			color_format = GL_UNSIGNED_SHORT_5_6_5;
+			depth_format = GL_DEPTH_COMPONENT16;
+			internal = GL_RGB;
+			break;
+		}
+		default: assert(false); break;
+	}
+
+	// and now the fbo.
+	GLuint fbo;
+	CHECK(tfx_glGenFramebuffers(1, &fbo));
+	CHECK(tfx_glBindFramebuffer(GL_FRAMEBUFFER, fbo));
+
+	int idx = 0;
+
+	// setup color buffer...
+	if (color_format) {
+		assert(internal != 0);
+
+		GLuint color;
+		CHECK(tfx_glGenTextures(1, &color));
+		c.gl_ids[idx++] = color;
+		CHECK(tfx_glBindTexture(GL_TEXTURE_2D, color));
+		CHECK(tfx_glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, w, h, 0, internal, color_format, NULL));
+
+		bool gen_mips = (flags & TFX_TEXTURE_GEN_MIPS) == TFX_TEXTURE_GEN_MIPS;
+		if ((flags & TFX_TEXTURE_FILTER_POINT) == TFX_TEXTURE_FILTER_POINT) {
+			CHECK(tfx_glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
+			CHECK(tfx_glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, gen_mips ? GL_NEAREST_MIPMAP_NEAREST : GL_NEAREST));
+		}
+		else if ((flags & TFX_TEXTURE_FILTER_LINEAR) == TFX_TEXTURE_FILTER_LINEAR || !flags) {
+			CHECK(tfx_glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+			CHECK(tfx_glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, gen_mips ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR));
+		}
+
+		CHECK(tfx_glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color, 0));
+	}
+
+	// setup depth buffer...
+	if (depth_format) {
+		GLuint rbo;
+		CHECK(tfx_glGenRenderbuffers(1, &rbo));
+		CHECK(tfx_glBindRenderbuffer(GL_RENDERBUFFER, rbo));
+		CHECK(tfx_glRenderbufferStorage(GL_RENDERBUFFER, depth_format, w, h));
+		CHECK(tfx_glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rbo));
+	}
+
+	GLenum status = CHECK(tfx_glCheckFramebufferStatus(GL_FRAMEBUFFER));
+	if (status != GL_FRAMEBUFFER_COMPLETE) {
+		assert(false);
+		// TODO: return something more error-y
+		return c;
+	}
+
+	c.gl_fbo = fbo;
+	c.allocated += 1;
+	capture_canvas(&c, flags);
+
+	return c;
+}
+
+static size_t uniform_size_for(tfx_uniform_type type) {
+	switch (type) {
+		case TFX_UNIFORM_FLOAT: return sizeof(float);
+		case TFX_UNIFORM_INT: return sizeof(uint32_t);
+		case TFX_UNIFORM_VEC2: return sizeof(float)*2;
+		case TFX_UNIFORM_VEC3: return sizeof(float)*3;
+		case TFX_UNIFORM_VEC4: return sizeof(float)*4;
+		case TFX_UNIFORM_MAT2: return sizeof(float)*4;
+		case TFX_UNIFORM_MAT3: return sizeof(float)*9;
+		case TFX_UNIFORM_MAT4: return sizeof(float)*16;
+		default: return 0;
+	}
+	return 0;
+}
+
+tfx_uniform tfx_uniform_new(const char *name, tfx_uniform_type type, int count) {
+	tfx_uniform u;
+	memset(&u, 0, sizeof(tfx_uniform));
+
+	u.name  = name;
+	u.id    = uniform_intern(name);
+	u.type  = type;
+	u.count = count;
+	u.last_count = count;
+	u.size  = count * uniform_size_for(type);
+
+	return u;
+}
+
+// std140 treats matrices as arrays of column vectors, and pads array elements
+// to 16 bytes.
+static void std140_element(tfx_uniform_type type, uint32_t *columns, uint32_t *column_size) {
+	*columns = 1;
+	switch (type) {
+		case TFX_UNIFORM_MAT2: *columns = 2; *column_size = 8; break;
+		case TFX_UNIFORM_MAT3: *columns = 3; *column_size = 12; break;
+		case TFX_UNIFORM_MAT4: *columns = 4; *column_size = 16; break;
+		default: *column_size = (uint32_t)uniform_size_for(type); break;
+	}
+}
+
+static uint32_t std140_stride(tfx_uniform_type type, int count) {
+	uint32_t columns, column_size;
+	std140_element(type, &columns, &column_size);
+	if (count > 1 || columns > 1) {
+		return 16;
+	}
+	return column_size;
+}
+
+tfx_uniform tfx_uniform_new_block(const char *block, const char *name, tfx_uniform_type type, int count) {
+	// the render thread packs and uploads blocks from these lists.
+	rt_wait_idle();
+
+	tfx_uniform u = tfx_uniform_new(name, type, count);
+
+	int b = 0;
+	while (b < g_block_count && strcmp(g_blocks[b].name, block) != 0) {
+		b++;
+	}
+	if (b == g_block_count) {
+		assert(g_block_count < TFX_MAX_UNIFORM_BLOCKS);
+		if (g_block_count == TFX_MAX_UNIFORM_BLOCKS) {
+			TFX_ERROR("too many uniform blocks, can't add %s", block);
+			return u;
+		}
+		memset(&g_blocks[b], 0, sizeof(tfx_uniform_block));
+		g_blocks[b].name = tfx_strdup(block);
+		g_block_count++;
+	}
+	tfx_uniform_block *ub = &g_blocks[b];
+
+	// declaring the same member again keeps its place.
+	int nm = sb_count(ub->members);
+	for (int i = 0; i < nm; i++) {
+		if (ub->members[i] == u.id) {
+			u.block = b + 1;
+			u.block_offset = ub->member_offsets[i];
+			return u;
+		}
+	}
+
+	uint32_t columns, column_size;
+	std140_element(type, &columns, &column_size);
+	uint32_t stride = std140_stride(type, count);
+	uint32_t align = stride;
+	uint32_t size = column_size;
+	if (count > 1 || columns > 1) {
+		size = stride * columns * count;
+	}
+	else if (column_size == 12) {
+		align = 16; // vec3
+	}
+
+	uint32_t offset = (ub->size + align - 1) & ~(align - 1);
+	ub->size = offset + size;
+	sb_push(ub->members, u.id);
+	sb_push(ub->member_offsets, offset);
+	sb_push(ub->member_types, type);
+	sb_push(ub->member_counts, count);
+
+	u.block = b + 1;
+	u.block_offset = offset;
+	return u;
+}
+
+void tfx_view_set_transform(uint8_t id, float *_view, float *proj_l, float *proj_r) {
+	// TODO: reserve tfx_world_to_view, tfx_view_to_screen uniforms
+	tfx_view *view = &g_views[id];
+	assert(view != NULL);
+	memcpy(view->view, _view, sizeof(float)*16);
+	if (proj_l) {
+		memcpy(view->proj_left, proj_l, sizeof(float)*16);
+		view->flags |= TFX_VIEW_FRUSTUM;
+	}
+	if (proj_r) {
+		memcpy(view->proj_right, proj_r, sizeof(float)*16);
+	}
+}
+
+void tfx_view_set_culling(uint8_t id, bool enabled) {
+	tfx_view *view = &g_views[id];
+	if (enabled) {
+		view->flags &= ~TFX_VIEW_NO_CULL;
+	}
+	else {
+		view->flags |= TFX_VIEW_NO_CULL;
+	}
+}
+
+void tfx_view_set_name(uint8_t id, const char *name) {
+	tfx_view *view = &g_views[id];
+	view->name = name;
+}
+
+void tfx_view_set_canvas(uint8_t id, tfx_canvas *canvas, int layer) {
+	tfx_view *view = &g_views[id];
+	assert(view != NULL);
+	view->has_canvas = true;
+	view->canvas = *canvas;
+	view->canvas_layer = layer;
+}
+
+void tfx_view_set_clear_color(uint8_t id, int color) {
+	tfx_view *view = &g_views[id];
+	assert(view != NULL);
+	view->flags |= TFX_VIEW_CLEAR_COLOR;
+	view->clear_color = color;
+}
+
+void tfx_view_set_clear_depth(uint8_t id, float depth) {
+	tfx_view *view = &g_views[id];
+	assert(view != NULL);
+	view->flags |= TFX_VIEW_CLEAR_DEPTH;
+	view->clear_depth = depth;
+}
+
+void tfx_view_set_depth_test(uint8_t id, tfx_depth_test mode) {
+	tfx_view *view = &g_views[id];
+	assert(view != NULL);
+
+	view->flags &= ~TFX_VIEW_DEPTH_TEST_MASK;
+	switch (mode) {
+		case TFX_DEPTH_TEST_NONE: break; /* already cleared */
+		case TFX_DEPTH_TEST_LT: {
+			view->flags |= TFX_VIEW_DEPTH_TEST_LT;
+			break;
+		}
+		case TFX_DEPTH_TEST_GT: {
+			view->flags |= TFX_VIEW_DEPTH_TEST_GT;
+			break;
+		}
+		case TFX_DEPTH_TEST_EQ: {
+			view->flags |= TFX_VIEW_DEPTH_TEST_EQ;
+			break;
+		}
+		default: assert(false); break;
+	}
+}
+
+uint16_t tfx_view_get_width(uint8_t id) {
+	tfx_view *view = &g_views[id];
+	assert(view != NULL);
+
+	if (view->has_canvas) {
+		return view->canvas.width;
+	}
+
+	return g_backbuffer.width;
+}
+
+uint16_t tfx_view_get_height(uint8_t id) {
+	tfx_view *view = &g_views[id];
+	assert(view != NULL);
+
+	if (view->has_canvas) {
+		return view->canvas.height;
+	}
+
+	return g_backbuffer.height;
+}
+
+void tfx_view_get_dimensions(uint8_t id, uint16_t *w, uint16_t *h) {
+	if (w) {
+		*w = tfx_view_get_width(id);
+	}
+	if (h) {
+		*h = tfx_view_get_height(id);
+	}
+}
+
+void tfx_view_set_scissor(uint8_t id, uint16_t x, uint16_t y, uint16_t w, uint16_t h) {
+	tfx_view *view = &g_views[id];
+	view->flags |= TFX_VIEW_SCISSOR;
+
+	tfx_rect rect;
+	rect.x = x;
+	rect.y = y;
+	rect.w = w;
+	rect.h = h;
+
+	view->scissor_rect = rect;
+}
+
+void tfx_view_set_sort(uint8_t id, tfx_sort_mode mode) {
+	tfx_view *view = &g_views[id];
+	assert(view != NULL);
+	assert(mode >= TFX_SORT_SEQUENTIAL && mode <= TFX_SORT_BACK_TO_FRONT);
+	view->sort_mode = mode;
+}
+
+tfx_texture tfx_get_texture(tfx_canvas *canvas, uint8_t index) {
+	tfx_texture tex;
+	memset(&tex, 0, sizeof(tfx_texture));
+
+	assert(index < canvas->allocated);
+	tex.format = canvas->format;
+	tex.gl_count = 1;
+	tex.gl_ids[0] = canvas->gl_ids[index];
+	tex.width = canvas->width;
+	tex.height = canvas->height;
+
+	if (canvas->mipmaps) {
+		tex.flags |= TFX_TEXTURE_GEN_MIPS;
+	}
+	if (canvas->cube) {
+		tex.flags |= TFX_TEXTURE_CUBE;
+	}
+
+	return tex;
+}
+
+static void encoder_reset(tfx_encoder *enc) {
+	memset(&enc->tmp_draw, 0, sizeof(tfx_draw));
+}
+
+tfx_encoder *tfx_encoder_begin() {
+	uint32_t idx = tfx_atomic_add(&g_encoder_count, 1);
+	if (idx >= TFX_MAX_ENCODERS) {
+		return NULL;
+	}
+	tfx_encoder *enc = &g_encoders[idx];
+	assert(!enc->active);
+	encoder_reset(enc);
+	enc->index = idx;
+	enc->active = true;
+	return enc;
+}
+
+void tfx_encoder_end(tfx_encoder *enc) {
+	assert(enc != NULL);
+	assert(enc != &g_encoders[0]);
+	assert(enc->bundle == NULL);
+	assert(enc->active);
+	enc->active = false;
+}
+
+// hand out a chunk of the frame arena. if it's full, the heap covers for the
+// rest of the frame and the arena is grown to fit on reset.
+static uint8_t *arena_chunk(tfx_frame_data *frame, uint32_t size) {
+	uint32_t offset = tfx_atomic_add(&frame->arena_offset, size);
+	if (offset + size <= frame->arena_size) {
+		return frame->arena + offset;
+	}
+	uint8_t *mem = malloc(size);
+	tfx_mutex_lock(&frame->arena_lock);
+	sb_push(frame->arena_overflow, mem);
+	tfx_mutex_unlock(&frame->arena_lock);
+	return mem;
+}
+
+// grab per-frame (or per-bundle) memory, a chunk at a time so that encoders
+// on different threads rarely touch the shared offset.
+static uint8_t *ub_alloc(tfx_encoder *enc, size_t size) {
+	// keep everything pointer aligned, uniform lists live here too.
+	size = (size + 7) & ~(size_t)7;
+	if ((size_t)(enc->ub_end - enc->ub_cursor) < size) {
+		uint32_t chunk = TFX_ENCODER_UNIFORM_CHUNK;
+		if (size > chunk) {
+			chunk = (uint32_t)size;
+		}
+		if (enc->bundle) {
+			enc->ub_cursor = malloc(chunk);
+			sb_push(enc->bundle->chunks, enc->ub_cursor);
+		}
+		else {
+			enc->ub_cursor = arena_chunk(g_submit_frame, chunk);
+		}
+		enc->ub_end = enc->ub_cursor + chunk;
+	}
+	uint8_t *ptr = enc->ub_cursor;
+	enc->ub_cursor += size;
+	return ptr;
+}
+
+static void encoder_set_uniform(tfx_encoder *enc, tfx_uniform *uniform, const void *data, const int count) {
+	tfx_uniform copy = *uniform;
+	size_t size = uniform->size;
+	copy.last_count = uniform->count;
+	if (count >= 0) {
+		size = count * uniform_size_for(uniform->type);
+		copy.last_count = count;
+	}
+
+	copy.data = ub_alloc(enc, size);
+	memcpy(copy.data, data, size);
+
+	// only the latest update of a uniform matters to the next draw.
+	uint32_t id = copy.id;
+	while ((uint32_t)sb_count(enc->uniform_slots) <= id) {
+		sb_push(enc->uniform_slots, -1);
+	}
+	int32_t slot = enc->uniform_slots[id];
+	if (slot < 0) {
+		slot = sb_count(enc->uniforms);
+		sb_push(enc->uniforms, copy);
+		// anything but the current serial, it hasn't been set yet.
+		sb_push(enc->uniform_serials, enc->serial - 1);
+		enc->uniform_slots[id] = slot;
+	}
+	else {
+		enc->uniforms[slot] = copy;
+	}
+
+	if (enc->uniform_serials[slot] != enc->serial) {
+		enc->uniform_serials[slot] = enc->serial;
+		sb_push(enc->fresh, (uint32_t)slot);
+	}
+}
+
+void tfx_encoder_set_uniform(tfx_encoder *enc, tfx_uniform *uniform, const float *data, const int count) {
+	encoder_set_uniform(enc, uniform, data, count);
+}
+
+void tfx_encoder_set_uniform_int(tfx_encoder *enc, tfx_uniform *uniform, const int *data, const int count) {
+	encoder_set_uniform(enc, uniform, data, count);
+}
+
+void tfx_encoder_set_callback(tfx_encoder *enc, tfx_draw_callback cb) {
+	enc->tmp_draw.callback = cb;
+}
+
+void tfx_encoder_set_scissor(tfx_encoder *enc, uint16_t x, uint16_t y, uint16_t w, uint16_t h) {
+	enc->tmp_draw.use_scissor = true;
+	enc->tmp_draw.scissor_rect.x = x;
+	enc->tmp_draw.scissor_rect.y = y;
+	enc->tmp_draw.scissor_rect.w = w;
+	enc->tmp_draw.scissor_rect.h = h;
+}
+
+void tfx_encoder_set_bounds_aabb(tfx_encoder *enc, const float *min, const float *max) {
+	assert(min != NULL && max != NULL);
+	float *b = enc->tmp_draw.bounds;
+	for (int i = 0; i < 3; i++) {
+		assert(max[i] >= min[i]);
+		b[i] = (min[i] + max[i]) * 0.5f;
+		b[i+3] = (max[i] - min[i]) * 0.5f;
+	}
+	b[6] = 0.0f;
+	enc->tmp_draw.use_bounds = true;
+}
+
+void tfx_encoder_set_bounds_sphere(tfx_encoder *enc, const float *center, float radius) {
+	assert(center != NULL && radius >= 0.0f);
+	float *b = enc->tmp_draw.bounds;
+	for (int i = 0; i < 3; i++) {
+		b[i] = center[i];
+		b[i+3] = 0.0f;
+	}
+	b[6] = radius;
+	enc->tmp_draw.use_bounds = true;
+}
+
+void tfx_encoder_set_occlusion(tfx_encoder *enc, tfx_occlusion occ) {
+	assert(occ <= TFX_MAX_OCCLUSION);
+	enc->tmp_draw.occlusion = occ;
+}
+
+void tfx_encoder_set_texture(tfx_encoder *enc, tfx_uniform *uniform, tfx_texture *tex, uint8_t slot) {
+	assert(slot <= 8);
+	assert(uniform != NULL);
+	assert(uniform->count == 1);
+
+	int value = slot;
+	encoder_set_uniform(enc, uniform, &value, 1);
+
+	assert(tex->gl_ids[tex->gl_idx] > 0);
+	enc->tmp_draw.textures[slot] = *tex;
+}
+
+void tfx_encoder_set_state(tfx_encoder *enc, uint64_t flags) {
+	enc->tmp_draw.flags = flags;
+}
+
+void tfx_encoder_set_buffer(tfx_encoder *enc, tfx_buffer *buf, uint8_t slot, bool write) {
+	assert(slot <= 8);
+	assert(buf != NULL);
+	enc->tmp_draw.ssbos[slot] = *buf;
+	enc->tmp_draw.ssbo_write[slot] = write;
+}
+
+void tfx_encoder_set_transient_buffer(tfx_encoder *enc, tfx_transient_buffer tb) {
+	// transient data only lives for a frame
+	assert(enc->bundle == NULL);
+	tfx_draw *draw = &enc->tmp_draw;
+	if (!tb.has_format) {
+		draw->ibo = g_transient_buffer.buf;
+		draw->use_ibo = true;
+		draw->ibo_32bit = tb.index_32bit;
+		draw->ibo_offset = tb.offset;
+		draw->indices = tb.num;
+		return;
+	}
+	draw->vbo = g_transient_buffer.buf;
+	draw->use_vbo = true;
+	draw->use_tvb = true;
+	draw->tvb_fmt = tb.format;
+	draw->offset = tb.offset;
+	if (!draw->use_ibo) {
+		draw->indices = tb.num;
+	}
+}
+
+void tfx_encoder_set_vertices(tfx_encoder *enc, tfx_buffer *vbo, int count) {
+	assert(vbo != NULL);
+	assert(vbo->has_format);
+
+	enc->tmp_draw.vbo = *vbo;
+	enc->tmp_draw.use_vbo = true;
+	if (!enc->tmp_draw.use_ibo) {
+		enc->tmp_draw.indices = count;
+	}
+}
+
+void tfx_encoder_set_indices(tfx_encoder *enc, tfx_buffer *ibo, int count) {
+	enc->tmp_draw.ibo = *ibo;
+	enc->tmp_draw.use_ibo = true;
+	enc->tmp_draw.ibo_32bit = false;
+	enc->tmp_draw.ibo_offset = 0;
+	enc->tmp_draw.indices = count;
+}
+
+void tfx_encoder_set_instance_data(tfx_encoder *enc, tfx_buffer *buf, uint32_t count) {
+	assert(buf != NULL);
+	assert(buf->has_format);
+	enc->tmp_draw.instance_vbo = *buf;
+	enc->tmp_draw.use_instance_vbo = true;
+	enc->tmp_draw.instance_offset = 0;
+	enc->tmp_draw.instances = count;
+}
+
+void tfx_encoder_set_transient_instance_data(tfx_encoder *enc, tfx_transient_buffer tb) {
+	assert(tb.has_format);
+	assert(enc->bundle == NULL);
+	enc->tmp_draw.instance_vbo = g_transient_buffer.buf;
+	enc->tmp_draw.instance_vbo.has_format = true;
+	enc->tmp_draw.instance_vbo.format = tb.format;
+	enc->tmp_draw.use_instance_vbo = true;
+	enc->tmp_draw.instance_offset = tb.offset;
+	enc->tmp_draw.instances = tb.num;
+}
+
+void tfx_encoder_set_instance_count(tfx_encoder *enc, uint32_t count) {
+	enc->tmp_draw.instances = count;
+}
+
+// attach the last update of every uniform set so far. uniforms set since the
+// last submit are copied for this draw, the rest come from the sticky list,
+// which is only rebuilt when a uniform set for the last draw wasn't set again
+// for this one. so a draw costs the uniforms it changes, not all of them.
+// locations are looked up at frame time, encoders may not be on the GL thread.
+static void push_uniforms(tfx_encoder *enc, tfx_draw *add_state) {
+	uint32_t serial = enc->serial;
+	bool rebuild = false;
+	int nl = sb_count(enc->last_fresh);
+	for (int i = 0; i < nl; i++) {
+		if (enc->uniform_serials[enc->last_fresh[i]] != serial) {
+			rebuild = true;
+			break;
+		}
+	}
+
+	int n = sb_count(enc->uniforms);
+	int nf = sb_count(enc->fresh);
+	if (rebuild) {
+		enc->sticky = NULL;
+		enc->sticky_count = 0;
+		if (n > nf) {
+			enc->sticky = (tfx_uniform*)ub_alloc(enc, (n - nf) * sizeof(tfx_uniform));
+		}
+		for (int i = 0; i < n; i++) {
+			if (enc->uniform_serials[i] != serial) {
+				enc->sticky[enc->sticky_count++] = enc->uniforms[i];
+			}
+		}
+	}
+	add_state->uniforms = enc->sticky;
+	add_state->uniform_count = enc->sticky_count;
+
+	add_state->draw_uniforms = NULL;
+	add_state->draw_uniform_count = nf;
+	if (nf > 0) {
+		add_state->draw_uniforms = (tfx_uniform*)ub_alloc(enc, nf * sizeof(tfx_uniform));
+		for (int i = 0; i < nf; i++) {
+			add_state->draw_uniforms[i] = enc->uniforms[enc->fresh[i]];
+		}
+	}
+
+	uint32_t *tmp = enc->last_fresh;
+	enc->last_fresh = enc->fresh;
+	enc->fresh = tmp;
+	sb_reset(enc->fresh);
+	enc->serial++;
+}
+
+// forget all uniform state, keeping the lists' capacity.
+static void encoder_reset_uniforms(tfx_encoder *enc) {
+	int n = sb_count(enc->uniforms);
+	for (int i = 0; i < n; i++) {
+		enc->uniform_slots[enc->uniforms[i].id] = -1;
+	}
+	sb_reset(enc->uniforms);
+	sb_reset(enc->uniform_serials);
+	sb_reset(enc->fresh);
+	sb_reset(enc->last_fresh);
+	enc->sticky = NULL;
+	enc->sticky_count = 0;
+}
+
+static void encoder_free_uniforms(tfx_encoder *enc) {
+	sb_free(enc->uniforms);
+	sb_free(enc->uniform_slots);
+	sb_free(enc->uniform_serials);
+	sb_free(enc->fresh);
+	sb_free(enc->last_fresh);
+	enc->uniforms = NULL;
+	enc->uniform_slots = NULL;
+	enc->uniform_serials = NULL;
+	enc->fresh = NULL;
+	enc->last_fresh = NULL;
+	enc->sticky = NULL;
+	enc->sticky_count = 0;
+}
+
+void tfx_encoder_dispatch(tfx_encoder *enc, uint8_t id, tfx_program program, uint32_t x, uint32_t y, uint32_t z) {
+	uint64_t start = tfx_time_ns();
+	enc->tmp_draw.program = program;
+	assert(program != 0);
+	assert((x + y + z) > 0);
+	assert(enc->bundle == NULL);
+
+	tfx_draw add_state;
+	memcpy(&add_state, &enc->tmp_draw, sizeof(tfx_draw));
+	add_state.threads_x = x;
+	add_state.threads_y = y;
+	add_state.threads_z = z;
+
+	push_uniforms(enc, &add_state);
+	sb_push(g_submit_frame->jobs[enc->index][id], add_state);
+	if (g_capture.recording) {
+		sb_push(enc->capture_log, 0x100 | id);
+	}
+
+	encoder_reset(enc);
+	enc->submit_ns += tfx_time_ns() - start;
+}
+
+void tfx_encoder_submit(tfx_encoder *enc, uint8_t id, tfx_program program, bool retain) {
+	uint64_t start = tfx_time_ns();
+	enc->tmp_draw.program = program;
+	assert(program != 0);
+
+	tfx_draw add_state;
+	memcpy(&add_state, &enc->tmp_draw, sizeof(tfx_draw));
+	push_uniforms(enc, &add_state);
+	if (enc->bundle) {
+		sb_push(enc->bundle->draws, add_state);
+	}
+	else {
+		sb_push(g_submit_frame->draws[enc->index][id], add_state);
+		if (g_capture.recording) {
+			sb_push(enc->capture_log, id);
+		}
+	}
+
+	if (!retain) {
+		encoder_reset(enc);
+	}
+	enc->submit_ns += tfx_time_ns() - start;
+}
+
+void tfx_encoder_submit_indirect(tfx_encoder *enc, uint8_t id, tfx_program program, tfx_buffer *commands, uint32_t offset, uint32_t count, bool retain) {
+	assert(commands != NULL && commands->gl_id != 0);
+	assert(offset % 4 == 0);
+	enc->tmp_draw.indirect = *commands;
+	enc->tmp_draw.indirect_offset = offset;
+	enc->tmp_draw.indirect_count = count;
+	tfx_encoder_submit(enc, id, program, retain);
+	enc->tmp_draw.indirect.gl_id = 0;
+}
+
+void tfx_encoder_submit_ordered(tfx_encoder *enc, uint8_t id, tfx_program program, uint32_t depth, bool retain) {
+	enc->tmp_draw.depth = depth;
+	enc->tmp_draw.depth_at = false;
+	tfx_encoder_submit(enc, id, program, retain);
+}
+
+// map a float onto a uint32 with the same ordering, negatives included.
+static uint32_t depth_bits(float depth) {
+	uint32_t bits;
+	memcpy(&bits, &depth, sizeof(uint32_t));
+	return (bits & 0x80000000u) ? ~bits : (bits | 0x80000000u);
+}
+
+void tfx_encoder_submit_depth(tfx_encoder *enc, uint8_t id, tfx_program program, float depth, bool retain) {
+	tfx_encoder_submit_ordered(enc, id, program, depth_bits(depth), retain);
+}
+
+void tfx_encoder_submit_at(tfx_encoder *enc, uint8_t id, tfx_program program, const float *pos, bool retain) {
+	assert(pos != NULL);
+	memcpy(enc->tmp_draw.depth_pos, pos, sizeof(float) * 3);
+	enc->tmp_draw.depth_at = true;
+	tfx_encoder_submit(enc, id, program, retain);
+}
+
+static uint32_t draw_depth(tfx_view *view, tfx_draw *draw) {
+	if (!draw->depth_at) {
+		return draw->depth;
+	}
+	// view space looks down -z, so distance in front of the camera is -z.
+	const float *m = view->view;
+	const float *pos = draw->depth_pos;
+	float z = m[2] * pos[0] + m[6] * pos[1] + m[10] * pos[2] + m[14];
+	return depth_bits(-z);
+}
+
+void tfx_encoder_touch(tfx_encoder *enc, uint8_t id) {
+	encoder_reset(enc);
+	if (enc->bundle == NULL) {
+		sb_push(g_submit_frame->draws[enc->index][id], enc->tmp_draw);
+		if (g_capture.recording) {
+			sb_push(enc->capture_log, id);
+		}
 	}
+}
 
-	CHECK(tfx_glDeleteShader(vs));
-	CHECK(tfx_glDeleteShader(fs));
+void tfx_encoder_submit_bundle(tfx_encoder *enc, uint8_t id, tfx_bundle *bundle) {
+	assert(bundle != NULL);
+	assert(!bundle->encoder.active);
+	assert(enc->bundle == NULL);
 
-	sb_push(g_programs, program);
+	if (sb_count(bundle->draws) == 0) {
+		return;
+	}
 
-	return program;
+	// the bundle's draws are referenced rather than copied, only the
+	// uniforms set for the replay are recorded. the sticky ones are left out,
+	// or uniforms set for earlier draws would override the bundle's own.
+	uint64_t start = tfx_time_ns();
+	tfx_draw add_state;
+	memset(&add_state, 0, sizeof(tfx_draw));
+	add_state.bundle = bundle;
+	push_uniforms(enc, &add_state);
+	add_state.uniforms = NULL;
+	add_state.uniform_count = 0;
+	sb_push(g_submit_frame->draws[enc->index][id], add_state);
+	if (g_capture.recording) {
+		sb_push(enc->capture_log, id);
+	}
+	enc->submit_ns += tfx_time_ns() - start;
 }
 
-tfx_program tfx_program_cs_new(const char *css) {
-	if (!g_caps.compute) {
+static void bundle_clear(tfx_bundle *bundle) {
+	// the render thread may still be drawing it.
+	rt_wait_idle();
+
+	sb_free(bundle->draws);
+	bundle->draws = NULL;
+
+	int nc = sb_count(bundle->chunks);
+	for (int i = 0; i < nc; i++) {
+		free(bundle->chunks[i]);
+	}
+	sb_free(bundle->chunks);
+	bundle->chunks = NULL;
+}
+
+tfx_bundle *tfx_bundle_new() {
+	tfx_bundle *bundle = calloc(1, sizeof(tfx_bundle));
+	bundle->encoder.bundle = bundle;
+	return bundle;
+}
+
+void tfx_bundle_free(tfx_bundle *bundle) {
+	assert(bundle != NULL);
+	assert(!bundle->encoder.active);
+	bundle_clear(bundle);
+	free(bundle);
+}
+
+tfx_encoder *tfx_bundle_begin(tfx_bundle *bundle) {
+	assert(bundle != NULL);
+	tfx_encoder *enc = &bundle->encoder;
+	assert(!enc->active);
+	bundle_clear(bundle);
+	encoder_reset(enc);
+	enc->active = true;
+	return enc;
+}
+
+void tfx_bundle_end(tfx_bundle *bundle) {
+	assert(bundle != NULL);
+	tfx_encoder *enc = &bundle->encoder;
+	assert(enc->active);
+	encoder_free_uniforms(enc);
+	enc->ub_cursor = NULL;
+	enc->ub_end = NULL;
+	enc->active = false;
+}
+
+void tfx_set_uniform(tfx_uniform *uniform, const float *data, const int count) {
+	tfx_encoder_set_uniform(&g_encoders[0], uniform, data, count);
+}
+
+void tfx_set_uniform_int(tfx_uniform *uniform, const int *data, const int count) {
+	tfx_encoder_set_uniform_int(&g_encoders[0], uniform, data, count);
+}
+
+void tfx_set_callback(tfx_draw_callback cb) {
+	tfx_encoder_set_callback(&g_encoders[0], cb);
+}
+
+void tfx_set_scissor(uint16_t x, uint16_t y, uint16_t w, uint16_t h) {
+	tfx_encoder_set_scissor(&g_encoders[0], x, y, w, h);
+}
+
+void tfx_set_bounds_aabb(const float *min, const float *max) {
+	tfx_encoder_set_bounds_aabb(&g_encoders[0], min, max);
+}
+
+void tfx_set_bounds_sphere(const float *center, float radius) {
+	tfx_encoder_set_bounds_sphere(&g_encoders[0], center, radius);
+}
+
+void tfx_set_occlusion(tfx_occlusion occ) {
+	tfx_encoder_set_occlusion(&g_encoders[0], occ);
+}
+
+void tfx_set_texture(tfx_uniform *uniform, tfx_texture *tex, uint8_t slot) {
+	tfx_encoder_set_texture(&g_encoders[0], uniform, tex, slot);
+}
+
+void tfx_set_state(uint64_t flags) {
+	tfx_encoder_set_state(&g_encoders[0], flags);
+}
+
+void tfx_set_buffer(tfx_buffer *buf, uint8_t slot, bool write) {
+	tfx_encoder_set_buffer(&g_encoders[0], buf, slot, write);
+}
+
+void tfx_set_transient_buffer(tfx_transient_buffer tb) {
+	tfx_encoder_set_transient_buffer(&g_encoders[0], tb);
+}
+
+void tfx_set_vertices(tfx_buffer *vbo, int count) {
+	tfx_encoder_set_vertices(&g_encoders[0], vbo, count);
+}
+
+void tfx_set_indices(tfx_buffer *ibo, int count) {
+	tfx_encoder_set_indices(&g_encoders[0], ibo, count);
+}
+
+void tfx_set_instance_data(tfx_buffer *buf, uint32_t count) {
+	tfx_encoder_set_instance_data(&g_encoders[0], buf, count);
+}
+
+void tfx_set_transient_instance_data(tfx_transient_buffer tb) {
+	tfx_encoder_set_transient_instance_data(&g_encoders[0], tb);
+}
+
+void tfx_set_instance_count(uint32_t count) {
+	tfx_encoder_set_instance_count(&g_encoders[0], count);
+}
+
+void tfx_dispatch(uint8_t id, tfx_program program, uint32_t x, uint32_t y, uint32_t z) {
+	tfx_encoder_dispatch(&g_encoders[0], id, program, x, y, z);
+}
+
+void tfx_submit(uint8_t id, tfx_program program, bool retain) {
+	tfx_encoder_submit(&g_encoders[0], id, program, retain);
+}
+
+void tfx_submit_ordered(uint8_t id, tfx_program program, uint32_t depth, bool retain) {
+	tfx_encoder_submit_ordered(&g_encoders[0], id, program, depth, retain);
+}
+
+void tfx_submit_depth(uint8_t id, tfx_program program, float depth, bool retain) {
+	tfx_encoder_submit_depth(&g_encoders[0], id, program, depth, retain);
+}
+
+void tfx_submit_at(uint8_t id, tfx_program program, const float *pos, bool retain) {
+	tfx_encoder_submit_at(&g_encoders[0], id, program, pos, retain);
+}
+
+void tfx_touch(uint8_t id) {
+	tfx_encoder_touch(&g_encoders[0], id);
+}
+
+void tfx_submit_bundle(uint8_t id, tfx_bundle *bundle) {
+	tfx_encoder_submit_bundle(&g_encoders[0], id, bundle);
+}
+
+void tfx_submit_indirect(uint8_t id, tfx_program program, tfx_buffer *commands, uint32_t offset, uint32_t count, bool retain) {
+	tfx_encoder_submit_indirect(&g_encoders[0], id, program, commands, offset, count, retain);
+}
+
+static tfx_canvas *get_canvas(tfx_view *view) {
+	assert(view != NULL);
+	if (view->has_canvas) {
+		return &view->canvas;
+	}
+	return &g_backbuffer;
+}
+
+void tfx_blit(uint8_t dst, uint8_t src, uint16_t x, uint16_t y, uint16_t w, uint16_t h) {
+	tfx_rect rect;
+	rect.x = x;
+	rect.y = y;
+	rect.w = w;
+	rect.h = h;
+
+	tfx_blit_op blit;
+	blit.source = get_canvas(&g_views[src]);
+	blit.rect = rect;
+
+	// this would cause a GL error and doesn't make sense.
+	assert(blit.source != get_canvas(&g_views[dst]));
+
+	tfx_view *view = &g_views[dst];
+	sb_push(view->blits, blit);
+}
+
+// fold the bound textures down to a few bits, so that draws sharing a
+// texture set end up next to each other.
+static uint32_t texture_bits(tfx_draw *draw) {
+	uint32_t hash = 0;
+	for (int i = 0; i < 8; i++) {
+		tfx_texture *tex = &draw->textures[i];
+		hash = hash * 31 + tex->gl_ids[tex->gl_idx];
+	}
+	return hash ^ (hash >> 16);
+}
+
+#define TFX_KEY_BITS(v, bits) ((uint64_t)(v) & ((1ull << (bits)) - 1))
+
+// key layouts, msb to lsb:
+// state: program(16) flags(13) textures(12) vbo(11) depth(12)
+// depth: depth(24) program(16) flags(13) textures(11)
+static uint64_t make_sort_key(tfx_view *view, tfx_draw *draw, tfx_sort_mode mode) {
+	uint32_t depth = draw_depth(view, draw);
+	uint64_t program = TFX_KEY_BITS(draw->program, 16);
+	uint64_t flags = TFX_KEY_BITS(draw->flags, 13);
+	uint64_t textures = texture_bits(draw);
+	switch (mode) {
+		case TFX_SORT_STATE: {
+			return 0
+				| (program << 48)
+				| (flags << 35)
+				| (TFX_KEY_BITS(textures, 12) << 23)
+				| (TFX_KEY_BITS(draw->vbo.gl_id, 11) << 12)
+				| TFX_KEY_BITS(depth >> 20, 12)
+			;
+		}
+		case TFX_SORT_FRONT_TO_BACK:
+		case TFX_SORT_BACK_TO_FRONT: {
+			if (mode == TFX_SORT_BACK_TO_FRONT) {
+				depth = ~depth;
+			}
+			return 0
+				| (TFX_KEY_BITS(depth >> 8, 24) << 40)
+				| (program << 24)
+				| (flags << 11)
+				| TFX_KEY_BITS(textures, 11)
+			;
+		}
+		default: assert(false); break;
+	}
+	return 0;
+}
+
+#undef TFX_KEY_BITS
+
+#define TFX_RADIX_BITS 11
+#define TFX_RADIX_SIZE (1 << TFX_RADIX_BITS)
+#define TFX_RADIX_MASK (TFX_RADIX_SIZE - 1)
+
+// stable LSD radix sort of keys + values. passes where every key shares the
+// same digit are skipped, which is most of them for typical scenes.
+static void radix_sort64(uint64_t *keys, uint64_t *tmp_keys, uint32_t *values, uint32_t *tmp_values, uint32_t count) {
+	static uint32_t histogram[TFX_RADIX_SIZE];
+
+	uint64_t *src_keys = keys, *dst_keys = tmp_keys;
+	uint32_t *src_values = values, *dst_values = tmp_values;
+
+	for (uint32_t shift = 0; shift < 64; shift += TFX_RADIX_BITS) {
+		memset(histogram, 0, sizeof(histogram));
+		for (uint32_t i = 0; i < count; i++) {
+			histogram[(src_keys[i] >> shift) & TFX_RADIX_MASK]++;
+		}
+
+		uint32_t first = (src_keys[0] >> shift) & TFX_RADIX_MASK;
+		if (histogram[first] == count) {
+			continue;
+		}
+
+		uint32_t offset = 0;
+		for (uint32_t i = 0; i < TFX_RADIX_SIZE; i++) {
+			uint32_t n = histogram[i];
+			histogram[i] = offset;
+			offset += n;
+		}
+
+		for (uint32_t i = 0; i < count; i++) {
+			uint32_t dst = histogram[(src_keys[i] >> shift) & TFX_RADIX_MASK]++;
+			dst_keys[dst] = src_keys[i];
+			dst_values[dst] = src_values[i];
+		}
+
+		uint64_t *swap_keys = src_keys;
+		src_keys = dst_keys;
+		dst_keys = swap_keys;
+
+		uint32_t *swap_values = src_values;
+		src_values = dst_values;
+		dst_values = swap_values;
+	}
+
+	if (src_keys != keys) {
+		memcpy(keys, src_keys, sizeof(uint64_t) * count);
+		memcpy(values, src_values, sizeof(uint32_t) * count);
+	}
+}
+
+#undef TFX_RADIX_BITS
+#undef TFX_RADIX_SIZE
+#undef TFX_RADIX_MASK
+
+// returns the order to submit the view's draws in.
+static uint32_t *sort_view(tfx_view *view, tfx_draw_ref *draws, int nd) {
+	if (sb_count(g_sort_values) < nd) {
+		int grow = nd - sb_count(g_sort_values);
+		sb_add(g_sort_keys, grow);
+		sb_add(g_sort_tmp_keys, grow);
+		sb_add(g_sort_values, grow);
+		sb_add(g_sort_tmp_values, grow);
+	}
+
+	for (int i = 0; i < nd; i++) {
+		g_sort_values[i] = (uint32_t)i;
+	}
+
+	if (view->sort_mode == TFX_SORT_SEQUENTIAL || nd < 2) {
+		return g_sort_values;
+	}
+
+	for (int i = 0; i < nd; i++) {
+		g_sort_keys[i] = make_sort_key(view, draws[i].draw, view->sort_mode);
+	}
+	radix_sort64(g_sort_keys, g_sort_tmp_keys, g_sort_values, g_sort_tmp_values, (uint32_t)nd);
+
+	return g_sort_values;
+}
+
+static void upload_uniform_list(tfx_program_data *prog, tfx_uniform *uniforms, uint32_t nu, tfx_stats *stats) {
+	uint32_t nl = (uint32_t)sb_count(prog->locations);
+	for (uint32_t j = 0; j < nu; j++) {
+		tfx_uniform uniform = uniforms[j];
+
+		GLint loc = uniform.id < nl ? prog->locations[uniform.id] : -1;
+		if (loc < 0) {
+			continue;
+		}
+
+		tfx_uniform_shadow *shadow = &prog->shadows[uniform.id];
+		uint32_t size = (uint32_t)(uniform.last_count * uniform_size_for(uniform.type));
+		if (size <= shadow->capacity) {
+			uint8_t *last = prog->shadow_data + shadow->offset;
+			if (size == shadow->size && memcmp(last, uniform.data, size) == 0) {
+				stats->uniforms_skipped += 1;
+				continue;
+			}
+			memcpy(last, uniform.data, size);
+			shadow->size = size;
+		}
+		else {
+			// too big to shadow, so the next upload can't be compared.
+			shadow->size = 0;
+		}
+		stats->uniforms += 1;
+		stats->uniform_bytes += size;
+		switch (uniform.type) {
+			case TFX_UNIFORM_INT:   CHECK(tfx_glUniform1iv(loc, uniform.last_count, uniform.idata)); break;
+			case TFX_UNIFORM_FLOAT: CHECK(tfx_glUniform1fv(loc, uniform.last_count, uniform.fdata)); break;
+			case TFX_UNIFORM_VEC2:  CHECK(tfx_glUniform2fv(loc, uniform.last_count, uniform.fdata)); break;
+			case TFX_UNIFORM_VEC3:  CHECK(tfx_glUniform3fv(loc, uniform.last_count, uniform.fdata)); break;
+			case TFX_UNIFORM_VEC4:  CHECK(tfx_glUniform4fv(loc, uniform.last_count, uniform.fdata)); break;
+			case TFX_UNIFORM_MAT2:  CHECK(tfx_glUniformMatrix2fv(loc, uniform.last_count, 0, uniform.fdata)); break;
+			case TFX_UNIFORM_MAT3:  CHECK(tfx_glUniformMatrix3fv(loc, uniform.last_count, 0, uniform.fdata)); break;
+			case TFX_UNIFORM_MAT4:  CHECK(tfx_glUniformMatrix4fv(loc, uniform.last_count, 0, uniform.fdata)); break;
+			default: assert(false); break;
+		}
+	}
+}
+
+static void upload_uniforms(tfx_program program, tfx_draw *draw, tfx_stats *stats) {
+	if (program == 0) {
+		return;
+	}
+	tfx_program_data *prog = &g_programs[program - 1];
+	upload_uniform_list(prog, draw->uniforms, draw->uniform_count, stats);
+	upload_uniform_list(prog, draw->draw_uniforms, draw->draw_uniform_count, stats);
+}
+
+// proj * view, column-major.
+static void view_clip(tfx_view *view, float m[16]) {
+	const float *p = view->proj_left;
+	const float *v = view->view;
+	for (int c = 0; c < 4; c++) {
+		for (int r = 0; r < 4; r++) {
+			m[c*4+r] = p[r] * v[c*4] + p[4+r] * v[c*4+1] + p[8+r] * v[c*4+2] + p[12+r] * v[c*4+3];
+		}
+	}
+}
+
+// normalized planes (nx, ny, nz, d) of a clip matrix, pointing inwards:
+// left, right, bottom, top, near, far.
+static void frustum_planes(const float m[16], float planes[6][4]) {
+	for (int i = 0; i < 6; i++) {
+		int row = i / 2;
+		float sign = (i & 1) ? -1.0f : 1.0f;
+		float len = 0.0f;
+		for (int c = 0; c < 4; c++) {
+			planes[i][c] = m[c*4+3] + sign * m[c*4+row];
+			if (c < 3) {
+				len += planes[i][c] * planes[i][c];
+			}
+		}
+		len = len > 0.0f ? 1.0f / sqrtf(len) : 0.0f;
+		for (int c = 0; c < 4; c++) {
+			planes[i][c] *= len;
+		}
+	}
+}
+
+// sets visible[i] for the n bounds in soa (stride floats per component). a
+// bound is outside when, for any plane, its center distance plus its
+// projected box extent and radius is still negative.
+static void cull_bounds(const float *soa, int stride, int n, float planes[6][4], uint8_t *visible) {
+	const float *cx = soa, *cy = soa + stride, *cz = soa + stride*2;
+	const float *ex = soa + stride*3, *ey = soa + stride*4, *ez = soa + stride*5;
+	const float *r = soa + stride*6;
+#if defined(TFX_CULL_SSE)
+	for (int i = 0; i < n; i += 4) {
+		__m128 x = _mm_loadu_ps(cx + i), y = _mm_loadu_ps(cy + i), z = _mm_loadu_ps(cz + i);
+		__m128 hx = _mm_loadu_ps(ex + i), hy = _mm_loadu_ps(ey + i), hz = _mm_loadu_ps(ez + i);
+		__m128 rad = _mm_loadu_ps(r + i);
+		__m128 out = _mm_setzero_ps();
+		for (int p = 0; p < 6; p++) {
+			const float *pl = planes[p];
+			__m128 d = _mm_add_ps(_mm_set1_ps(pl[3]), rad);
+			d = _mm_add_ps(d, _mm_mul_ps(x, _mm_set1_ps(pl[0])));
+			d = _mm_add_ps(d, _mm_mul_ps(y, _mm_set1_ps(pl[1])));
+			d = _mm_add_ps(d, _mm_mul_ps(z, _mm_set1_ps(pl[2])));
+			d = _mm_add_ps(d, _mm_mul_ps(hx, _mm_set1_ps(fabsf(pl[0]))));
+			d = _mm_add_ps(d, _mm_mul_ps(hy, _mm_set1_ps(fabsf(pl[1]))));
+			d = _mm_add_ps(d, _mm_mul_ps(hz, _mm_set1_ps(fabsf(pl[2]))));
+			out = _mm_or_ps(out, _mm_cmplt_ps(d, _mm_setzero_ps()));
+		}
+		int mask = _mm_movemask_ps(out);
+		for (int j = 0; j < 4; j++) {
+			visible[i+j] = !(mask & (1 << j));
+		}
+	}
+#elif defined(TFX_CULL_NEON)
+	for (int i = 0; i < n; i += 4) {
+		float32x4_t x = vld1q_f32(cx + i), y = vld1q_f32(cy + i), z = vld1q_f32(cz + i);
+		float32x4_t hx = vld1q_f32(ex + i), hy = vld1q_f32(ey + i), hz = vld1q_f32(ez + i);
+		float32x4_t rad = vld1q_f32(r + i);
+		uint32x4_t out = vdupq_n_u32(0);
+		for (int p = 0; p < 6; p++) {
+			const float *pl = planes[p];
+			float32x4_t d = vaddq_f32(vdupq_n_f32(pl[3]), rad);
+			d = vmlaq_n_f32(d, x, pl[0]);
+			d = vmlaq_n_f32(d, y, pl[1]);
+			d = vmlaq_n_f32(d, z, pl[2]);
+			d = vmlaq_n_f32(d, hx, fabsf(pl[0]));
+			d = vmlaq_n_f32(d, hy, fabsf(pl[1]));
+			d = vmlaq_n_f32(d, hz, fabsf(pl[2]));
+			out = vorrq_u32(out, vcltq_f32(d, vdupq_n_f32(0.0f)));
+		}
+		visible[i+0] = vgetq_lane_u32(out, 0) == 0;
+		visible[i+1] = vgetq_lane_u32(out, 1) == 0;
+		visible[i+2] = vgetq_lane_u32(out, 2) == 0;
+		visible[i+3] = vgetq_lane_u32(out, 3) == 0;
+	}
+#else
+	for (int i = 0; i < n; i++) {
+		bool out = false;
+		for (int p = 0; p < 6 && !out; p++) {
+			const float *pl = planes[p];
+			float d = pl[3] + r[i]
+				+ cx[i] * pl[0] + cy[i] * pl[1] + cz[i] * pl[2]
+				+ ex[i] * fabsf(pl[0]) + ey[i] * fabsf(pl[1]) + ez[i] * fabsf(pl[2]);
+			out = d < 0.0f;
+		}
+		visible[i] = !out;
+	}
+#endif
+}
+
+// drop draws whose bounds are outside the view's frustum, compacting the
+// list in place. returns the number dropped.
+static int cull_view(tfx_view *view, tfx_draw_ref *draws, int nd) {
+	if (!(view->flags & TFX_VIEW_FRUSTUM) || (view->flags & TFX_VIEW_NO_CULL) || nd == 0) {
 		return 0;
 	}
 
-	GLuint cs = load_shader(GL_COMPUTE_SHADER, css);
-	GLuint program = CHECK(tfx_glCreateProgram());
-	if (!program) {
+	int stride = (nd + 3) & ~3;
+	sb_reset(g_cull_soa);
+	sb_reset(g_cull_visible);
+	float *soa = sb_add(g_cull_soa, stride * 7);
+	uint8_t *visible = sb_add(g_cull_visible, stride);
+
+	int n = 0;
+	for (int i = 0; i < nd; i++) {
+		tfx_draw *draw = draws[i].draw;
+		if (!draw->use_bounds) {
+			continue;
+		}
+		for (int c = 0; c < 7; c++) {
+			soa[c*stride+n] = draw->bounds[c];
+		}
+		n++;
+	}
+	if (n == 0) {
 		return 0;
 	}
-	CHECK(tfx_glAttachShader(program, cs));
-	CHECK(tfx_glLinkProgram(program));
+	// pad the last group of four with something harmless
+	for (int i = n; i < ((n + 3) & ~3); i++) {
+		for (int c = 0; c < 7; c++) {
+			soa[c*stride+i] = 0.0f;
+		}
+	}
 
-	GLint linked;
-	CHECK(tfx_glGetProgramiv(program, GL_LINK_STATUS, &linked));
-	if (!linked) {
-		GLint infoLen = 0;
-		CHECK(tfx_glGetProgramiv(program, GL_INFO_LOG_LENGTH, &infoLen));
-		if (infoLen > 0) {
-			char* infoLog = (char*)malloc(infoLen);
-			CHECK(tfx_glGetProgramInfoLog(program, infoLen, NULL, infoLog));
-			TFX_ERROR("Error linking program:\n%s", infoLog);
-			free(infoLog);
+	float clip[16];
+	float planes[6][4];
+	view_clip(view, clip);
+	frustum_planes(clip, planes);
+	cull_bounds(soa, stride, n, planes, visible);
+
+	int kept = 0;
+	int b = 0;
+	for (int i = 0; i < nd; i++) {
+		if (draws[i].draw->use_bounds && !visible[b++]) {
+			continue;
+		}
+		draws[kept++] = draws[i];
+	}
+	return nd - kept;
+}
+
+// append every encoder's recording for a view, in encoder order, expanding
+// bundles in place.
+static int gather_draws(tfx_frame_data *frame, uint8_t id, bool jobs, tfx_draw_ref **out) {
+	int first = sb_count(*out);
+	for (uint32_t e = 0; e < frame->encoder_count; e++) {
+		tfx_draw *list = jobs ? frame->jobs[e][id] : frame->draws[e][id];
+		int n = sb_count(list);
+		for (int i = 0; i < n; i++) {
+			tfx_draw_ref ref;
+			tfx_bundle *bundle = list[i].bundle;
+			if (bundle == NULL) {
+				ref.draw = &list[i];
+				ref.patch = NULL;
+				ref.batch = 0;
+				ref.command = 0;
+				sb_push(*out, ref);
+				continue;
+			}
+			ref.patch = &list[i];
+			ref.batch = 0;
+			ref.command = 0;
+			int nb = sb_count(bundle->draws);
+			for (int j = 0; j < nb; j++) {
+				ref.draw = &bundle->draws[j];
+				sb_push(*out, ref);
+			}
+		}
+	}
+	return sb_count(*out) - first;
+}
+
+// gather every view's visible draws and put them in execution order.
+// returns the number of draws culled.
+static uint32_t gather_frame(tfx_frame_data *frame) {
+	uint32_t culled = 0;
+	sb_reset(g_frame_draws);
+	sb_reset(g_frame_jobs);
+	for (int id = 0; id < VIEW_MAX; id++) {
+		tfx_view_range *range = &g_view_ranges[id];
+		range->first_job = sb_count(g_frame_jobs);
+		range->jobs = gather_draws(frame, id, true, &g_frame_jobs);
+		range->first_draw = sb_count(g_frame_draws);
+		range->draws = gather_draws(frame, id, false, &g_frame_draws);
+
+		if (range->draws > 0) {
+			int dropped = cull_view(&frame->views[id], &g_frame_draws[range->first_draw], range->draws);
+			sb_pop(g_frame_draws, dropped);
+			range->draws -= dropped;
+			culled += dropped;
+		}
+
+		int nd = range->draws;
+		if (nd < 2) {
+			continue;
+		}
+		tfx_draw_ref *draws = &g_frame_draws[range->first_draw];
+		uint32_t *order = sort_view(&frame->views[id], draws, nd);
+		sb_reset(g_sort_refs);
+		tfx_draw_ref *tmp = sb_add(g_sort_refs, nd);
+		memcpy(tmp, draws, nd * sizeof(tfx_draw_ref));
+		for (int i = 0; i < nd; i++) {
+			draws[i] = tmp[order[i]];
 		}
-		CHECK(tfx_glDeleteProgram(program));
-		return 0;
 	}
-	CHECK(tfx_glDeleteShader(cs));
+	return culled;
+}
 
-	sb_push(g_programs, program);
+// copy a block member's value into the block, true if anything changed.
+static bool block_write(tfx_uniform_block *ub, tfx_uniform *uniform) {
+	uint32_t columns, column_size;
+	std140_element(uniform->type, &columns, &column_size);
+	uint32_t stride = std140_stride(uniform->type, uniform->count);
+
+	bool changed = false;
+	uint8_t *dst = ub->image + uniform->block_offset;
+	uint8_t *src = uniform->data;
+	// setting more elements than were declared would spill into the next
+	// member, or past the end of the block.
+	int count = uniform->last_count < uniform->count ? uniform->last_count : uniform->count;
+	uint32_t n = columns * (uint32_t)(count > 0 ? count : 0);
+	for (uint32_t i = 0; i < n; i++) {
+		if (memcmp(dst, src, column_size) != 0) {
+			memcpy(dst, src, column_size);
+			changed = true;
+		}
+		dst += stride;
+		src += column_size;
+	}
+	return changed;
+}
 
-	return program;
+static bool block_apply(int b, tfx_uniform *uniforms, uint32_t count) {
+	bool changed = false;
+	for (uint32_t i = 0; i < count; i++) {
+		if (uniforms[i].block == (uint32_t)b + 1) {
+			changed |= block_write(&g_blocks[b], &uniforms[i]);
+		}
+	}
+	return changed;
 }
 
-tfx_vertex_format tfx_vertex_format_start() {
-	tfx_vertex_format fmt;
-	memset(&fmt, 0, sizeof(tfx_vertex_format));
+// bring the blocks used by a draw up to date, packing a new copy into the
+// frame's buffer only when something changed since the last one.
+static void pack_blocks(tfx_draw_ref *ref) {
+	tfx_draw *draw = ref->draw;
+	if (draw->program == 0) {
+		return;
+	}
+	uint32_t mask = g_programs[draw->program - 1].block_mask;
+	for (int b = 0; b < g_block_count; b++) {
+		if ((mask & (1u << b)) == 0) {
+			continue;
+		}
+		tfx_uniform_block *ub = &g_blocks[b];
+		uint32_t size = (ub->size + 15) & ~15u;
+		if (ub->image_size < size) {
+			ub->image = realloc(ub->image, size);
+			memset(ub->image + ub->image_size, 0, size - ub->image_size);
+			ub->image_size = size;
+			ub->packed = false;
+		}
 
-	return fmt;
+		bool changed = !ub->packed;
+		changed |= block_apply(b, draw->uniforms, draw->uniform_count);
+		changed |= block_apply(b, draw->draw_uniforms, draw->draw_uniform_count);
+		if (ref->patch) {
+			changed |= block_apply(b, ref->patch->uniforms, ref->patch->uniform_count);
+			changed |= block_apply(b, ref->patch->draw_uniforms, ref->patch->draw_uniform_count);
+		}
+
+		if (changed) {
+			uint32_t align = g_block_buffer.align;
+			uint32_t offset = ((uint32_t)sb_count(g_block_buffer.staging) + align - 1) / align * align;
+			sb_add(g_block_buffer.staging, (int)(offset + size) - sb_count(g_block_buffer.staging));
+			memcpy(g_block_buffer.staging + offset, ub->image, size);
+			ub->packed_offset = offset;
+			ub->packed = true;
+		}
+		ref->block_offsets[b] = ub->packed_offset;
+	}
 }
 
-void tfx_vertex_format_add(tfx_vertex_format *fmt, uint8_t slot, size_t count, bool normalized, tfx_component_type type) {
-	assert(type >= 0 && type <= TFX_TYPE_SKIP);
+// returns the bytes uploaded.
+static uint32_t upload_blocks() {
+	if (!g_caps.uniform_buffers || g_block_count == 0) {
+		return 0;
+	}
 
-	if (slot >= fmt->count) {
-		fmt->count = slot + 1;
+	sb_reset(g_block_buffer.staging);
+	for (int b = 0; b < g_block_count; b++) {
+		g_blocks[b].packed = false;
 	}
-	tfx_vertex_component *component = &fmt->components[slot];
-	memset(component, 0, sizeof(tfx_vertex_component));
-	component->offset = 0;
-	component->size = count;
-	component->normalized = normalized;
-	component->type = type;
 
-	fmt->component_mask |= 1 << slot;
-}
+	int nj = sb_count(g_frame_jobs);
+	for (int i = 0; i < nj; i++) {
+		pack_blocks(&g_frame_jobs[i]);
+	}
+	int nd = sb_count(g_frame_draws);
+	for (int i = 0; i < nd; i++) {
+		pack_blocks(&g_frame_draws[i]);
+	}
 
-size_t tfx_vertex_format_offset(tfx_vertex_format *fmt, uint8_t slot) {
-	assert(slot < 8);
-	return fmt->components[slot].offset;
+	uint32_t size = (uint32_t)sb_count(g_block_buffer.staging);
+	if (size == 0) {
+		return 0;
+	}
+	gl_bind_buffer(TFX_GL_UNIFORM_BUFFER, g_block_buffer.gl_id);
+	if (size > g_block_buffer.capacity) {
+		g_block_buffer.capacity = size + size / 4;
+	}
+	// orphan last frame's storage instead of waiting for the GPU to finish with it
+	CHECK(tfx_glBufferData(GL_UNIFORM_BUFFER, g_block_buffer.capacity, NULL, GL_STREAM_DRAW));
+	CHECK(tfx_glBufferSubData(GL_UNIFORM_BUFFER, 0, size, g_block_buffer.staging));
+	return size;
 }
 
-void tfx_vertex_format_end(tfx_vertex_format *fmt) {
-	size_t stride = 0;
-	int nc = fmt->count;
-	for (int i = 0; i < nc; i++) {
-		tfx_vertex_component *vc = &fmt->components[i];
-		size_t bytes = 0;
-		switch (vc->type) {
-			case TFX_TYPE_SKIP:
-			case TFX_TYPE_UBYTE:
-			case TFX_TYPE_BYTE: bytes = 1; break;
-			case TFX_TYPE_USHORT:
-			case TFX_TYPE_SHORT: bytes = 2; break;
-			case TFX_TYPE_FLOAT: bytes = 4; break;
-			default: assert(false); break;
+// bind the block ranges a draw packed, if they aren't already.
+static void bind_blocks(tfx_draw_ref *ref, uint32_t *bound) {
+	if (g_block_count == 0 || !g_caps.uniform_buffers || ref->draw->program == 0) {
+		return;
+	}
+	uint32_t mask = g_programs[ref->draw->program - 1].block_mask;
+	for (int b = 0; b < g_block_count; b++) {
+		if ((mask & (1u << b)) == 0 || bound[b] == ref->block_offsets[b]) {
+			continue;
 		}
-		vc->offset = stride;
-		stride += vc->size * bytes;
+		uint32_t size = (g_blocks[b].size + 15) & ~15u;
+		CHECK(tfx_glBindBufferRange(GL_UNIFORM_BUFFER, b, g_block_buffer.gl_id, ref->block_offsets[b], size));
+		g_gl.buffers[TFX_GL_UNIFORM_BUFFER] = g_block_buffer.gl_id;
+		bound[b] = ref->block_offsets[b];
 	}
-	fmt->stride = stride;
 }
 
-tfx_buffer tfx_buffer_new(void *data, size_t size, tfx_vertex_format *format, tfx_buffer_usage usage) {
-	GLenum gl_usage = GL_STATIC_DRAW;
-	switch (usage) {
-		case TFX_USAGE_STATIC:  gl_usage = GL_STATIC_DRAW; break;
-		case TFX_USAGE_DYNAMIC: gl_usage = GL_DYNAMIC_DRAW; break;
-		case TFX_USAGE_STREAM:  gl_usage = GL_STREAM_DRAW; break;
-		default: assert(false); break;
+static void release_compiler() {
+	if (!g_shaderc_allocated) {
+		return;
 	}
 
-	tfx_buffer buffer;
-	memset(&buffer, 0, sizeof(tfx_buffer));
-	buffer.gl_id = 0;
-	if (format) {
-		assert(format->stride > 0);
+	int release_shader_c = 0;
+	CHECK(tfx_glGetIntegerv(GL_SHADER_COMPILER, &release_shader_c));
 
-		buffer.has_format = true;
-		buffer.format = *format;
+	if (release_shader_c) {
+		CHECK(tfx_glReleaseShaderCompiler());
 	}
 
-	CHECK(tfx_glGenBuffers(1, &buffer.gl_id));
-	CHECK(tfx_glBindBuffer(GL_ARRAY_BUFFER, buffer.gl_id));
+	g_shaderc_allocated = false;
+}
 
-	if (size != 0) {
-		CHECK(tfx_glBufferData(GL_ARRAY_BUFFER, size, data, gl_usage));
+// draws with the same program, state, buffers and uniforms only differ in
+// their ranges, so they can be merged into one multi-draw.
+static bool batch_compatible(tfx_draw_ref *a, tfx_draw_ref *b) {
+	tfx_draw *da = a->draw;
+	tfx_draw *db = b->draw;
+	if (da->program != db->program || da->flags != db->flags || a->patch != b->patch) {
+		return false;
+	}
+	if (!db->use_vbo || db->callback || db->indirect.gl_id || db->vbo.dirty || db->occlusion) {
+		return false;
+	}
+	if (da->vbo.gl_id != db->vbo.gl_id || da->use_tvb != db->use_tvb) {
+		return false;
+	}
+	tfx_vertex_format *fa = da->use_tvb ? &da->tvb_fmt : &da->vbo.format;
+	tfx_vertex_format *fb = db->use_tvb ? &db->tvb_fmt : &db->vbo.format;
+	if (memcmp(fa, fb, sizeof(tfx_vertex_format)) != 0) {
+		return false;
 	}
+	// transient vertices are reached through the base vertex
+	if (da->use_tvb && da->offset % fa->stride != db->offset % fb->stride) {
+		return false;
+	}
+	if (da->use_ibo != db->use_ibo || (da->use_ibo && (da->ibo.gl_id != db->ibo.gl_id || da->ibo_32bit != db->ibo_32bit || db->ibo.dirty))) {
+		return false;
+	}
+	if (da->use_instance_vbo != db->use_instance_vbo) {
+		return false;
+	}
+	if (da->use_instance_vbo) {
+		if (da->instance_vbo.gl_id != db->instance_vbo.gl_id || da->instance_offset != db->instance_offset || db->instance_vbo.dirty) {
+			return false;
+		}
+		if (memcmp(&da->instance_vbo.format, &db->instance_vbo.format, sizeof(tfx_vertex_format)) != 0) {
+			return false;
+		}
+	}
+	if (da->use_scissor != db->use_scissor) {
+		return false;
+	}
+	if (da->use_scissor && memcmp(&da->scissor_rect, &db->scissor_rect, sizeof(tfx_rect)) != 0) {
+		return false;
+	}
+	for (int i = 0; i < 8; i++) {
+		tfx_texture *ta = &da->textures[i];
+		tfx_texture *tb = &db->textures[i];
+		if (ta->gl_ids[ta->gl_idx] != tb->gl_ids[tb->gl_idx]) {
+			return false;
+		}
+	}
+	uint32_t mask = da->program ? g_programs[da->program - 1].block_mask : 0;
+	for (int i = 0; i < g_block_count; i++) {
+		if ((mask & (1u << i)) && a->block_offsets[i] != b->block_offsets[i]) {
+			return false;
+		}
+	}
+	// the sticky list is shared until a uniform is dropped, so only what was
+	// set since the last draw needs comparing.
+	if (da->uniforms != db->uniforms || da->uniform_count != db->uniform_count) {
+		return false;
+	}
+	if (da->draw_uniform_count != db->draw_uniform_count) {
+		return false;
+	}
+	for (uint32_t i = 0; i < da->draw_uniform_count; i++) {
+		tfx_uniform *ua = &da->draw_uniforms[i];
+		tfx_uniform *ub = &db->draw_uniforms[i];
+		if (ua->id != ub->id || ua->last_count != ub->last_count) {
+			return false;
+		}
+		size_t size = ua->last_count * uniform_size_for(ua->type);
+		if (memcmp(ua->data, ub->data, size) != 0) {
+			return false;
+		}
+	}
+	return true;
+}
 
-	return buffer;
+static uint32_t draw_base_vertex(tfx_draw *draw, uint32_t *attrib_offset);
+
+static void batch_command(tfx_draw_ref *ref) {
+	tfx_draw *draw = ref->draw;
+	tfx_indirect_command cmd;
+	memset(&cmd, 0, sizeof(tfx_indirect_command));
+	cmd.count = draw->indices;
+	cmd.instances = draw->instances > 0 ? draw->instances : 1;
+	uint32_t attrib_offset;
+	uint32_t base = draw_base_vertex(draw, &attrib_offset);
+	if (draw->use_ibo) {
+		cmd.first = (uint32_t)(draw->ibo_offset / (draw->ibo_32bit ? 4 : 2));
+		cmd.base_vertex = (int32_t)base;
+	}
+	else {
+		cmd.first = base;
+	}
+	sb_push(g_indirect_buffer.commands, cmd);
 }
 
-typedef struct tfx_texture_params {
-	GLenum format;
-	GLenum internal_format;
-	GLenum type;
-	void *update_data;
-} tfx_texture_params;
+// find runs of mergeable draws in each view and upload their commands.
+static void build_batches() {
+	if (!g_caps.multi_draw_indirect || !tfx_glMultiDrawElementsIndirect) {
+		return;
+	}
+	sb_reset(g_indirect_buffer.commands);
+	for (int id = 0; id < VIEW_MAX; id++) {
+		tfx_view_range range = g_view_ranges[id];
+		tfx_draw_ref *draws = &g_frame_draws[range.first_draw];
+		int i = 0;
+		while (i < range.draws) {
+			tfx_draw_ref *first = &draws[i];
+			int n = 1;
+			if (first->draw->use_vbo && !first->draw->callback && !first->draw->indirect.gl_id && !first->draw->occlusion) {
+				while (i + n < range.draws && batch_compatible(first, &draws[i + n])) {
+					n++;
+				}
+			}
+			if (n > 1) {
+				first->batch = n;
+				first->command = (uint32_t)sb_count(g_indirect_buffer.commands);
+				for (int j = 0; j < n; j++) {
+					batch_command(&draws[i + j]);
+				}
+			}
+			i += n;
+		}
+	}
 
-tfx_texture tfx_texture_new(uint16_t w, uint16_t h, void *data, tfx_format format, uint16_t flags) {
-	tfx_texture t;
-	memset(&t, 0, sizeof(tfx_texture));
+	uint32_t size = (uint32_t)(sb_count(g_indirect_buffer.commands) * sizeof(tfx_indirect_command));
+	if (size == 0) {
+		return;
+	}
+	if (!g_indirect_buffer.gl_id) {
+		CHECK(tfx_glGenBuffers(1, &g_indirect_buffer.gl_id));
+	}
+	gl_bind_buffer(TFX_GL_DRAW_INDIRECT_BUFFER, g_indirect_buffer.gl_id);
+	if (size > g_indirect_buffer.capacity) {
+		g_indirect_buffer.capacity = size + size / 4;
+	}
+	CHECK(tfx_glBufferData(GL_DRAW_INDIRECT_BUFFER, g_indirect_buffer.capacity, NULL, GL_STREAM_DRAW));
+	CHECK(tfx_glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, size, g_indirect_buffer.commands));
+}
 
-	t.width = w;
-	t.height = h;
-	t.format = format;
-	t.flags = flags;
+// issue indirect commands from the bound GL_DRAW_INDIRECT_BUFFER, one by one
+// when multi-draw isn't available.
+static void multi_draw_indirect(GLenum mode, bool indexed, GLenum index_type, size_t offset, uint32_t count, uint32_t stride) {
+	if (indexed) {
+		if (tfx_glMultiDrawElementsIndirect) {
+			CHECK(tfx_glMultiDrawElementsIndirect(mode, index_type, (GLvoid*)offset, (GLsizei)count, (GLsizei)stride));
+			return;
+		}
+		assert(tfx_glDrawElementsIndirect != NULL);
+		stride = stride ? stride : 5 * sizeof(uint32_t);
+		for (uint32_t i = 0; i < count; i++) {
+			CHECK(tfx_glDrawElementsIndirect(mode, index_type, (GLvoid*)(offset + i * stride)));
+		}
+		return;
+	}
+	if (tfx_glMultiDrawArraysIndirect) {
+		CHECK(tfx_glMultiDrawArraysIndirect(mode, (GLvoid*)offset, (GLsizei)count, (GLsizei)stride));
+		return;
+	}
+	assert(tfx_glDrawArraysIndirect != NULL);
+	stride = stride ? stride : 4 * sizeof(uint32_t);
+	for (uint32_t i = 0; i < count; i++) {
+		CHECK(tfx_glDrawArraysIndirect(mode, (GLvoid*)(offset + i * stride)));
+	}
+}
 
-	t.gl_count = 1;
+// point attributes from location `first` on at the bound array buffer.
+// `divisors` tracks what each location is set to. returns the next location.
+static int bind_attribs(tfx_vertex_format *fmt, size_t offset, int first, bool per_instance, uint32_t *divisors) {
+	int nc = fmt->count;
+#ifdef TFX_DEBUG
+	assert(nc <= 8); // the mask is only 8 bits
+#endif
 
-	// double buffer the texture updates, to reduce stalling.
-	if ((flags & TFX_TEXTURE_CPU_WRITABLE) == TFX_TEXTURE_CPU_WRITABLE) {
-		t.gl_count = 2;
+	int real = first;
+	for (int i = 0; i < nc; i++) {
+		if ((fmt->component_mask & (1 << i)) == 0) {
+			continue;
+		}
+		tfx_vertex_component vc = fmt->components[i];
+		GLenum gl_type = GL_FLOAT;
+		switch (vc.type) {
+			case TFX_TYPE_SKIP: continue;
+			case TFX_TYPE_UBYTE:  gl_type = GL_UNSIGNED_BYTE; break;
+			case TFX_TYPE_BYTE:   gl_type = GL_BYTE; break;
+			case TFX_TYPE_USHORT: gl_type = GL_UNSIGNED_SHORT; break;
+			case TFX_TYPE_SHORT:  gl_type = GL_SHORT; break;
+			case TFX_TYPE_FLOAT: break;
+			default: assert(false); break;
+		}
+		assert(real < TFX_MAX_ATTRIBS);
+		CHECK(tfx_glEnableVertexAttribArray(real));
+		CHECK(tfx_glVertexAttribPointer(real, (GLint)vc.size, gl_type, vc.normalized, (GLsizei)fmt->stride, (GLvoid*)(vc.offset + offset)));
+		uint32_t divisor = vc.divisor;
+		if (per_instance && divisor == 0) {
+			divisor = 1;
+		}
+		if (divisors[real] != divisor) {
+			assert(tfx_glVertexAttribDivisor != NULL);
+			CHECK(tfx_glVertexAttribDivisor(real, divisor));
+			divisors[real] = divisor;
+		}
+		real += 1;
 	}
+	return real;
+}
 
-	t.gl_idx = 0;
+// transient vertices are bound at their offset within a vertex and reached
+// through the base vertex, so draws from anywhere in the buffer share a VAO.
+static uint32_t draw_base_vertex(tfx_draw *draw, uint32_t *attrib_offset) {
+	*attrib_offset = 0;
+	if (!draw->use_tvb) {
+		return 0;
+	}
+	uint32_t offset = (uint32_t)draw->offset;
+	if (draw->use_ibo && !tfx_glDrawElementsInstancedBaseVertex) {
+		*attrib_offset = offset;
+		return 0;
+	}
+	uint32_t stride = (uint32_t)draw->tvb_fmt.stride;
+	*attrib_offset = offset % stride;
+	return offset / stride;
+}
 
-	tfx_texture_params *params = calloc(1, sizeof(tfx_texture_params));
-	params->update_data = NULL;
+static void vao_key(tfx_draw *draw, uint32_t attrib_offset, tfx_vao_key *key) {
+	memset(key, 0, sizeof(tfx_vao_key));
+	key->vbo = draw->vbo.gl_id;
+	key->offset = attrib_offset;
+	key->format = draw->use_tvb ? draw->tvb_fmt : draw->vbo.format;
+	if (draw->use_ibo) {
+		key->ibo = draw->ibo.gl_id;
+	}
+	if (draw->use_instance_vbo) {
+		key->instance_vbo = draw->instance_vbo.gl_id;
+		key->instance_format = draw->instance_vbo.format;
+	}
+}
 
-	switch (format) {
-		case TFX_FORMAT_RGB565:
-			params->format = GL_RGB;
-			params->internal_format = GL_RGB;
-			params->type = GL_UNSIGNED_SHORT_5_6_5;
-			break;
-		case TFX_FORMAT_RGBA8:
-			params->format = GL_RGBA;
-			params->internal_format = GL_RGBA;
-			params->type = GL_UNSIGNED_BYTE;
-			break;
-		default:
-			assert(false);
-			break;
+static void vao_point_instances(tfx_vao_entry *entry, size_t instance_offset) {
+	if (!entry->key.instance_vbo || entry->instance_offset == instance_offset) {
+		return;
 	}
+	gl_bind_buffer(TFX_GL_ARRAY_BUFFER, entry->key.instance_vbo);
+	bind_attribs(&entry->key.instance_format, instance_offset, entry->instance_first, true, entry->divisors);
+	entry->instance_offset = instance_offset;
+}
 
-	t.internal = params;
+// bind a VAO set up for the key, creating it (or recycling the least
+// recently used one) on a miss.
+static void vao_use(tfx_vao_key *key, size_t instance_offset) {
+	g_vao_cache.tick++;
 
-	CHECK(tfx_glGenTextures(t.gl_count, t.gl_ids));
-	for (unsigned i = 0; i < t.gl_count; i++) {
-		assert(t.gl_ids[i] > 0);
+	tfx_vao_entry *last = &g_vao_cache.entries[g_vao_cache.last];
+	if (g_vao_cache.count > 0 && memcmp(&last->key, key, sizeof(tfx_vao_key)) == 0) {
+		last->last_used = g_vao_cache.tick;
+		gl_bind_vertex_array(last->gl_id);
+		vao_point_instances(last, instance_offset);
+		return;
+	}
 
-		bool gen_mips = (flags & TFX_TEXTURE_GEN_MIPS) == TFX_TEXTURE_GEN_MIPS;
+	uint32_t hash = 2166136261u;
+	const uint8_t *bytes = (const uint8_t*)key;
+	for (size_t i = 0; i < sizeof(tfx_vao_key); i++) {
+		hash = (hash ^ bytes[i]) * 16777619u;
+	}
 
-		CHECK(tfx_glBindTexture(GL_TEXTURE_2D, t.gl_ids[i]));
-		if ((flags & TFX_TEXTURE_FILTER_POINT) == TFX_TEXTURE_FILTER_POINT) {
-			CHECK(tfx_glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
-			CHECK(tfx_glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, gen_mips ? GL_NEAREST_MIPMAP_NEAREST : GL_NEAREST));
+	int lru = 0;
+	for (int i = 0; i < g_vao_cache.count; i++) {
+		tfx_vao_entry *entry = &g_vao_cache.entries[i];
+		if (entry->hash == hash && memcmp(&entry->key, key, sizeof(tfx_vao_key)) == 0) {
+			entry->last_used = g_vao_cache.tick;
+			g_vao_cache.last = i;
+			gl_bind_vertex_array(entry->gl_id);
+			vao_point_instances(entry, instance_offset);
+			return;
 		}
-		else if ((flags & TFX_TEXTURE_FILTER_LINEAR) == TFX_TEXTURE_FILTER_LINEAR || !flags) {
-			CHECK(tfx_glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
-			CHECK(tfx_glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, gen_mips ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR));
+		if (entry->last_used < g_vao_cache.entries[lru].last_used) {
+			lru = i;
 		}
-		CHECK(tfx_glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
-		CHECK(tfx_glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+	}
 
-		if ((g_flags & TFX_RESET_MAX_ANISOTROPY) == TFX_RESET_MAX_ANISOTROPY) {
-			GLenum GL_TEXTURE_MAX_ANISOTROPY_EXT = 0x84FE;
-			CHECK(tfx_glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, g_max_aniso));
+	int slot = lru;
+	if (g_vao_cache.count < TFX_VAO_CACHE_SIZE) {
+		slot = g_vao_cache.count++;
+	}
+	tfx_vao_entry *entry = &g_vao_cache.entries[slot];
+	if (entry->gl_id) {
+		// start from a clean slate rather than undoing the old setup
+		if (g_gl.vao == entry->gl_id) {
+			g_gl.vao = TFX_GL_UNKNOWN;
 		}
+		CHECK(tfx_glDeleteVertexArrays(1, &entry->gl_id));
+	}
+	entry->key = *key;
+	entry->hash = hash;
+	entry->last_used = g_vao_cache.tick;
+	CHECK(tfx_glGenVertexArrays(1, &entry->gl_id));
+	g_vao_cache.last = slot;
+	gl_bind_vertex_array(entry->gl_id);
+
+	// divisors of a new VAO are all 0
+	memset(entry->divisors, 0, sizeof(entry->divisors));
+	gl_bind_buffer(TFX_GL_ARRAY_BUFFER, key->vbo);
+	int real = bind_attribs(&entry->key.format, key->offset, 0, false, entry->divisors);
+	entry->instance_first = real;
+	entry->instance_offset = instance_offset;
+	if (key->instance_vbo) {
+		gl_bind_buffer(TFX_GL_ARRAY_BUFFER, key->instance_vbo);
+		bind_attribs(&entry->key.instance_format, instance_offset, real, true, entry->divisors);
+	}
+	if (key->ibo) {
+		CHECK(tfx_glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, key->ibo));
+	}
+}
 
-		CHECK(tfx_glPixelStorei(GL_UNPACK_ALIGNMENT, 1));
-		CHECK(tfx_glTexImage2D(GL_TEXTURE_2D, 0, params->internal_format, w, h, 0, params->format, params->type, data));
-		if (gen_mips && data) {
-			CHECK(tfx_glGenerateMipmap(GL_TEXTURE_2D));
+static void memory_barrier(GLbitfield barriers, tfx_stats *stats) {
+	CHECK(tfx_glMemoryBarrier(barriers));
+	stats->barriers++;
+}
+
+static void draw_scissor(tfx_view *view, tfx_draw *draw, tfx_canvas *canvas) {
+	if ((view->flags & TFX_VIEW_SCISSOR) || draw->use_scissor) {
+		gl_set_enabled(TFX_GL_SCISSOR_TEST, true);
+		tfx_rect rect = view->scissor_rect;
+		if (draw->use_scissor) {
+			rect = draw->scissor_rect;
 		}
+		gl_scissor(rect.x, canvas->height - rect.y - rect.h, rect.w, rect.h);
+	}
+	else {
+		gl_set_enabled(TFX_GL_SCISSOR_TEST, false);
 	}
+}
 
-	sb_push(g_textures, t);
+static const char *occlusion_vss = ""
+	"in vec3 a_position;\n"
+	"uniform mat4 u_occlusion_clip;\n"
+	"uniform vec4 u_occlusion_center;\n"
+	"uniform vec4 u_occlusion_extent;\n"
+	"void main() {\n"
+	"	vec3 pos = u_occlusion_center.xyz + a_position * u_occlusion_extent.xyz;\n"
+	"	gl_Position = u_occlusion_clip * vec4(pos, 1.0);\n"
+	"}\n"
+;
+static const char *occlusion_fss = "void main() {}\n";
 
-	return t;
+static bool occlusion_init() {
+	if (g_occlusion.program) {
+		return true;
+	}
+	const char *attribs[] = { "a_position", NULL };
+	GLuint program = program_link(occlusion_vss, occlusion_fss, attribs);
+	if (!program) {
+		return false;
+	}
+	g_occlusion.program = program;
+	g_occlusion.clip_loc = CHECK(tfx_glGetUniformLocation(program, "u_occlusion_clip"));
+	g_occlusion.center_loc = CHECK(tfx_glGetUniformLocation(program, "u_occlusion_center"));
+	g_occlusion.extent_loc = CHECK(tfx_glGetUniformLocation(program, "u_occlusion_extent"));
+
+	static const float verts[] = {
+		-1, -1, -1,  1, -1, -1,  1,  1, -1,  -1,  1, -1,
+		-1, -1,  1,  1, -1,  1,  1,  1,  1,  -1,  1,  1
+	};
+	static const uint16_t indices[] = {
+		0, 2, 1, 0, 3, 2,  4, 5, 6, 4, 6, 7,
+		0, 1, 5, 0, 5, 4,  3, 6, 2, 3, 7, 6,
+		0, 4, 7, 0, 7, 3,  1, 2, 6, 1, 6, 5
+	};
+	tfx_vertex_format fmt = tfx_vertex_format_start();
+	tfx_vertex_format_add(&fmt, 0, 3, false, TFX_TYPE_FLOAT);
+	tfx_vertex_format_end(&fmt);
+	g_occlusion.vbo.format = fmt;
+	CHECK(tfx_glGenBuffers(1, &g_occlusion.vbo.gl_id));
+	CHECK(tfx_glGenBuffers(1, &g_occlusion.ibo.gl_id));
+	gl_bind_buffer(TFX_GL_ARRAY_BUFFER, g_occlusion.vbo.gl_id);
+	CHECK(tfx_glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW));
+	// the element binding belongs to the bound VAO, so fill it as an array
+	gl_bind_buffer(TFX_GL_ARRAY_BUFFER, g_occlusion.ibo.gl_id);
+	CHECK(tfx_glBufferData(GL_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW));
+	return true;
 }
 
-void tfx_texture_update(tfx_texture *tex, void *data) {
-	assert((tex->flags & TFX_TEXTURE_CPU_WRITABLE) == TFX_TEXTURE_CPU_WRITABLE);
-	tfx_texture_params *internal = tex->internal;
-	internal->update_data = data;
+static GLuint occlusion_query_get() {
+	int n = sb_count(g_occlusion.free_queries);
+	if (n > 0) {
+		GLuint query = g_occlusion.free_queries[n - 1];
+		sb_pop(g_occlusion.free_queries, 1);
+		return query;
+	}
+	GLuint query = 0;
+	CHECK(tfx_glGenQueries(1, &query));
+	return query;
 }
 
-void tfx_texture_free(tfx_texture *tex) {
-	int nt = sb_count(g_textures);
-	for (int i = 0; i < nt; i++) {
-		tfx_texture *cached = &g_textures[i];
-		// we only need to check index 0, as these ids cannot overlap or be reused.
-		if (tex->gl_ids[0] == cached->gl_ids[0]) {
-			tfx_texture_params *internal = (tfx_texture_params*)cached->internal;
-			free(internal);
-			tfx_glDeleteTextures(cached->gl_count, cached->gl_ids);
-			g_textures[i] = g_textures[nt-1];
-			// this, uh, might not be right.
-			stb__sbraw(g_textures)[1] -= 1;
+// take in whatever results are ready, oldest first, without waiting on the
+// GPU. the newest one decides visibility.
+static void occlusion_poll(tfx_occlusion_slot *slot) {
+	uint32_t done = 0;
+	while (done < slot->pending) {
+		GLuint query = slot->queries[done];
+		GLuint ready = 0;
+		CHECK(tfx_glGetQueryObjectuiv(query, GL_QUERY_RESULT_AVAILABLE, &ready));
+		if (!ready) {
+			break;
 		}
+		GLuint passed = 0;
+		CHECK(tfx_glGetQueryObjectuiv(query, GL_QUERY_RESULT, &passed));
+		slot->visible = passed != 0;
+		sb_push(g_occlusion.free_queries, query);
+		done++;
+	}
+	if (done > 0) {
+		slot->pending -= done;
+		memmove(slot->queries, slot->queries + done, slot->pending * sizeof(GLuint));
 	}
 }
 
-tfx_canvas mk_cube_canvas(tfx_canvas canvas, uint16_t flags) {
-	bool gen_mips = (flags & TFX_TEXTURE_GEN_MIPS) == TFX_TEXTURE_GEN_MIPS;
+// start a query for the handle, 0 if it has too many in flight already.
+static GLuint occlusion_begin(tfx_occlusion_slot *slot) {
+	if (slot->pending == TFX_OCCLUSION_LATENCY) {
+		return 0;
+	}
+	GLuint query = occlusion_query_get();
+	slot->queries[slot->pending++] = query;
+	CHECK(tfx_glBeginQuery(GL_ANY_SAMPLES_PASSED, query));
+	return query;
+}
 
-	GLuint color_tex = 0;
-	CHECK(tfx_glGenTextures(1, &color_tex));
-	CHECK(tfx_glBindTexture(GL_TEXTURE_CUBE_MAP, color_tex));
-	CHECK(tfx_glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE));
-	CHECK(tfx_glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
-	CHECK(tfx_glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
-	CHECK(tfx_glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, gen_mips ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR));
-	CHECK(tfx_glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+// a box reaching past the near plane would be clipped where the camera can
+// see it, so it can't stand in for the draw.
+static bool occlusion_near(const float *plane, const float *bounds) {
+	float d = plane[0] * bounds[0] + plane[1] * bounds[1] + plane[2] * bounds[2] + plane[3];
+	float r = fabsf(plane[0]) * bounds[3] + fabsf(plane[1]) * bounds[4] + fabsf(plane[2]) * bounds[5] + bounds[6];
+	return d - r < 0.0f;
+}
 
-	if ((g_flags & TFX_RESET_MAX_ANISOTROPY) == TFX_RESET_MAX_ANISOTROPY) {
-		GLenum GL_TEXTURE_MAX_ANISOTROPY_EXT = 0x84FE;
-		CHECK(tfx_glTexParameterf(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_ANISOTROPY_EXT, g_max_aniso));
+// draw the draw's bounding box without writing color or depth inside a new
+// query. returns the query, or 0 if none could be started.
+static GLuint occlusion_proxy(const float *clip, tfx_draw *draw, tfx_occlusion_slot *slot, bool use_vaos, int *last_count, uint32_t *divisors) {
+	if (slot->pending == TFX_OCCLUSION_LATENCY || !occlusion_init()) {
+		return 0;
 	}
 
-	bool hdr = (canvas.format & TFX_FORMAT_RG11B10F) == TFX_FORMAT_RG11B10F;
-	GLenum fmt = GL_RGBA8;
-	GLenum type = GL_UNSIGNED_BYTE;
-	if (hdr) {
-		fmt = GL_R11F_G11F_B10F;
-		type = GL_FLOAT;
+	gl_use_program(g_occlusion.program);
+	gl_color_mask(false, false, false, false);
+	gl_depth_mask(false);
+	gl_set_enabled(TFX_GL_CULL_FACE, false);
+	gl_set_enabled(TFX_GL_BLEND, false);
+
+	const float *b = draw->bounds;
+	float center[4] = { b[0], b[1], b[2], 1.0f };
+	float extent[4] = { b[3] + b[6], b[4] + b[6], b[5] + b[6], 0.0f };
+	CHECK(tfx_glUniformMatrix4fv(g_occlusion.clip_loc, 1, GL_FALSE, clip));
+	CHECK(tfx_glUniform4fv(g_occlusion.center_loc, 1, center));
+	CHECK(tfx_glUniform4fv(g_occlusion.extent_loc, 1, extent));
+
+	tfx_draw proxy;
+	memset(&proxy, 0, sizeof(tfx_draw));
+	proxy.vbo = g_occlusion.vbo;
+	proxy.ibo = g_occlusion.ibo;
+	proxy.use_vbo = true;
+	proxy.use_ibo = true;
+	if (use_vaos) {
+		tfx_vao_key key;
+		vao_key(&proxy, 0, &key);
+		vao_use(&key, 0);
 	}
-	GLuint size = canvas.width;
-	for (int i = 0; i < 6; i++) {
-		CHECK(tfx_glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, fmt, size, size, 0, GL_BGRA, type, NULL));
+	else {
+		gl_bind_buffer(TFX_GL_ARRAY_BUFFER, proxy.vbo.gl_id);
+		int real = bind_attribs(&proxy.vbo.format, 0, 0, false, divisors);
+		for (int i = real; i < *last_count; i++) {
+			CHECK(tfx_glDisableVertexAttribArray(i));
+		}
+		*last_count = real;
+		CHECK(tfx_glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, proxy.ibo.gl_id));
 	}
-	if (gen_mips) {
-		CHECK(tfx_glGenerateMipmap(GL_TEXTURE_CUBE_MAP));
+
+	GLuint query = occlusion_begin(slot);
+	CHECK(tfx_glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_SHORT, NULL));
+	CHECK(tfx_glEndQuery(GL_ANY_SAMPLES_PASSED));
+	return query;
+}
+
+// give the queries of freed handles back to the pool, unread.
+static void occlusion_collect() {
+	for (uint32_t i = 0; i < g_occlusion.used; i++) {
+		tfx_occlusion_slot *slot = &g_occlusion.slots[i];
+		if (slot->active || slot->pending == 0) {
+			continue;
+		}
+		for (uint32_t j = 0; j < slot->pending; j++) {
+			sb_push(g_occlusion.free_queries, slot->queries[j]);
+		}
+		slot->pending = 0;
 	}
+}
 
-	GLuint depth_tex = 0;
-	CHECK(tfx_glGenTextures(1, &depth_tex));
-	CHECK(tfx_glBindTexture(GL_TEXTURE_CUBE_MAP, depth_tex));
-	CHECK(tfx_glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE));
-	CHECK(tfx_glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
-	CHECK(tfx_glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
-	CHECK(tfx_glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
-	CHECK(tfx_glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
-	for (int i = 0; i < 6; i++) {
-		CHECK(tfx_glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_DEPTH_COMPONENT16, size, size, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_BYTE, NULL));
+static void view_label(char *label, size_t size, tfx_view *view, int id) {
+	if (view->name) {
+		snprintf(label, size, "%s (%d)", view->name, id);
+	}
+	else {
+		snprintf(label, size, "View %d", id);
 	}
+}
 
-	GLuint fb = 0;
-	CHECK(tfx_glGenFramebuffers(1, &fb));
-	CHECK(tfx_glBindFramebuffer(GL_FRAMEBUFFER, fb));
-	CHECK(tfx_glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, color_tex, 0));
-	CHECK(tfx_glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depth_tex, 0));
+// collect the oldest frame's timestamps if they are in, then start recording
+// into its slot. if the GPU is still behind, this frame isn't timed.
+static void timers_begin(tfx_view *frame_views) {
+	g_timers.recording = false;
+	if ((g_flags & TFX_RESET_GPU_TIMERS) == 0) {
+		return;
+	}
+	uint32_t slot = g_timers.current;
+	if (g_timers.frames[slot].pending) {
+		uint32_t n = g_timers.frames[slot].count;
+		GLuint *queries = g_timers.frames[slot].queries;
+		int16_t *views = g_timers.frames[slot].views;
+		GLuint ready = 0;
+		CHECK(tfx_glGetQueryObjectuiv(queries[n - 1], GL_QUERY_RESULT_AVAILABLE, &ready));
+		if (!ready) {
+			return;
+		}
+		g_timers.frames[slot].pending = false;
 
-	GLuint buffer = GL_COLOR_ATTACHMENT0;
-	CHECK(tfx_glDrawBuffers(1, &buffer));
-	CHECK(tfx_glReadBuffer(GL_COLOR_ATTACHMENT0));
+		// timestamps are meaningless across a disjoint event (ES only)
+		GLint disjoint = 0;
+		if (g_platform_data.use_gles) {
+			// GL_GPU_DISJOINT_EXT
+			CHECK(tfx_glGetIntegerv(0x8FBB, &disjoint));
+		}
+		if (!disjoint) {
+			// line the GPU clock up with ours for the timeline, as of now.
+			int64_t gpu_to_cpu = 0;
+			bool trace = g_trace.enabled && tfx_glGetInteger64v;
+			if (trace) {
+				GLint64 gpu_now = 0;
+				CHECK(tfx_glGetInteger64v(GL_TIMESTAMP, &gpu_now));
+				gpu_to_cpu = (int64_t)tfx_time_ns() - (int64_t)gpu_now;
+			}
 
-	GLenum status = CHECK(tfx_glCheckFramebufferStatus(GL_FRAMEBUFFER));
-	if (status != GL_FRAMEBUFFER_COMPLETE) {
-		assert(false);
-		// TODO: return something more error-y
-		return canvas;
+			char label[TFX_TRACE_NAME];
+			uint64_t first = 0, last = 0;
+			memset(g_timers.view_ms, 0, sizeof(g_timers.view_ms));
+			for (uint32_t i = 0; i < n; i++) {
+				uint64_t t = 0;
+				CHECK(tfx_glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &t));
+				if (i == 0) {
+					first = t;
+				}
+				else if (views[i - 1] >= 0) {
+					int id = views[i - 1];
+					g_timers.view_ms[id] += (float)((double)(t - last) / 1000000.0);
+					if (trace) {
+						view_label(label, sizeof(label), &frame_views[id], id);
+						trace_zone(TFX_TRACE_GPU, label, last + gpu_to_cpu, t + gpu_to_cpu);
+					}
+				}
+				last = t;
+			}
+			g_timers.frame_ms = (float)((double)(last - first) / 1000000.0);
+			if (trace) {
+				trace_zone(TFX_TRACE_GPU, "GPU Frame", first + gpu_to_cpu, last + gpu_to_cpu);
+			}
+		}
 	}
+	g_timers.frames[slot].count = 0;
+	g_timers.recording = true;
+}
 
-	int idx = 0;
-	canvas.gl_ids[idx++] = color_tex;
-	canvas.gl_ids[idx++] = depth_tex;
-	canvas.gl_fbo = fb;
-	canvas.allocated += 1;
-	canvas.mipmaps = gen_mips;
-	canvas.cube = true;
+static void timer_mark(int view) {
+	if (!g_timers.recording) {
+		return;
+	}
+	uint32_t slot = g_timers.current;
+	uint32_t n = g_timers.frames[slot].count;
+	assert(n < TFX_TIMER_MARKS);
+	if (n == g_timers.frames[slot].allocated) {
+		CHECK(tfx_glGenQueries(1, &g_timers.frames[slot].queries[n]));
+		g_timers.frames[slot].allocated++;
+	}
+	CHECK(tfx_glQueryCounter(g_timers.frames[slot].queries[n], GL_TIMESTAMP));
+	g_timers.frames[slot].views[n] = (int16_t)view;
+	g_timers.frames[slot].count++;
+}
 
-	return canvas;
+static void timers_end(tfx_stats *stats) {
+	if (g_timers.recording) {
+		g_timers.frames[g_timers.current].pending = true;
+		g_timers.current = (g_timers.current + 1) % TFX_TIMER_FRAMES;
+		g_timers.recording = false;
+	}
+	if (g_flags & TFX_RESET_GPU_TIMERS) {
+		stats->gpu_ms = g_timers.frame_ms;
+		memcpy(stats->gpu_view_ms, g_timers.view_ms, sizeof(g_timers.view_ms));
+	}
 }
 
-tfx_canvas tfx_canvas_new(uint16_t w, uint16_t h, tfx_format format, uint16_t flags) {
-	tfx_canvas c;
-	memset(&c, 0, sizeof(tfx_canvas));
+// CPU side of the view marks: the view being timed and when it started.
+static int g_cpu_view = -1;
+static uint64_t g_cpu_view_start = 0;
+static char g_cpu_view_label[TFX_TRACE_NAME];
+
+// start timing a view (or nothing, with -1) on the GPU and CPU, ending the
+// previous one.
+static void view_mark(tfx_stats *stats, int view, const char *label) {
+	uint64_t now = tfx_time_ns();
+	if (g_cpu_view >= 0) {
+		stats->cpu_view_ms[g_cpu_view] += (float)((double)(now - g_cpu_view_start) / 1000000.0);
+		trace_zone(TFX_TRACE_RENDER, g_cpu_view_label, g_cpu_view_start, now);
+	}
+	g_cpu_view = view;
+	g_cpu_view_start = now;
+	if (label) {
+		snprintf(g_cpu_view_label, sizeof(g_cpu_view_label), "%s", label);
+	}
+	timer_mark(view);
+}
 
-	c.allocated = 0;
-	c.width  = w;
-	c.height = h;
-	c.format = format;
+static tfx_stats render_frame(tfx_frame_data *frame) {
+	uint64_t frame_start = tfx_time_ns();
 
-	if ((flags & TFX_TEXTURE_CUBE) == TFX_TEXTURE_CUBE) {
-		return mk_cube_canvas(c, flags);
+	/* This isn't used on RPi, but should free memory on some devices. When
+	 * you call tfx_frame, you should be done with your shader compiles for
+	 * a good while, since that should only be done during init/loading. */
+	release_compiler();
+
+	if (g_caps.debug_output) {
+		CHECK(tfx_glEnable(GL_DEBUG_OUTPUT));
 	}
 
-	GLenum color_format = 0;
-	GLenum depth_format = 0;
-	GLenum internal = 0;
+	tfx_stats stats;
+	memset(&stats, 0, sizeof(tfx_stats));
 
-	switch (format) {
-		case TFX_FORMAT_RGBA8: {
-			color_format = GL_UNSIGNED_BYTE;
-			internal = GL_RGB;
-			break;
-		}
-		case TFX_FORMAT_RGB565: {
-			color_format = GL_UNSIGNED_SHORT_5_6_5;
-			internal = GL_RGB;
-			break;
-		}
-		case TFX_FORMAT_D16: {
-			depth_format = GL_DEPTH_COMPONENT16;
-			break;
-		}
-		case TFX_FORMAT_RGBA8_D16: {
-			color_format = GL_UNSIGNED_BYTE;
-			depth_format = GL_DEPTH_COMPONENT16;
-			internal = GL_RGBA;
-			break;
-		}
-		case TFX_FORMAT_RGBA8_D24: {
-			color_format = GL_UNSIGNED_BYTE;
-			depth_format = GL_DEPTH_COMPONENT24;
-			internal = GL_RGBA;
-			break;
-		}
-		case TFX_FORMAT_RGB565_D16: {
-			color_format = GL_UNSIGNED_SHORT_5_6_5;
-			depth_format = GL_DEPTH_COMPONENT16;
-			internal = GL_RGB;
-			break;
-		}
-		default: assert(false); break;
-	}
+	int last_count = 0;
+	uint32_t divisors[TFX_MAX_ATTRIBS];
+	memset(divisors, 0, sizeof(divisors));
 
-	// and now the fbo.
-	GLuint fbo;
-	CHECK(tfx_glGenFramebuffers(1, &fbo));
-	CHECK(tfx_glBindFramebuffer(GL_FRAMEBUFFER, fbo));
+	//CHECK(tfx_glEnable(GL_FRAMEBUFFER_SRGB));
 
-	int idx = 0;
+	// I'm not aware of any situation this is available but undesirable,
+	// so we use it unconditionally if possible.
+	if (g_caps.seamless_cubemap) {
+		CHECK(tfx_glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS));
+	}
 
-	// setup color buffer...
-	if (color_format) {
-		assert(internal != 0);
+	bool use_vaos = tfx_glGenVertexArrays && tfx_glBindVertexArray && tfx_glDeleteVertexArrays;
+	// the app may have changed anything between frames
+	gl_forget();
+	memset(&g_gl.counts, 0, sizeof(tfx_gl_counts));
 
-		GLuint color;
-		CHECK(tfx_glGenTextures(1, &color));
-		c.gl_ids[idx++] = color;
-		CHECK(tfx_glBindTexture(GL_TEXTURE_2D, color));
-		CHECK(tfx_glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, w, h, 0, internal, color_format, NULL));
+	unsigned debug_id = 0;
 
-		bool gen_mips = (flags & TFX_TEXTURE_GEN_MIPS) == TFX_TEXTURE_GEN_MIPS;
-		if ((flags & TFX_TEXTURE_FILTER_POINT) == TFX_TEXTURE_FILTER_POINT) {
-			CHECK(tfx_glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
-			CHECK(tfx_glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, gen_mips ? GL_NEAREST_MIPMAP_NEAREST : GL_NEAREST));
-		}
-		else if ((flags & TFX_TEXTURE_FILTER_LINEAR) == TFX_TEXTURE_FILTER_LINEAR || !flags) {
-			CHECK(tfx_glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
-			CHECK(tfx_glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, gen_mips ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR));
-		}
+	timers_begin(frame->views);
+	view_mark(&stats, -1, NULL);
 
-		CHECK(tfx_glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color, 0));
-	}
+	uint64_t update_zone = trace_begin();
+	push_group(debug_id++, "Update Resources");
 
-	// setup depth buffer...
-	if (depth_format) {
-		GLuint rbo;
-		CHECK(tfx_glGenRenderbuffers(1, &rbo));
-		CHECK(tfx_glBindRenderbuffer(GL_RENDERBUFFER, rbo));
-		CHECK(tfx_glRenderbufferStorage(GL_RENDERBUFFER, depth_format, w, h));
-		CHECK(tfx_glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rbo));
+	// persistently mapped data is already in place.
+	uint32_t transient_size = frame->transient_offset;
+	if (transient_size > 0 && !g_transient_buffer.mapped) {
+		gl_bind_buffer(TFX_GL_ARRAY_BUFFER, g_transient_buffer.buf.gl_id);
+		// orphan, so the upload doesn't wait for last frame's draws
+		CHECK(tfx_glBufferData(GL_ARRAY_BUFFER, TFX_TRANSIENT_BUFFER_SIZE, NULL, GL_STREAM_DRAW));
+		CHECK(tfx_glBufferSubData(GL_ARRAY_BUFFER, 0, transient_size, frame->transient_data));
 	}
 
-	GLenum status = CHECK(tfx_glCheckFramebufferStatus(GL_FRAMEBUFFER));
-	if (status != GL_FRAMEBUFFER_COMPLETE) {
-		assert(false);
-		// TODO: return something more error-y
-		return c;
+	int nt = sb_count(frame->texture_updates);
+	for (int i = 0; i < nt; i++) {
+		tfx_texture *tex = frame->texture_updates[i].texture;
+		tfx_texture_params *internal = tex->internal;
+		// spin the buffer id before updating
+		tex->gl_idx = (tex->gl_idx + 1) % tex->gl_count;
+		gl_bind_texture(0, GL_TEXTURE_2D, tex->gl_ids[tex->gl_idx]);
+		tfx_glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, tex->width, tex->height, internal->format, internal->type, frame->texture_updates[i].data);
 	}
 
-	c.gl_fbo = fbo;
-	c.allocated += 1;
+	stats.culled = gather_frame(frame);
+	stats.uniform_bytes += upload_blocks();
+	stats.transient_bytes = frame->transient_offset;
+	build_batches();
 
-	return c;
-}
+	pop_group();
+	trace_end(TFX_TRACE_RENDER, "Update Resources", update_zone);
 
-static size_t uniform_size_for(tfx_uniform_type type) {
-	switch (type) {
-		case TFX_UNIFORM_FLOAT: return sizeof(float);
-		case TFX_UNIFORM_INT: return sizeof(uint32_t);
-		case TFX_UNIFORM_VEC2: return sizeof(float)*2;
-		case TFX_UNIFORM_VEC3: return sizeof(float)*3;
-		case TFX_UNIFORM_VEC4: return sizeof(float)*4;
-		case TFX_UNIFORM_MAT2: return sizeof(float)*4;
-		case TFX_UNIFORM_MAT3: return sizeof(float)*9;
-		case TFX_UNIFORM_MAT4: return sizeof(float)*16;
-		default: return 0;
-	}
-	return 0;
-}
+	char debug_label[256];
 
-tfx_uniform tfx_uniform_new(const char *name, tfx_uniform_type type, int count) {
-	tfx_uniform u;
-	memset(&u, 0, sizeof(tfx_uniform));
+	tfx_canvas *last_canvas = NULL;
 
-	u.name  = name;
-	u.type  = type;
-	u.count = count;
-	u.last_count = count;
-	u.size  = count * uniform_size_for(type);
+	uint32_t bound_blocks[TFX_MAX_UNIFORM_BLOCKS];
+	memset(bound_blocks, 0xff, sizeof(bound_blocks));
 
-	return u;
-}
+	for (int id = 0; id < VIEW_MAX; id++) {
+		tfx_view *view = &frame->views[id];
 
-void tfx_set_uniform(tfx_uniform *uniform, const float *data, const int count) {
-	size_t size = uniform->size;
-	uniform->last_count = uniform->count;
-	if (count >= 0) {
-		size = count * uniform_size_for(uniform->type);
-		uniform->last_count = count;
-	}
+		tfx_view_range range = g_view_ranges[id];
+		int cd = range.jobs;
+		int nd = range.draws;
+		tfx_draw_ref *jobs = &g_frame_jobs[range.first_job];
+		tfx_draw_ref *draws = &g_frame_draws[range.first_draw];
+		int nb = sb_count(view->blits);
+		if (nd == 0 && cd == 0 && nb == 0) {
+			continue;
+		}
+
+		view_label(debug_label, sizeof(debug_label), view, id);
+		push_group(debug_id++, debug_label);
+		view_mark(&stats, id, debug_label);
+
+		tfx_program program = 0;
+		if (g_caps.compute) {
+			if (cd > 0) {
+				// split compute into its own section because it is infrequently used.
+				// helpful in renderdoc captures.
+				push_group(debug_id++, "Compute");
+			}
+			for (int i = 0; i < cd; i++) {
+				tfx_draw job = *jobs[i].draw;
+				gl_use_program(program_gl_id(job.program));
+				program = job.program;
+				upload_uniforms(program, &job, &stats);
+				bind_blocks(&jobs[i], bound_blocks);
+				// TODO: bind image textures
+				for (int i = 0; i < 8; i++) {
+					if (job.ssbos[i].gl_id != 0) {
+						tfx_buffer *ssbo = &job.ssbos[i];
+						if (ssbo->dirty) {
+							memory_barrier(GL_SHADER_STORAGE_BARRIER_BIT, &stats);
+							ssbo->dirty = false;
+						}
+						if (job.ssbo_write[i]) {
+							ssbo->dirty = true;
+						}
+						gl_bind_storage(i, job.ssbos[i].gl_id);
+					}
+					else {
+						gl_bind_storage(i, 0);
+					}
+				}
+				CHECK(tfx_glDispatchCompute(job.threads_x, job.threads_y, job.threads_z));
+				stats.dispatches++;
+			}
+			if (cd > 0) {
+				pop_group();
+			}
+		}
 
-	uniform->data = g_ub_cursor;
-	memcpy(uniform->fdata, data, size);
-	g_ub_cursor += size;
+		if (nd == 0 && nb == 0) {
+			pop_group();
+			continue;
+		}
 
-	sb_push(g_uniforms, *uniform);
-}
+		stats.draws += nd;
 
-void tfx_set_uniform_int(tfx_uniform *uniform, const int *data, const int count) {
-	size_t size = uniform->size;
-	uniform->last_count = uniform->count;
-	if (count >= 0) {
-		size = count * uniform_size_for(uniform->type);
-		uniform->last_count = count;
-	}
+		tfx_canvas *canvas = get_canvas(view);
 
-	uniform->data = g_ub_cursor;
-	memcpy(uniform->idata, data, size);
-	g_ub_cursor += size;
+		// TODO: defer framebuffer creation
 
-	sb_push(g_uniforms, *uniform);
-}
+		// this can currently only happen on error.
+		if (canvas->allocated == 0) {
+			pop_group();
+			continue;
+		}
+		gl_bind_framebuffer(canvas->gl_fbo);
+		gl_viewport(0, 0, canvas->width, canvas->height);
 
-void tfx_view_set_transform(uint8_t id, float *_view, float *proj_l, float *proj_r) {
-	// TODO: reserve tfx_world_to_view, tfx_view_to_screen uniforms
-	tfx_view *view = &g_views[id];
-	assert(view != NULL);
-	memcpy(view->view, _view, sizeof(float)*16);
-	memcpy(view->proj_left, proj_l, sizeof(float)*16);
-	memcpy(view->proj_right, proj_r, sizeof(float)*16);
-}
+		if (canvas->cube) {
+			CHECK(tfx_glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + view->canvas_layer, canvas->gl_ids[0], 0));
+			CHECK(tfx_glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,  GL_TEXTURE_CUBE_MAP_POSITIVE_X + view->canvas_layer, canvas->gl_ids[1], 0));
+		}
 
-void tfx_view_set_name(uint8_t id, const char *name) {
-	tfx_view *view = &g_views[id];
-	view->name = name;
-}
+		if (last_canvas && canvas != last_canvas && last_canvas->mipmaps && last_canvas->gl_fbo != canvas->gl_fbo) {
+			GLenum fmt = last_canvas->cube ? GL_TEXTURE_CUBE_MAP : GL_TEXTURE_2D;
+			gl_bind_texture(0, fmt, last_canvas->gl_ids[0]);
+			tfx_glGenerateMipmap(fmt);
+		}
+		last_canvas = canvas;
 
-void tfx_view_set_canvas(uint8_t id, tfx_canvas *canvas, int layer) {
-	tfx_view *view = &g_views[id];
-	assert(view != NULL);
-	view->has_canvas = true;
-	view->canvas = *canvas;
-	view->canvas_layer = layer;
-}
+		if (view->flags & TFX_VIEW_SCISSOR) {
+			tfx_rect rect = view->scissor_rect;
+			gl_set_enabled(TFX_GL_SCISSOR_TEST, true);
+			gl_scissor(rect.x, canvas->height - rect.y - rect.h, rect.w, rect.h);
+		}
+		else {
+			gl_set_enabled(TFX_GL_SCISSOR_TEST, false);
+		}
 
-void tfx_view_set_clear_color(uint8_t id, int color) {
-	tfx_view *view = &g_views[id];
-	assert(view != NULL);
-	view->flags |= TFX_VIEW_CLEAR_COLOR;
-	view->clear_color = color;
-}
+		gl_color_mask(true, true, true, true);
+		gl_depth_mask(true);
 
-void tfx_view_set_clear_depth(uint8_t id, float depth) {
-	tfx_view *view = &g_views[id];
-	assert(view != NULL);
-	view->flags |= TFX_VIEW_CLEAR_DEPTH;
-	view->clear_depth = depth;
-}
+		GLuint mask = 0;
+		if (view->flags & TFX_VIEW_CLEAR_COLOR) {
+			mask |= GL_COLOR_BUFFER_BIT;
+			int color = view->clear_color;
+			float c[] = {
+				((color >> 24) & 0xff) / 255.0f,
+				((color >> 16) & 0xff) / 255.0f,
+				((color >>  8) & 0xff) / 255.0f,
+				((color >>  0) & 0xff) / 255.0f
+			};
+			CHECK(tfx_glClearColor(c[0], c[1], c[2], c[3]));
+		}
+		if (view->flags & TFX_VIEW_CLEAR_DEPTH) {
+			mask |= GL_DEPTH_BUFFER_BIT;
+			CHECK(tfx_glClearDepthf(view->clear_depth));
+		}
 
-void tfx_view_set_depth_test(uint8_t id, tfx_depth_test mode) {
-	tfx_view *view = &g_views[id];
-	assert(view != NULL);
+		if (mask != 0) {
+			CHECK(tfx_glClear(mask));
+		}
 
-	view->flags &= ~TFX_VIEW_DEPTH_TEST_MASK;
-	switch (mode) {
-		case TFX_DEPTH_TEST_NONE: break; /* already cleared */
-		case TFX_DEPTH_TEST_LT: {
-			view->flags |= TFX_VIEW_DEPTH_TEST_LT;
-			break;
+		// blits land on the cleared canvas, before any draws. rects are from
+		// the top left like scissors, and the same on both canvases.
+		// ES2 has no glBlitFramebuffer, so they're dropped there.
+		if (nb > 0 && !tfx_glBlitFramebuffer && !g_blit_warned) {
+			TFX_WARN("%s", "blits are not supported without glBlitFramebuffer, skipping");
+			g_blit_warned = true;
 		}
-		case TFX_DEPTH_TEST_GT: {
-			view->flags |= TFX_VIEW_DEPTH_TEST_GT;
-			break;
+		if (nb > 0 && tfx_glBlitFramebuffer) {
+			for (int i = 0; i < nb; i++) {
+				tfx_blit_op *blit = &view->blits[i];
+				tfx_rect r = blit->rect;
+				GLint sy = blit->source->height - r.y - r.h;
+				GLint dy = canvas->height - r.y - r.h;
+				CHECK(tfx_glBindFramebuffer(GL_READ_FRAMEBUFFER, blit->source->gl_fbo));
+				CHECK(tfx_glBlitFramebuffer(
+					r.x, sy, r.x + r.w, sy + r.h,
+					r.x, dy, r.x + r.w, dy + r.h,
+					GL_COLOR_BUFFER_BIT, GL_NEAREST
+				));
+			}
+			CHECK(tfx_glBindFramebuffer(GL_READ_FRAMEBUFFER, canvas->gl_fbo));
+			stats.blits += nb;
 		}
-		case TFX_DEPTH_TEST_EQ: {
-			view->flags |= TFX_VIEW_DEPTH_TEST_EQ;
-			break;
+
+		if (view->flags & TFX_VIEW_DEPTH_TEST_MASK) {
+			gl_set_enabled(TFX_GL_DEPTH_TEST, true);
+			if (view->flags & TFX_VIEW_DEPTH_TEST_LT) {
+				gl_depth_func(GL_LEQUAL);
+			}
+			else if (view->flags & TFX_VIEW_DEPTH_TEST_GT) {
+				gl_depth_func(GL_GEQUAL);
+			}
+			else if (view->flags & TFX_VIEW_DEPTH_TEST_EQ) {
+				gl_depth_func(GL_EQUAL);
+			}
+		}
+		else {
+			gl_set_enabled(TFX_GL_DEPTH_TEST, false);
 		}
-		default: assert(false); break;
-	}
-}
 
-uint16_t tfx_view_get_width(uint8_t id) {
-	tfx_view *view = &g_views[id];
-	assert(view != NULL);
+		float clip[16];
+		float planes[6][4];
+		bool have_clip = false;
 
-	if (view->has_canvas) {
-		return view->canvas.width;
-	}
+		// all state goes through the shadow, which drops anything redundant.
+		for (int i = 0; i < nd; i++) {
+			tfx_draw_ref ref = draws[i];
+			tfx_draw draw = *ref.draw;
+
+			// occlusion tested draws are queried while visible. hidden ones
+			// only get their box tested, which their draw is made conditional
+			// on, or skipped when that isn't supported.
+			tfx_occlusion_slot *occlusion = NULL;
+			GLuint condition = 0;
+			bool use_occlusion = draw.occlusion && draw.use_vbo && draw.use_bounds
+				&& (view->flags & TFX_VIEW_FRUSTUM) && g_caps.occlusion_query;
+			if (use_occlusion) {
+				if (!have_clip) {
+					view_clip(view, clip);
+					frustum_planes(clip, planes);
+					have_clip = true;
+				}
+				occlusion = &g_occlusion.slots[draw.occlusion - 1];
+				occlusion_poll(occlusion);
+				if (!occlusion->visible && !occlusion_near(planes[4], draw.bounds)) {
+					stats.occluded++;
+					draw_scissor(view, &draw, canvas);
+					condition = occlusion_proxy(clip, &draw, occlusion, use_vaos, &last_count, divisors);
+					if (condition && !(g_caps.conditional_render && tfx_glBeginConditionalRender)) {
+						continue;
+					}
+					occlusion = NULL;
+				}
+			}
 
-	return g_backbuffer.width;
-}
+			gl_use_program(program_gl_id(draw.program));
+			program = draw.program;
 
-uint16_t tfx_view_get_height(uint8_t id) {
-	tfx_view *view = &g_views[id];
-	assert(view != NULL);
+			gl_depth_mask((draw.flags & TFX_STATE_DEPTH_WRITE) > 0);
 
-	if (view->has_canvas) {
-		return view->canvas.height;
-	}
+			if (g_caps.multisample) {
+				gl_set_enabled(TFX_GL_MULTISAMPLE, (draw.flags & TFX_STATE_MSAA) > 0);
+			}
 
-	return g_backbuffer.height;
-}
+			if (draw.flags & TFX_STATE_CULL_CW) {
+				gl_set_enabled(TFX_GL_CULL_FACE, true);
+				gl_front_face(GL_CW);
+			}
+			else if (draw.flags & TFX_STATE_CULL_CCW) {
+				gl_set_enabled(TFX_GL_CULL_FACE, true);
+				gl_front_face(GL_CCW);
+			}
+			else {
+				gl_set_enabled(TFX_GL_CULL_FACE, false);
+			}
 
-void tfx_view_get_dimensions(uint8_t id, uint16_t *w, uint16_t *h) {
-	if (w) {
-		*w = tfx_view_get_width(id);
-	}
-	if (h) {
-		*h = tfx_view_get_height(id);
-	}
-}
+			gl_set_enabled(TFX_GL_BLEND, (draw.flags & TFX_STATE_BLEND_MASK) > 0);
+			if (draw.flags & TFX_STATE_BLEND_ALPHA) {
+				gl_blend_func(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+			}
 
-void tfx_view_set_scissor(uint8_t id, uint16_t x, uint16_t y, uint16_t w, uint16_t h) {
-	tfx_view *view = &g_views[id];
-	view->flags |= TFX_VIEW_SCISSOR;
+			bool write_rgb = draw.flags & TFX_STATE_RGB_WRITE;
+			bool write_alpha = draw.flags & TFX_STATE_ALPHA_WRITE;
+			gl_color_mask(write_rgb, write_rgb, write_rgb, write_alpha);
 
-	tfx_rect rect;
-	rect.x = x;
-	rect.y = y;
-	rect.w = w;
-	rect.h = h;
+			draw_scissor(view, &draw, canvas);
 
-	view->scissor_rect = rect;
-}
+			upload_uniforms(program, &draw, &stats);
+			if (ref.patch) {
+				upload_uniforms(program, ref.patch, &stats);
+			}
+			bind_blocks(&ref, bound_blocks);
 
-static tfx_draw g_tmp_draw;
+			if (draw.callback != NULL) {
+				draw.callback();
+				gl_forget();
+				memset(bound_blocks, 0xff, sizeof(bound_blocks));
+			}
 
-static void reset() {
-	memset(&g_tmp_draw, 0, sizeof(tfx_draw));
-}
+			if (!draw.use_vbo) {
+				continue;
+			}
 
-void tfx_set_callback(tfx_draw_callback cb) {
-	g_tmp_draw.callback = cb;
-}
+			GLenum mode = GL_TRIANGLES;
+			switch (draw.flags & TFX_STATE_DRAW_MASK) {
+				case TFX_STATE_DRAW_POINTS:     mode = GL_POINTS; break;
+				case TFX_STATE_DRAW_LINES:      mode = GL_LINES; break;
+				case TFX_STATE_DRAW_LINE_STRIP: mode = GL_LINE_STRIP; break;
+				case TFX_STATE_DRAW_LINE_LOOP:  mode = GL_LINE_LOOP; break;
+				case TFX_STATE_DRAW_TRI_STRIP:  mode = GL_TRIANGLE_STRIP; break;
+				case TFX_STATE_DRAW_TRI_FAN:    mode = GL_TRIANGLE_FAN; break;
+				default: break; // unspecified = triangles.
+			}
 
-void tfx_set_scissor(uint16_t x, uint16_t y, uint16_t w, uint16_t h) {
-	g_tmp_draw.use_scissor = true;
-	g_tmp_draw.scissor_rect.x = x;
-	g_tmp_draw.scissor_rect.y = y;
-	g_tmp_draw.scissor_rect.w = w;
-	g_tmp_draw.scissor_rect.h = h;
-}
+			GLuint vbo = draw.vbo.gl_id;
+#ifdef TFX_DEBUG
+			assert(vbo != 0);
+#endif
 
-void tfx_set_texture(tfx_uniform *uniform, tfx_texture *tex, uint8_t slot) {
-	assert(slot <= 8);
-	assert(uniform != NULL);
-	assert(uniform->count == 1);
+			if (draw.vbo.dirty && tfx_glMemoryBarrier) {
+				memory_barrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT, &stats);
+				draw.vbo.dirty = false;
+			}
 
-	uniform->data = g_ub_cursor;
-	uniform->idata[0] = slot;
-	g_ub_cursor += uniform->size;
+			uint32_t va_offset = 0;
+			GLint base_vertex = (GLint)draw_base_vertex(&draw, &va_offset);
+			if (draw.use_tvb) {
+				draw.vbo.format = draw.tvb_fmt;
+			}
+			tfx_vertex_format *fmt = &draw.vbo.format;
+			assert(fmt != NULL);
+			assert(fmt->stride > 0);
 
-	sb_push(g_uniforms, *uniform);
+			if (draw.use_instance_vbo) {
+				if (draw.instance_vbo.dirty && tfx_glMemoryBarrier) {
+					memory_barrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT, &stats);
+					draw.instance_vbo.dirty = false;
+				}
+				assert(draw.instance_vbo.format.stride > 0);
+			}
+			if (draw.use_ibo && draw.ibo.dirty && tfx_glMemoryBarrier) {
+				memory_barrier(GL_ELEMENT_ARRAY_BARRIER_BIT, &stats);
+				draw.ibo.dirty = false;
+			}
 
-	assert(tex->gl_ids[tex->gl_idx] > 0);
-	g_tmp_draw.textures[slot] = *tex;
-}
+			if (use_vaos) {
+				tfx_vao_key key;
+				vao_key(&draw, va_offset, &key);
+				vao_use(&key, draw.instance_offset);
+			}
+			else {
+				gl_bind_buffer(TFX_GL_ARRAY_BUFFER, vbo);
+				int real = bind_attribs(fmt, va_offset, 0, false, divisors);
+				if (draw.use_instance_vbo) {
+					gl_bind_buffer(TFX_GL_ARRAY_BUFFER, draw.instance_vbo.gl_id);
+					real = bind_attribs(&draw.instance_vbo.format, draw.instance_offset, real, true, divisors);
+				}
+				for (int i = real; i < last_count; i++) {
+					CHECK(tfx_glDisableVertexAttribArray(i));
+				}
+				last_count = real;
+				if (draw.use_ibo) {
+					CHECK(tfx_glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, draw.ibo.gl_id));
+				}
+			}
+			GLsizei instances = draw.instances > 0 ? (GLsizei)draw.instances : 1;
 
-tfx_texture tfx_get_texture(tfx_canvas *canvas, uint8_t index) {
-	tfx_texture tex;
-	memset(&tex, 0, sizeof(tfx_texture));
+			for (int i = 0; i < 8; i++) {
+				tfx_texture *tex = &draw.textures[i];
+				if (tex->gl_ids[tex->gl_idx] != 0) {
+					bool cube = (tex->flags & TFX_TEXTURE_CUBE) == TFX_TEXTURE_CUBE;
+					GLenum fmt = cube ? GL_TEXTURE_CUBE_MAP : GL_TEXTURE_2D;
+					gl_bind_texture(i, fmt, tex->gl_ids[tex->gl_idx]);
+#ifdef TFX_DEBUG
+					assert(tex->gl_ids[tex->gl_idx] > 0);
+#endif
+				}
+			}
 
-	assert(index < canvas->allocated);
-	tex.format = canvas->format;
-	tex.gl_count = 1;
-	tex.gl_ids[0] = canvas->gl_ids[index];
-	tex.width = canvas->width;
-	tex.height = canvas->height;
+			GLenum index_type = draw.ibo_32bit ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT;
 
-	if (canvas->mipmaps) {
-		tex.flags |= TFX_TEXTURE_GEN_MIPS;
+			GLuint query = 0;
+			if (occlusion) {
+				query = occlusion_begin(occlusion);
+			}
+			if (condition) {
+				CHECK(tfx_glBeginConditionalRender(condition, GL_QUERY_NO_WAIT));
+			}
+
+			if (draw.indirect.gl_id) {
+				if (draw.indirect.dirty && tfx_glMemoryBarrier) {
+					memory_barrier(GL_COMMAND_BARRIER_BIT, &stats);
+					draw.indirect.dirty = false;
+				}
+				gl_bind_buffer(TFX_GL_DRAW_INDIRECT_BUFFER, draw.indirect.gl_id);
+				multi_draw_indirect(mode, draw.use_ibo, index_type, draw.indirect_offset, draw.indirect_count, 0);
+			}
+			else if (ref.batch > 1) {
+				gl_bind_buffer(TFX_GL_DRAW_INDIRECT_BUFFER, g_indirect_buffer.gl_id);
+				size_t offset = ref.command * sizeof(tfx_indirect_command);
+				multi_draw_indirect(mode, draw.use_ibo, index_type, offset, ref.batch, sizeof(tfx_indirect_command));
+				i += ref.batch - 1;
+			}
+			else if (draw.use_ibo && base_vertex > 0) {
+				CHECK(tfx_glDrawElementsInstancedBaseVertex(mode, draw.indices, index_type, (GLvoid*)draw.ibo_offset, instances, base_vertex));
+			}
+			else if (draw.use_ibo) {
+				CHECK(tfx_glDrawElementsInstanced(mode, draw.indices, index_type, (GLvoid*)draw.ibo_offset, instances));
+			}
+			else {
+				CHECK(tfx_glDrawArraysInstanced(mode, base_vertex, (GLsizei)draw.indices, instances));
+			}
+
+			if (condition) {
+				CHECK(tfx_glEndConditionalRender());
+			}
+			if (query) {
+				CHECK(tfx_glEndQuery(GL_ANY_SAMPLES_PASSED));
+			}
+		}
+
+		pop_group();
 	}
-	if (canvas->cube) {
-		tex.flags |= TFX_TEXTURE_CUBE;
+
+	for (int id = 0; id < VIEW_MAX; id++) {
+		tfx_view *view = &frame->views[id];
+		sb_free(view->blits);
+		view->blits = NULL;
 	}
 
-	return tex;
-}
+	gl_set_enabled(TFX_GL_SCISSOR_TEST, false);
+	gl_color_mask(true, true, true, true);
 
-void tfx_set_state(uint64_t flags) {
-	g_tmp_draw.flags = flags;
-}
+	if (use_vaos) {
+		gl_bind_vertex_array(0);
+	}
 
-void tfx_set_buffer(tfx_buffer *buf, uint8_t slot, bool write) {
-	assert(slot <= 8);
-	assert(buf != NULL);
-	g_tmp_draw.ssbos[slot] = *buf;
-	g_tmp_draw.ssbo_write[slot] = write;
-}
+	stats.state_changes = g_gl.counts.changes;
+	stats.state_changes_skipped = g_gl.counts.skipped;
+	stats.program_binds = g_gl.counts.program_binds;
+	stats.texture_binds = g_gl.counts.texture_binds;
+	stats.buffer_binds = g_gl.counts.buffer_binds;
 
-// TODO: make this work for index buffers
-void tfx_set_transient_buffer(tfx_transient_buffer tb) {
-	assert(tb.has_format);
-	g_tmp_draw.vbo = g_transient_buffer.buf;
-	g_tmp_draw.use_vbo = true;
-	g_tmp_draw.use_tvb = true;
-	g_tmp_draw.tvb_fmt = tb.format;
-	g_tmp_draw.offset = tb.offset;
-	g_tmp_draw.indices = tb.num;
-}
+	occlusion_collect();
+	view_mark(&stats, -1, NULL);
+	timers_end(&stats);
+	tvb_advance();
 
-void tfx_set_vertices(tfx_buffer *vbo, int count) {
-	assert(vbo != NULL);
-	assert(vbo->has_format);
+	uint64_t frame_end = tfx_time_ns();
+	stats.cpu_submit_ms = (float)((double)frame->submit_ns / 1000000.0);
+	stats.cpu_frame_ms = (float)((double)(frame_end - frame_start) / 1000000.0);
+	trace_zone(TFX_TRACE_RENDER, "Render Frame", frame_start, frame_end);
 
-	g_tmp_draw.vbo = *vbo;
-	g_tmp_draw.use_vbo = true;
-	if (!g_tmp_draw.use_ibo) {
-		g_tmp_draw.indices = count;
-	}
+	return stats;
 }
 
-void tfx_set_indices(tfx_buffer *ibo, int count) {
-	g_tmp_draw.ibo = *ibo;
-	g_tmp_draw.use_ibo = true;
-	g_tmp_draw.indices = count;
+// index of a resource in the capture being written, 0 if it isn't in there.
+static uint32_t capture_find(uint32_t tag, uint32_t id) {
+	if (id == 0) {
+		return 0;
+	}
+	int n = sb_count(g_capture.records);
+	for (int i = n - 1; i >= 0; i--) {
+		tfx_capture_record *rec = &g_capture.records[i];
+		if (rec->tag == tag && rec->id == id) {
+			return rec->index;
+		}
+	}
+	g_capture.missing++;
+	return 0;
 }
 
-static void push_uniforms(tfx_program program, tfx_draw *add_state) {
-	tfx_set **found = tfx_set_new();
-
-	int n = sb_count(g_uniforms);
-	for (int i = n-1; i >= 0; i--) {
-		tfx_uniform uniform = g_uniforms[i];
-
-		tfx_shadermap *val = tfx_proglookup(g_uniform_map, program);
-		if (!val) {
-			val = tfx_progset(g_uniform_map, program);
+// textures are either a texture's own (index = which of its buffers), or a
+// canvas attachment (index = which attachment).
+static uint32_t capture_find_texture(tfx_texture *tex, uint8_t *index) {
+	unsigned id = tex->gl_ids[0];
+	int n = sb_count(g_capture.records);
+	for (int i = n - 1; i >= 0; i--) {
+		tfx_capture_record *rec = &g_capture.records[i];
+		if (rec->tag == TFX_CHUNK_TEXTURE && rec->id == id) {
+			*index = (uint8_t)tex->gl_idx;
+			return rec->index;
 		}
-#ifdef TFX_DEBUG
-		assert(val);
-		assert(val->value);
-#endif
-		tfx_locmap **locmap = val->value;
-		tfx_locmap *locval = tfx_loclookup(locmap, uniform.name);
-
-		if (!locval) {
-			GLint loc = CHECK(tfx_glGetUniformLocation(program, uniform.name));
-			if (loc >= 0) {
-				locval = tfx_locset(locmap, uniform.name, loc);
-			}
-			else {
-				continue;
+	}
+	for (int i = n - 1; i >= 0; i--) {
+		tfx_capture_record *rec = &g_capture.records[i];
+		if (rec->tag != TFX_CHUNK_CANVAS || rec->id == 0) {
+			continue;
+		}
+		for (uint32_t j = 0; j < rec->canvas.allocated && j < 8; j++) {
+			if (rec->canvas.gl_ids[j] == id) {
+				*index = (uint8_t)j;
+				return rec->index;
 			}
 		}
+	}
+	g_capture.missing++;
+	return 0;
+}
 
-		// only record the last update for a given uniform
-		if (!tfx_slookup(found, uniform.name)) {
-			tfx_uniform found_uniform = uniform;
-			found_uniform.data = g_ub_cursor;
-			memcpy(found_uniform.data, uniform.data, uniform.size);
-			g_ub_cursor += uniform.size;
+static void capture_buffer_ref(uint8_t **out, tfx_buffer *buf) {
+	cap_u32(out, capture_find(TFX_CHUNK_BUFFER, buf->gl_id));
+	cap_u8(out, buf->dirty);
+}
 
-			tfx_sset(found, uniform.name);
-			sb_push(add_state->uniforms, found_uniform);
-		}
+// values are written as they were set, uniforms are defined on first use.
+static void capture_uniform(uint8_t **out, tfx_uniform *uniform) {
+	uint32_t id = uniform->id;
+	while ((uint32_t)sb_count(g_capture.defined) <= id) {
+		sb_push(g_capture.defined, 0);
 	}
-
-	tfx_set_delete(found);
+	if (!g_capture.defined[id]) {
+		g_capture.defined[id] = 1;
+		uint8_t *payload = NULL;
+		cap_u32(&payload, id);
+		cap_u32(&payload, (uint32_t)uniform->type);
+		cap_u32(&payload, (uint32_t)uniform->count);
+		cap_str(&payload, g_uniform_names[id]);
+		cap_str(&payload, uniform->block ? g_blocks[uniform->block - 1].name : NULL);
+		cap_u32(&g_capture.defs, TFX_CHUNK_UNIFORM);
+		cap_u32(&g_capture.defs, (uint32_t)sb_count(payload));
+		cap_put(&g_capture.defs, payload, sb_count(payload));
+		sb_free(payload);
+	}
+	cap_u32(out, id);
+	cap_u32(out, (uint32_t)uniform->last_count);
+	cap_put(out, uniform->data, uniform->last_count * uniform_size_for(uniform->type));
 }
 
-void tfx_dispatch(uint8_t id, tfx_program program, uint32_t x, uint32_t y, uint32_t z) {
-	tfx_view *view = &g_views[id];
-	g_tmp_draw.program = program;
-	assert(program != 0);
-	assert(view != NULL);
-	assert((x + y + z) > 0);
+// draw flags, to know which parts follow.
+enum {
+	TFX_CAPTURE_VBO            = 1 << 0,
+	TFX_CAPTURE_TVB            = 1 << 1,
+	TFX_CAPTURE_IBO            = 1 << 2,
+	TFX_CAPTURE_IBO_32BIT      = 1 << 3,
+	TFX_CAPTURE_IBO_TRANSIENT  = 1 << 4,
+	TFX_CAPTURE_INSTANCE       = 1 << 5,
+	TFX_CAPTURE_INSTANCE_TRANSIENT = 1 << 6,
+	TFX_CAPTURE_SCISSOR        = 1 << 7,
+	TFX_CAPTURE_BOUNDS         = 1 << 8,
+	TFX_CAPTURE_INDIRECT       = 1 << 9
+};
 
-	tfx_draw add_state;
-	memcpy(&add_state, &g_tmp_draw, sizeof(tfx_draw));
-	add_state.threads_x = x;
-	add_state.threads_y = y;
-	add_state.threads_z = z;
+enum {
+	TFX_CAPTURE_DRAW = 0,
+	TFX_CAPTURE_JOB,
+	TFX_CAPTURE_TOUCH
+};
 
-	push_uniforms(program, &add_state);
-	sb_push(view->jobs, add_state);
+// everything but the uniforms. transient offsets are made relative to the
+// frame's transient data, which is written along with the frame.
+static void capture_draw(uint8_t **out, tfx_frame_data *frame, tfx_draw *draw, uint8_t kind, uint8_t id) {
+	cap_u8(out, kind);
+	cap_u8(out, id);
+	if (kind == TFX_CAPTURE_TOUCH) {
+		return;
+	}
+	if (draw->callback) {
+		g_capture.callbacks++;
+	}
 
-	reset();
-}
+	unsigned tvb = g_transient_buffer.buf.gl_id;
+	uint32_t base = frame->transient_base;
+	bool ibo_transient = draw->use_ibo && draw->ibo.gl_id == tvb;
+	bool instance_transient = draw->use_instance_vbo && draw->instance_vbo.gl_id == tvb;
+	uint32_t bits = 0;
+	bits |= draw->use_vbo ? TFX_CAPTURE_VBO : 0;
+	bits |= draw->use_tvb ? TFX_CAPTURE_TVB : 0;
+	bits |= draw->use_ibo ? TFX_CAPTURE_IBO : 0;
+	bits |= draw->ibo_32bit ? TFX_CAPTURE_IBO_32BIT : 0;
+	bits |= ibo_transient ? TFX_CAPTURE_IBO_TRANSIENT : 0;
+	bits |= draw->use_instance_vbo ? TFX_CAPTURE_INSTANCE : 0;
+	bits |= instance_transient ? TFX_CAPTURE_INSTANCE_TRANSIENT : 0;
+	bits |= draw->use_scissor ? TFX_CAPTURE_SCISSOR : 0;
+	bits |= draw->use_bounds ? TFX_CAPTURE_BOUNDS : 0;
+	bits |= draw->indirect.gl_id ? TFX_CAPTURE_INDIRECT : 0;
+	cap_u32(out, bits);
+
+	cap_u32(out, capture_find(TFX_CHUNK_PROGRAM, draw->program));
+	cap_put(out, &draw->flags, sizeof(uint64_t));
+	// positions from submit_at are written as the depth they sort at.
+	cap_u32(out, draw_depth(&frame->views[id], draw));
+	cap_u32(out, draw->indices);
+	cap_u32(out, (uint32_t)(draw->use_tvb ? draw->offset - base : draw->offset));
+	if (draw->use_tvb) {
+		cap_format(out, &draw->tvb_fmt);
+	}
+	else if (draw->use_vbo) {
+		capture_buffer_ref(out, &draw->vbo);
+		cap_format(out, &draw->vbo.format);
+	}
+	if (ibo_transient) {
+		cap_u32(out, (uint32_t)(draw->ibo_offset - base));
+	}
+	else if (draw->use_ibo) {
+		capture_buffer_ref(out, &draw->ibo);
+		cap_u32(out, (uint32_t)draw->ibo_offset);
+	}
+	if (draw->use_instance_vbo) {
+		if (instance_transient) {
+			cap_u32(out, (uint32_t)(draw->instance_offset - base));
+		}
+		else {
+			capture_buffer_ref(out, &draw->instance_vbo);
+			cap_u32(out, (uint32_t)draw->instance_offset);
+		}
+		cap_format(out, &draw->instance_vbo.format);
+	}
+	cap_u32(out, draw->instances);
+	if (draw->indirect.gl_id) {
+		capture_buffer_ref(out, &draw->indirect);
+		cap_u32(out, draw->indirect_offset);
+		cap_u32(out, draw->indirect_count);
+	}
 
-void tfx_submit(uint8_t id, tfx_program program, bool retain) {
-	tfx_view *view = &g_views[id];
-	g_tmp_draw.program = program;
-	assert(program != 0);
-	assert(view != NULL);
+	uint8_t textures = 0;
+	for (int i = 0; i < 8; i++) {
+		tfx_texture *tex = &draw->textures[i];
+		textures |= tex->gl_ids[tex->gl_idx] != 0 ? 1 << i : 0;
+	}
+	cap_u8(out, textures);
+	for (int i = 0; i < 8; i++) {
+		if (textures & (1 << i)) {
+			uint8_t index = 0;
+			cap_u32(out, capture_find_texture(&draw->textures[i], &index));
+			cap_u8(out, index);
+		}
+	}
 
-	tfx_draw add_state;
-	memcpy(&add_state, &g_tmp_draw, sizeof(tfx_draw));
-	push_uniforms(program, &add_state);
-	sb_push(view->draws, add_state);
+	uint8_t ssbos = 0;
+	uint8_t writes = 0;
+	for (int i = 0; i < 8; i++) {
+		ssbos |= draw->ssbos[i].gl_id != 0 ? 1 << i : 0;
+		writes |= draw->ssbo_write[i] ? 1 << i : 0;
+	}
+	cap_u8(out, ssbos);
+	cap_u8(out, writes);
+	for (int i = 0; i < 8; i++) {
+		if (ssbos & (1 << i)) {
+			capture_buffer_ref(out, &draw->ssbos[i]);
+		}
+	}
 
-	if (!retain) {
-		reset();
+	if (draw->use_scissor) {
+		cap_put(out, &draw->scissor_rect, sizeof(tfx_rect));
+	}
+	if (draw->use_bounds) {
+		cap_put(out, draw->bounds, sizeof(draw->bounds));
+	}
+	cap_u32(out, draw->occlusion);
+	if (kind == TFX_CAPTURE_JOB) {
+		cap_u32(out, draw->threads_x);
+		cap_u32(out, draw->threads_y);
+		cap_u32(out, draw->threads_z);
 	}
 }
 
-void tfx_submit_ordered(uint8_t id, tfx_program program, uint32_t depth, bool retain) {
-	g_tmp_draw.depth = depth;
-	tfx_submit(id, program, retain);
+static bool uniform_listed(uint32_t id, tfx_uniform *uniforms, uint32_t count) {
+	for (uint32_t i = 0; i < count; i++) {
+		if (uniforms[i].id == id) {
+			return true;
+		}
+	}
+	return false;
 }
 
-void tfx_touch(uint8_t id) {
-	tfx_view *view = &g_views[id];
-	assert(view != NULL);
-
-	reset();
-	sb_push(view->draws, g_tmp_draw);
+// a bundle is written as its draws. the uniforms set for the replay go with
+// the first one, each draw adds the recorded uniforms they don't override.
+static uint32_t capture_bundle(uint8_t **out, tfx_frame_data *frame, tfx_draw *replay, uint8_t id) {
+	tfx_bundle *bundle = replay->bundle;
+	int nd = sb_count(bundle->draws);
+	for (int i = 0; i < nd; i++) {
+		tfx_draw *draw = &bundle->draws[i];
+		capture_draw(out, frame, draw, TFX_CAPTURE_DRAW, id);
+
+		uint32_t count_at = (uint32_t)sb_count(*out);
+		uint32_t count = 0;
+		cap_u32(out, 0);
+		if (i == 0) {
+			for (uint32_t j = 0; j < replay->draw_uniform_count; j++, count++) {
+				capture_uniform(out, &replay->draw_uniforms[j]);
+			}
+		}
+		for (int pass = 0; pass < 2; pass++) {
+			tfx_uniform *uniforms = pass == 0 ? draw->uniforms : draw->draw_uniforms;
+			uint32_t nu = pass == 0 ? draw->uniform_count : draw->draw_uniform_count;
+			for (uint32_t j = 0; j < nu; j++) {
+				uint32_t uid = uniforms[j].id;
+				if (uniform_listed(uid, replay->draw_uniforms, replay->draw_uniform_count)) {
+					continue;
+				}
+				capture_uniform(out, &uniforms[j]);
+				count++;
+			}
+		}
+		memcpy(*out + count_at, &count, sizeof(uint32_t));
+	}
+	return (uint32_t)nd;
 }
 
-static tfx_canvas *get_canvas(tfx_view *view) {
-	assert(view != NULL);
-	if (view->has_canvas) {
-		return &view->canvas;
+static void capture_view(uint8_t **out, tfx_view *view, uint8_t id) {
+	cap_u8(out, id);
+	cap_u32(out, view->flags);
+	cap_str(out, view->name);
+	cap_u32(out, view->has_canvas ? capture_find(TFX_CHUNK_CANVAS, view->canvas.gl_fbo) : 0);
+	cap_u32(out, (uint32_t)view->canvas_layer);
+	cap_u32(out, (uint32_t)view->clear_color);
+	cap_f32(out, view->clear_depth);
+	cap_put(out, &view->scissor_rect, sizeof(tfx_rect));
+	cap_u32(out, (uint32_t)view->sort_mode);
+	cap_put(out, view->view, sizeof(float) * 16);
+	cap_put(out, view->proj_left, sizeof(float) * 16);
+	cap_put(out, view->proj_right, sizeof(float) * 16);
+	int nb = sb_count(view->blits);
+	cap_u32(out, (uint32_t)nb);
+	for (int i = 0; i < nb; i++) {
+		tfx_blit_op *blit = &view->blits[i];
+		// 0 is the backbuffer
+		cap_u32(out, blit->source->gl_fbo ? capture_find(TFX_CHUNK_CANVAS, blit->source->gl_fbo) : 0);
+		cap_put(out, &blit->rect, sizeof(tfx_rect));
 	}
-	return &g_backbuffer;
 }
 
-void tfx_blit(uint8_t dst, uint8_t src, uint16_t x, uint16_t y, uint16_t w, uint16_t h) {
-	tfx_rect rect;
-	rect.x = x;
-	rect.y = y;
-	rect.w = w;
-	rect.h = h;
-
-	tfx_blit_op blit;
-	blit.source = get_canvas(&g_views[src]);
-	blit.rect = rect;
+// FRAM: transient data, texture updates, views in use, then every encoder's
+// submits in the order they were made.
+static void capture_frame(tfx_frame_data *frame) {
+	uint8_t **out = &g_capture.scratch;
+	sb_reset(*out);
+	sb_reset(g_capture.defs);
+
+	cap_u32(out, frame->transient_offset);
+	cap_put(out, frame->transient_data, frame->transient_offset);
+
+	int nu = sb_count(frame->texture_updates);
+	cap_u32(out, (uint32_t)nu);
+	for (int i = 0; i < nu; i++) {
+		tfx_texture *tex = frame->texture_updates[i].texture;
+		cap_u32(out, capture_find(TFX_CHUNK_TEXTURE, tex->gl_ids[0]));
+		// the buffer it's about to be spun onto, which draws refer to.
+		cap_u8(out, (uint8_t)((tex->gl_idx + 1) % tex->gl_count));
+		uint32_t size = texture_bytes(tex->width, tex->height, tex->format);
+		cap_u32(out, size);
+		cap_put(out, frame->texture_updates[i].data, size);
+	}
 
-	// this would cause a GL error and doesn't make sense.
-	assert(blit.source != get_canvas(&g_views[dst]));
+	uint32_t ne = frame->encoder_count;
+	bool used[VIEW_MAX];
+	memset(used, 0, sizeof(used));
+	for (uint32_t e = 0; e < ne; e++) {
+		tfx_encoder *enc = &g_encoders[e];
+		int nl = sb_count(enc->capture_log);
+		for (int i = 0; i < nl; i++) {
+			used[enc->capture_log[i] & 0xff] = true;
+		}
+	}
+	uint32_t count_at = (uint32_t)sb_count(*out);
+	uint32_t nv = 0;
+	cap_u32(out, 0);
+	for (int id = 0; id < VIEW_MAX; id++) {
+		tfx_view *view = &frame->views[id];
+		if (used[id] || view->flags || view->has_canvas || view->name || view->blits || view->sort_mode) {
+			capture_view(out, view, (uint8_t)id);
+			nv++;
+		}
+	}
+	memcpy(*out + count_at, &nv, sizeof(uint32_t));
+
+	cap_u32(out, ne);
+	for (uint32_t e = 0; e < ne; e++) {
+		tfx_encoder *enc = &g_encoders[e];
+		uint32_t draw_at[VIEW_MAX];
+		uint32_t job_at[VIEW_MAX];
+		memset(draw_at, 0, sizeof(draw_at));
+		memset(job_at, 0, sizeof(job_at));
+
+		count_at = (uint32_t)sb_count(*out);
+		uint32_t nr = 0;
+		cap_u32(out, 0);
+		int nl = sb_count(enc->capture_log);
+		for (int i = 0; i < nl; i++) {
+			uint8_t id = enc->capture_log[i] & 0xff;
+			bool job = (enc->capture_log[i] & 0x100) != 0;
+			tfx_draw *list = job ? frame->jobs[e][id] : frame->draws[e][id];
+			uint32_t *at = job ? &job_at[id] : &draw_at[id];
+			if (*at >= (uint32_t)sb_count(list)) {
+				continue;
+			}
+			tfx_draw *draw = &list[(*at)++];
+			if (draw->bundle) {
+				nr += capture_bundle(out, frame, draw, id);
+				continue;
+			}
+			uint8_t kind = job ? TFX_CAPTURE_JOB : (draw->program ? TFX_CAPTURE_DRAW : TFX_CAPTURE_TOUCH);
+			capture_draw(out, frame, draw, kind, id);
+			if (kind != TFX_CAPTURE_TOUCH) {
+				cap_u32(out, draw->draw_uniform_count);
+				for (uint32_t j = 0; j < draw->draw_uniform_count; j++) {
+					capture_uniform(out, &draw->draw_uniforms[j]);
+				}
+			}
+			nr++;
+		}
+		memcpy(*out + count_at, &nr, sizeof(uint32_t));
+	}
 
-	tfx_view *view = &g_views[dst];
-	sb_push(view->blits, blit);
+	// uniforms first seen this frame are defined ahead of it.
+	fwrite(g_capture.defs, sb_count(g_capture.defs), 1, g_capture.file);
+	capture_chunk(TFX_CHUNK_FRAME, *out, (uint32_t)sb_count(*out));
 }
 
-static void release_compiler() {
-	if (!g_shaderc_allocated) {
-		return;
+// at the end of each submitted frame while a capture is open.
+static void capture_submit(tfx_frame_data *frame) {
+	if (g_capture.recording) {
+		capture_frame(frame);
+		if (--g_capture.frames_left == 0) {
+			capture_close();
+		}
 	}
-
-	int release_shader_c = 0;
-	CHECK(tfx_glGetIntegerv(GL_SHADER_COMPILER, &release_shader_c));
-
-	if (release_shader_c) {
-		CHECK(tfx_glReleaseShaderCompiler());
+	else {
+		g_capture.recording = true;
 	}
+	for (int e = 0; e < TFX_MAX_ENCODERS; e++) {
+		sb_reset(g_encoders[e].capture_log);
+	}
+}
 
-	g_shaderc_allocated = false;
+// nothing submitted to it yet, so it can be captured from the start.
+static bool frame_is_empty(tfx_frame_data *frame) {
+	if (g_encoder_count > 1) {
+		return false;
+	}
+	for (int id = 0; id < VIEW_MAX; id++) {
+		if (sb_count(frame->draws[0][id]) || sb_count(frame->jobs[0][id])) {
+			return false;
+		}
+	}
+	return true;
 }
 
-tfx_stats tfx_frame() {
-	/* This isn't used on RPi, but should free memory on some devices. When
-	 * you call tfx_frame, you should be done with your shader compiles for
-	 * a good while, since that should only be done during init/loading. */
-	release_compiler();
+bool tfx_capture(const char *filename, uint32_t frames) {
+	if ((g_flags & TFX_RESET_CAPTURE) != TFX_RESET_CAPTURE) {
+		TFX_WARN("%s", "tfx_capture needs TFX_RESET_CAPTURE");
+		return false;
+	}
+	if (g_capture.file) {
+		TFX_WARN("%s", "a capture is already being written");
+		return false;
+	}
+	FILE *f = fopen(filename, "wb");
+	if (!f) {
+		TFX_WARN("Unable to open %s for the capture", filename);
+		return false;
+	}
+	g_capture.file = f;
+	g_capture.frames_left = frames > 0 ? frames : 1;
+	g_capture.recording = frame_is_empty(g_submit_frame);
+	g_capture.written = 0;
+	g_capture.missing = 0;
+	g_capture.callbacks = 0;
+	sb_reset(g_capture.defined);
+
+	uint32_t header[2] = { TFX_CAPTURE_MAGIC, TFX_CAPTURE_VERSION };
+	fwrite(header, sizeof(header), 1, f);
+
+	// blocks must be declared before any program using them is linked.
+	for (int b = 0; b < g_block_count; b++) {
+		tfx_uniform_block *ub = &g_blocks[b];
+		uint8_t *payload = NULL;
+		cap_str(&payload, ub->name);
+		int nm = sb_count(ub->members);
+		cap_u32(&payload, (uint32_t)nm);
+		for (int i = 0; i < nm; i++) {
+			cap_str(&payload, g_uniform_names[ub->members[i]]);
+			cap_u32(&payload, (uint32_t)ub->member_types[i]);
+			cap_u32(&payload, (uint32_t)ub->member_counts[i]);
+		}
+		capture_chunk(TFX_CHUNK_BLOCK, payload, (uint32_t)sb_count(payload));
+		sb_free(payload);
+	}
 
-	if (g_caps.debug_output) {
-		CHECK(tfx_glEnable(GL_DEBUG_OUTPUT));
+	int n = sb_count(g_capture.records);
+	for (int i = 0; i < n; i++) {
+		tfx_capture_record *rec = &g_capture.records[i];
+		rec->index = 0;
+		if (rec->id) {
+			capture_write_record(rec);
+		}
 	}
 
-	tfx_stats stats;
-	memset(&stats, 0, sizeof(tfx_stats));
+	return !ferror(f);
+}
 
-	int last_count = 0;
+// a capture being played back. resources are numbered as in the file, and
+// uniforms by their id when captured.
+typedef struct tfx_replay_resource {
+	uint32_t tag;
+	tfx_program program;
+	tfx_buffer buffer;
+	tfx_texture texture;
+	// which of the texture's buffers the last update went to
+	uint8_t updated;
+	tfx_canvas canvas;
+} tfx_replay_resource;
 
-	//CHECK(tfx_glEnable(GL_FRAMEBUFFER_SRGB));
+struct tfx_replay {
+	uint8_t *data;
+	size_t size;
+	tfx_replay_resource *resources;
+	tfx_uniform *uniforms;
+	// where each frame's payload starts, and its size
+	uint32_t *frames;
+	uint32_t *frame_sizes;
+	tfx_occlusion occlusion[TFX_MAX_OCCLUSION + 1];
+	uint32_t skipped;
+};
 
-	// I'm not aware of any situation this is available but undesirable,
-	// so we use it unconditionally if possible.
-	if (g_caps.seamless_cubemap) {
-		CHECK(tfx_glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS));
-	}
+typedef struct tfx_reader {
+	const uint8_t *p;
+	const uint8_t *end;
+	bool bad;
+} tfx_reader;
 
-	GLuint vao;
-	if (tfx_glGenVertexArrays && tfx_glBindVertexArray) {
-		CHECK(tfx_glGenVertexArrays(1, &vao));
-		CHECK(tfx_glBindVertexArray(vao));
+static const void *rd_get(tfx_reader *r, size_t size) {
+	if (r->bad || (size_t)(r->end - r->p) < size) {
+		r->bad = true;
+		return NULL;
 	}
+	const void *p = r->p;
+	r->p += size;
+	return p;
+}
 
-	unsigned debug_id = 0;
-
-	push_group(debug_id++, "Update Resources");
-
-	if (g_transient_buffer.offset > 0) {
-		CHECK(tfx_glBindBuffer(GL_ARRAY_BUFFER, g_transient_buffer.buf.gl_id));
-		if (tfx_glMapBufferRange && tfx_glUnmapBuffer) {
-			void *ptr = tfx_glMapBufferRange(GL_ARRAY_BUFFER, 0, g_transient_buffer.offset, GL_MAP_WRITE_BIT);
-			if (ptr) {
-				memcpy(ptr, g_transient_buffer.data, g_transient_buffer.offset);
-				CHECK(tfx_glUnmapBuffer(GL_ARRAY_BUFFER));
-			}
-		}
-		else {
-			CHECK(tfx_glBufferSubData(GL_ARRAY_BUFFER, 0, g_transient_buffer.offset, g_transient_buffer.data));
-		}
+static void rd_copy(tfx_reader *r, void *dst, size_t size) {
+	const void *src = rd_get(r, size);
+	if (src) {
+		memcpy(dst, src, size);
 	}
-
-	int nt = sb_count(g_textures);
-	for (int i = 0; i < nt; i++) {
-		tfx_texture *tex = &g_textures[i];
-		tfx_texture_params *internal = tex->internal;
-		if (internal->update_data != NULL && (tex->flags & TFX_TEXTURE_CPU_WRITABLE) == TFX_TEXTURE_CPU_WRITABLE) {
-			// spin the buffer id before updating
-			tex->gl_idx = (tex->gl_idx + 1) % tex->gl_count;
-			tfx_glBindTexture(GL_TEXTURE_2D, tex->gl_ids[tex->gl_idx]);
-			tfx_glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, tex->width, tex->height, internal->format, internal->type, internal->update_data);
-			internal->update_data = NULL;
-		}
+	else {
+		memset(dst, 0, size);
 	}
+}
 
-	pop_group();
+static uint8_t rd_u8(tfx_reader *r) {
+	uint8_t v;
+	rd_copy(r, &v, sizeof(uint8_t));
+	return v;
+}
 
-	char debug_label[256];
+static uint32_t rd_u32(tfx_reader *r) {
+	uint32_t v;
+	rd_copy(r, &v, sizeof(uint32_t));
+	return v;
+}
 
-	tfx_canvas *last_canvas = NULL;
+static float rd_f32(tfx_reader *r) {
+	float v;
+	rd_copy(r, &v, sizeof(float));
+	return v;
+}
 
-	for (int id = 0; id < VIEW_MAX; id++) {
-		tfx_view *view = &g_views[id];
+// points into the capture, which outlives everything using it.
+static const char *rd_str(tfx_reader *r) {
+	uint32_t len = rd_u32(r);
+	if (len == 0) {
+		return NULL;
+	}
+	const char *s = rd_get(r, len);
+	if (s && s[len - 1] != '\0') {
+		r->bad = true;
+		return NULL;
+	}
+	return s;
+}
 
-		int nd = sb_count(view->draws);
-		int cd = sb_count(view->jobs);
-		if (nd == 0 && cd == 0) {
-			continue;
-		}
+static void rd_format(tfx_reader *r, tfx_vertex_format *fmt) {
+	memset(fmt, 0, sizeof(tfx_vertex_format));
+	fmt->count = rd_u8(r);
+	fmt->component_mask = rd_u8(r);
+	fmt->stride = rd_u32(r);
+	if (fmt->count > 8) {
+		r->bad = true;
+		return;
+	}
+	for (int i = 0; i < fmt->count; i++) {
+		tfx_vertex_component *vc = &fmt->components[i];
+		vc->offset = rd_u32(r);
+		vc->size = rd_u8(r);
+		vc->normalized = rd_u8(r) != 0;
+		vc->type = (tfx_component_type)rd_u8(r);
+		vc->divisor = rd_u32(r);
+	}
+}
+
+static tfx_replay_resource *replay_resource(tfx_replay *replay, uint32_t index, uint32_t tag) {
+	if (index == 0 || index > (uint32_t)sb_count(replay->resources)) {
+		return NULL;
+	}
+	tfx_replay_resource *res = &replay->resources[index - 1];
+	return res->tag == tag ? res : NULL;
+}
 
-		if (view->name) {
-			snprintf(debug_label, 256, "%s (%d)", view->name, id);
+static void replay_chunk(tfx_replay *replay, tfx_reader *r, uint32_t tag) {
+	tfx_replay_resource res;
+	memset(&res, 0, sizeof(tfx_replay_resource));
+	res.tag = tag;
+
+	switch (tag) {
+		case TFX_CHUNK_BLOCK: {
+			const char *block = rd_str(r);
+			uint32_t nm = rd_u32(r);
+			for (uint32_t i = 0; i < nm && !r->bad; i++) {
+				const char *name = rd_str(r);
+				tfx_uniform_type type = (tfx_uniform_type)rd_u32(r);
+				int count = (int)rd_u32(r);
+				if (block && name) {
+					tfx_uniform_new_block(block, name, type, count);
+				}
+			}
+			return;
 		}
-		else {
-			snprintf(debug_label, 256, "View %d", id);
+		case TFX_CHUNK_UNIFORM: {
+			uint32_t id = rd_u32(r);
+			tfx_uniform_type type = (tfx_uniform_type)rd_u32(r);
+			int count = (int)rd_u32(r);
+			const char *name = rd_str(r);
+			const char *block = rd_str(r);
+			if (r->bad || !name || id > 0xffff) {
+				r->bad = true;
+				return;
+			}
+			while ((uint32_t)sb_count(replay->uniforms) <= id) {
+				tfx_uniform none;
+				memset(&none, 0, sizeof(tfx_uniform));
+				sb_push(replay->uniforms, none);
+			}
+			replay->uniforms[id] = block ? tfx_uniform_new_block(block, name, type, count) : tfx_uniform_new(name, type, count);
+			return;
 		}
-		push_group(debug_id++, debug_label);
-
-		GLuint program = 0;
-		if (g_caps.compute) {
-			if (cd > 0) {
-				// split compute into its own section because it is infrequently used.
-				// helpful in renderdoc captures.
-				push_group(debug_id++, "Compute");
+		case TFX_CHUNK_PROGRAM: {
+			if (rd_u8(r)) {
+				const char *css = rd_str(r);
+				if (css) {
+					res.program = tfx_program_cs_new(css);
+				}
 			}
-			for (int i = 0; i < cd; i++) {
-				tfx_draw job = view->draws[i];
-				if (job.program != program) {
-					CHECK(tfx_glUseProgram(job.program));
-					program = job.program;
+			else {
+				const char *vss = rd_str(r);
+				const char *fss = rd_str(r);
+				uint32_t na = rd_u32(r);
+				const char **attribs = NULL;
+				for (uint32_t i = 0; i < na && !r->bad; i++) {
+					sb_push(attribs, rd_str(r));
 				}
-				// TODO: bind image textures
-				for (int i = 0; i < 8; i++) {
-					if (job.textures[i].gl_ids[job.textures[i].gl_idx] != 0) {
-						tfx_buffer *ssbo = &job.ssbos[i];
-						if (ssbo->dirty) {
-							CHECK(tfx_glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT));
-							ssbo->dirty = false;
-						}
-						if (job.ssbo_write[i]) {
-							ssbo->dirty = true;
-						}
-						CHECK(tfx_glBindBufferBase(GL_SHADER_STORAGE_BUFFER, i, job.ssbos[i].gl_id));
-					}
-					else {
-						CHECK(tfx_glBindBufferBase(GL_SHADER_STORAGE_BUFFER, i, 0));
-					}
+				sb_push(attribs, NULL);
+				if (vss && fss && !r->bad) {
+					res.program = tfx_program_new(vss, fss, attribs);
 				}
-				CHECK(tfx_glDispatchCompute(job.threads_x, job.threads_y, job.threads_z));
+				sb_free(attribs);
+			}
+			break;
+		}
+		case TFX_CHUNK_BUFFER: {
+			tfx_buffer_usage usage = (tfx_buffer_usage)rd_u32(r);
+			uint32_t size = rd_u32(r);
+			tfx_vertex_format fmt;
+			bool has_format = rd_u8(r) != 0;
+			if (has_format) {
+				rd_format(r, &fmt);
+			}
+			const void *data = rd_u8(r) ? rd_get(r, size) : NULL;
+			if (!r->bad) {
+				res.buffer = tfx_buffer_new((void*)data, size, has_format ? &fmt : NULL, usage);
+			}
+			break;
+		}
+		case TFX_CHUNK_TEXTURE: {
+			uint16_t w = (uint16_t)rd_u32(r);
+			uint16_t h = (uint16_t)rd_u32(r);
+			tfx_format format = (tfx_format)rd_u32(r);
+			uint16_t flags = (uint16_t)rd_u32(r);
+			const void *data = rd_u8(r) ? rd_get(r, texture_bytes(w, h, format)) : NULL;
+			if (r->bad) {
+				break;
 			}
-			if (cd > 0) {
-				pop_group();
+			// the formats tfx_texture_new takes, anything else can't have
+			// been created by it.
+			if (format != TFX_FORMAT_RGB565 && format != TFX_FORMAT_RGBA8) {
+				TFX_WARN("replay: texture format %d isn't supported, draws using it are skipped", (int)format);
+				break;
+			}
+			res.texture = tfx_texture_new(w, h, (void*)data, format, flags);
+			break;
+		}
+		case TFX_CHUNK_CANVAS: {
+			uint16_t w = (uint16_t)rd_u32(r);
+			uint16_t h = (uint16_t)rd_u32(r);
+			tfx_format format = (tfx_format)rd_u32(r);
+			uint16_t flags = (uint16_t)rd_u32(r);
+			if (!r->bad) {
+				res.canvas = tfx_canvas_new(w, h, format, flags);
 			}
+			break;
 		}
+		default:
+			// from a newer version, nothing refers to it.
+			return;
+	}
+	sb_push(replay->resources, res);
+}
 
-		if (nd == 0) {
-			pop_group();
+tfx_replay *tfx_replay_open(const char *filename) {
+	FILE *f = fopen(filename, "rb");
+	if (!f) {
+		TFX_WARN("Unable to open capture %s", filename);
+		return NULL;
+	}
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	uint8_t *data = size > 0 ? (uint8_t*)malloc(size) : NULL;
+	bool ok = data && fread(data, size, 1, f) == 1;
+	fclose(f);
+
+	tfx_reader r;
+	r.p = data;
+	r.end = data + (ok ? size : 0);
+	r.bad = !ok;
+	uint32_t magic = rd_u32(&r);
+	uint32_t version = rd_u32(&r);
+	if (r.bad || magic != TFX_CAPTURE_MAGIC || version != TFX_CAPTURE_VERSION) {
+		TFX_WARN("%s is not a capture tinyfx can read", filename);
+		free(data);
+		return NULL;
+	}
+
+	tfx_replay *replay = calloc(1, sizeof(tfx_replay));
+	replay->data = data;
+	replay->size = (size_t)size;
+	while (r.p < r.end && !r.bad) {
+		uint32_t tag = rd_u32(&r);
+		uint32_t chunk_size = rd_u32(&r);
+		const uint8_t *payload = rd_get(&r, chunk_size);
+		if (!payload) {
+			break;
+		}
+		if (tag == TFX_CHUNK_FRAME) {
+			sb_push(replay->frames, (uint32_t)(payload - data));
+			sb_push(replay->frame_sizes, chunk_size);
 			continue;
 		}
+		tfx_reader chunk;
+		chunk.p = payload;
+		chunk.end = payload + chunk_size;
+		chunk.bad = false;
+		replay_chunk(replay, &chunk, tag);
+		r.bad = chunk.bad;
+	}
+	if (r.bad) {
+		TFX_WARN("capture %s is truncated or corrupt", filename);
+		tfx_replay_close(replay);
+		return NULL;
+	}
+	return replay;
+}
 
-		stats.draws += nd;
+uint32_t tfx_replay_frames(tfx_replay *replay) {
+	assert(replay != NULL);
+	return (uint32_t)sb_count(replay->frames);
+}
 
-		tfx_canvas *canvas = get_canvas(view);
+static tfx_buffer replay_buffer(tfx_replay *replay, tfx_reader *r, bool *missing) {
+	tfx_buffer buf;
+	memset(&buf, 0, sizeof(tfx_buffer));
+	tfx_replay_resource *res = replay_resource(replay, rd_u32(r), TFX_CHUNK_BUFFER);
+	bool dirty = rd_u8(r) != 0;
+	if (res) {
+		buf = res->buffer;
+		buf.dirty = dirty;
+	}
+	else {
+		*missing = true;
+	}
+	return buf;
+}
 
-		int nb = sb_count(view->blits);
-		stats.blits += nb;
+static void replay_view(tfx_replay *replay, tfx_reader *r) {
+	tfx_view *view = &g_views[rd_u8(r)];
+	view->flags = rd_u32(r);
+	view->name = rd_str(r);
+	tfx_replay_resource *canvas = replay_resource(replay, rd_u32(r), TFX_CHUNK_CANVAS);
+	view->has_canvas = canvas != NULL;
+	if (canvas) {
+		view->canvas = canvas->canvas;
+	}
+	view->canvas_layer = (int)rd_u32(r);
+	view->clear_color = (int)rd_u32(r);
+	view->clear_depth = rd_f32(r);
+	rd_copy(r, &view->scissor_rect, sizeof(tfx_rect));
+	view->sort_mode = (tfx_sort_mode)rd_u32(r);
+	rd_copy(r, view->view, sizeof(float) * 16);
+	rd_copy(r, view->proj_left, sizeof(float) * 16);
+	rd_copy(r, view->proj_right, sizeof(float) * 16);
+	uint32_t nb = rd_u32(r);
+	for (uint32_t i = 0; i < nb && !r->bad; i++) {
+		tfx_replay_resource *source = replay_resource(replay, rd_u32(r), TFX_CHUNK_CANVAS);
+		tfx_blit_op blit;
+		blit.source = source ? &source->canvas : &g_backbuffer;
+		rd_copy(r, &blit.rect, sizeof(tfx_rect));
+		sb_push(view->blits, blit);
+	}
+}
 
-		// TODO: blit support
+// set up the encoder's draw as captured, then submit it like the app did.
+static void replay_draw(tfx_replay *replay, tfx_reader *r, tfx_encoder *enc, uint32_t base) {
+	uint8_t kind = rd_u8(r);
+	uint8_t id = rd_u8(r);
+	if (kind == TFX_CAPTURE_TOUCH) {
+		tfx_encoder_touch(enc, id);
+		return;
+	}
 
-		// TODO: defer framebuffer creation
+	encoder_reset(enc);
+	tfx_draw *draw = &enc->tmp_draw;
+	bool missing = false;
+	uint32_t bits = rd_u32(r);
+	tfx_replay_resource *program = replay_resource(replay, rd_u32(r), TFX_CHUNK_PROGRAM);
+	rd_copy(r, &draw->flags, sizeof(uint64_t));
+	draw->depth = rd_u32(r);
+	draw->indices = rd_u32(r);
+	draw->offset = rd_u32(r);
+	if (bits & TFX_CAPTURE_TVB) {
+		draw->vbo = g_transient_buffer.buf;
+		draw->use_vbo = true;
+		draw->use_tvb = true;
+		draw->offset += base;
+		rd_format(r, &draw->tvb_fmt);
+	}
+	else if (bits & TFX_CAPTURE_VBO) {
+		draw->vbo = replay_buffer(replay, r, &missing);
+		draw->use_vbo = true;
+		rd_format(r, &draw->vbo.format);
+		draw->vbo.has_format = true;
+	}
+	if (bits & TFX_CAPTURE_IBO_TRANSIENT) {
+		draw->ibo = g_transient_buffer.buf;
+		draw->ibo_offset = rd_u32(r) + base;
+	}
+	else if (bits & TFX_CAPTURE_IBO) {
+		draw->ibo = replay_buffer(replay, r, &missing);
+		draw->ibo_offset = rd_u32(r);
+	}
+	draw->use_ibo = (bits & TFX_CAPTURE_IBO) != 0;
+	draw->ibo_32bit = (bits & TFX_CAPTURE_IBO_32BIT) != 0;
+	if (bits & TFX_CAPTURE_INSTANCE) {
+		if (bits & TFX_CAPTURE_INSTANCE_TRANSIENT) {
+			draw->instance_vbo = g_transient_buffer.buf;
+			draw->instance_offset = rd_u32(r) + base;
+		}
+		else {
+			draw->instance_vbo = replay_buffer(replay, r, &missing);
+			draw->instance_offset = rd_u32(r);
+		}
+		rd_format(r, &draw->instance_vbo.format);
+		draw->instance_vbo.has_format = true;
+		draw->use_instance_vbo = true;
+	}
+	draw->instances = rd_u32(r);
+	if (bits & TFX_CAPTURE_INDIRECT) {
+		draw->indirect = replay_buffer(replay, r, &missing);
+		draw->indirect_offset = rd_u32(r);
+		draw->indirect_count = rd_u32(r);
+	}
 
-		// this can currently only happen on error.
-		if (canvas->allocated == 0) {
-			pop_group();
+	uint8_t textures = rd_u8(r);
+	for (int i = 0; i < 8; i++) {
+		if ((textures & (1 << i)) == 0) {
 			continue;
 		}
-		CHECK(tfx_glBindFramebuffer(GL_FRAMEBUFFER, canvas->gl_fbo));
-		CHECK(tfx_glViewport(0, 0, canvas->width, canvas->height));
+		uint32_t index = rd_u32(r);
+		uint8_t which = rd_u8(r);
+		tfx_replay_resource *tex = replay_resource(replay, index, TFX_CHUNK_TEXTURE);
+		tfx_replay_resource *canvas = replay_resource(replay, index, TFX_CHUNK_CANVAS);
+		if (tex && which < tex->texture.gl_count) {
+			draw->textures[i] = tex->texture;
+			draw->textures[i].gl_idx = which;
+		}
+		else if (canvas && which < canvas->canvas.allocated) {
+			draw->textures[i] = tfx_get_texture(&canvas->canvas, which);
+		}
+	}
 
-		if (canvas->cube) {
-			CHECK(tfx_glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + view->canvas_layer, canvas->gl_ids[0], 0));
-			CHECK(tfx_glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,  GL_TEXTURE_CUBE_MAP_POSITIVE_X + view->canvas_layer, canvas->gl_ids[1], 0));
+	uint8_t ssbos = rd_u8(r);
+	uint8_t writes = rd_u8(r);
+	for (int i = 0; i < 8; i++) {
+		if (ssbos & (1 << i)) {
+			draw->ssbos[i] = replay_buffer(replay, r, &missing);
+			draw->ssbo_write[i] = (writes & (1 << i)) != 0;
 		}
+	}
 
-		if (last_canvas && canvas != last_canvas && last_canvas->mipmaps && last_canvas->gl_fbo != canvas->gl_fbo) {
-			GLenum fmt = last_canvas->cube ? GL_TEXTURE_CUBE_MAP : GL_TEXTURE_2D;
-			tfx_glBindTexture(fmt, last_canvas->gl_ids[0]);
-			tfx_glGenerateMipmap(fmt);
+	if (bits & TFX_CAPTURE_SCISSOR) {
+		rd_copy(r, &draw->scissor_rect, sizeof(tfx_rect));
+		draw->use_scissor = true;
+	}
+	if (bits & TFX_CAPTURE_BOUNDS) {
+		rd_copy(r, draw->bounds, sizeof(draw->bounds));
+		draw->use_bounds = true;
+	}
+	uint32_t occ = rd_u32(r);
+	if (occ > 0 && occ <= TFX_MAX_OCCLUSION) {
+		if (!replay->occlusion[occ]) {
+			replay->occlusion[occ] = tfx_occlusion_new();
 		}
-		last_canvas = canvas;
+		draw->occlusion = replay->occlusion[occ];
+	}
+	uint32_t threads[3] = { 0, 0, 0 };
+	if (kind == TFX_CAPTURE_JOB) {
+		threads[0] = rd_u32(r);
+		threads[1] = rd_u32(r);
+		threads[2] = rd_u32(r);
+	}
 
-		if (view->flags & TFX_VIEW_SCISSOR) {
-			tfx_rect rect = view->scissor_rect;
-			CHECK(tfx_glEnable(GL_SCISSOR_TEST));
-			CHECK(tfx_glScissor(rect.x, canvas->height - rect.y - rect.h, rect.w, rect.h));
+	uint32_t nu = rd_u32(r);
+	for (uint32_t i = 0; i < nu && !r->bad; i++) {
+		uint32_t uid = rd_u32(r);
+		int count = (int)rd_u32(r);
+		if (uid >= (uint32_t)sb_count(replay->uniforms) || !replay->uniforms[uid].name || count <= 0 || count > replay->uniforms[uid].count) {
+			r->bad = true;
+			return;
 		}
-		else {
-			CHECK(tfx_glDisable(GL_SCISSOR_TEST));
+		tfx_uniform *uniform = &replay->uniforms[uid];
+		const void *data = rd_get(r, count * uniform_size_for(uniform->type));
+		if (data) {
+			encoder_set_uniform(enc, uniform, data, count);
 		}
+	}
 
-		CHECK(tfx_glColorMask(true, true, true, true));
-		CHECK(tfx_glDepthMask(true));
+	if (r->bad || missing || !program || !program->program) {
+		replay->skipped++;
+		encoder_reset(enc);
+		return;
+	}
+	if (kind == TFX_CAPTURE_JOB) {
+		tfx_encoder_dispatch(enc, id, program->program, threads[0], threads[1], threads[2]);
+	}
+	else {
+		tfx_encoder_submit(enc, id, program->program, false);
+	}
+}
 
-		GLuint mask = 0;
-		if (view->flags & TFX_VIEW_CLEAR_COLOR) {
-			mask |= GL_COLOR_BUFFER_BIT;
-			int color = view->clear_color;
-			float c[] = {
-				((color >> 24) & 0xff) / 255.0f,
-				((color >> 16) & 0xff) / 255.0f,
-				((color >>  8) & 0xff) / 255.0f,
-				((color >>  0) & 0xff) / 255.0f
-			};
-			CHECK(tfx_glClearColor(c[0], c[1], c[2], c[3]));
-		}
-		if (view->flags & TFX_VIEW_CLEAR_DEPTH) {
-			mask |= GL_DEPTH_BUFFER_BIT;
-			CHECK(tfx_glClearDepthf(view->clear_depth));
+// updates go to the texture's next buffer, and the captured draws sample a
+// given one. if the replay's texture is out of step with the captured one
+// (the capture started mid-way, or a loop made an odd number of updates),
+// move it so the update lands where the draws expect it.
+static void replay_texture_spin(tfx_replay_resource *res, uint8_t which) {
+	tfx_texture *tex = &res->texture;
+	uint8_t next = (uint8_t)((res->updated + 1) % tex->gl_count);
+	if (which >= tex->gl_count || which == next) {
+		res->updated = next;
+		return;
+	}
+	res->updated = which;
+	// the render thread spins it when uploading.
+	rt_wait_idle();
+	int nt = sb_count(g_textures);
+	for (int i = 0; i < nt; i++) {
+		if (g_textures[i].gl_ids[0] == tex->gl_ids[0]) {
+			g_textures[i].gl_idx = (which + tex->gl_count - 1) % tex->gl_count;
 		}
+	}
+}
 
-		if (mask != 0) {
-			CHECK(tfx_glClear(mask));
+bool tfx_replay_submit(tfx_replay *replay, uint32_t frame) {
+	assert(replay != NULL);
+	if (frame >= (uint32_t)sb_count(replay->frames)) {
+		return false;
+	}
+	tfx_reader r;
+	r.p = replay->data + replay->frames[frame];
+	r.end = r.p + replay->frame_sizes[frame];
+	r.bad = false;
+
+	// the frame's transient data goes in one piece, draws are rebased on it.
+	uint32_t size = rd_u32(&r);
+	const void *transient = rd_get(&r, size);
+	if (!transient || g_submit_frame->transient_offset + size > TFX_TRANSIENT_BUFFER_SIZE) {
+		TFX_WARN("%s", "not enough transient space to replay frame");
+		return false;
+	}
+	uint32_t offset = tfx_atomic_add(&g_submit_frame->transient_offset, size);
+	memcpy(g_submit_frame->transient_data + offset, transient, size);
+	uint32_t base = g_submit_frame->transient_base + offset;
+
+	uint32_t nu = rd_u32(&r);
+	for (uint32_t i = 0; i < nu && !r.bad; i++) {
+		tfx_replay_resource *tex = replay_resource(replay, rd_u32(&r), TFX_CHUNK_TEXTURE);
+		uint8_t which = rd_u8(&r);
+		uint32_t bytes = rd_u32(&r);
+		const void *data = rd_get(&r, bytes);
+		if (tex && data && (tex->texture.flags & TFX_TEXTURE_CPU_WRITABLE)) {
+			replay_texture_spin(tex, which);
+			tfx_texture_update(&tex->texture, (void*)data);
 		}
+	}
 
-		// fallback blit path for ES2 (no glBlitFramebuffer available)
-		/*
-		for (int i = 0; i < nb; i++) {
-			tfx_blit_op blit = view->blits[i];
-			// TODO
-		}
-		*/
+	uint32_t nv = rd_u32(&r);
+	for (uint32_t i = 0; i < nv && !r.bad; i++) {
+		replay_view(replay, &r);
+	}
 
-		if (view->flags & TFX_VIEW_DEPTH_TEST_MASK) {
-			CHECK(tfx_glEnable(GL_DEPTH_TEST));
-			if (view->flags & TFX_VIEW_DEPTH_TEST_LT) {
-				CHECK(tfx_glDepthFunc(GL_LEQUAL));
-			}
-			else if (view->flags & TFX_VIEW_DEPTH_TEST_GT) {
-				CHECK(tfx_glDepthFunc(GL_GEQUAL));
-			}
-			else if (view->flags & TFX_VIEW_DEPTH_TEST_EQ) {
-				CHECK(tfx_glDepthFunc(GL_EQUAL));
-			}
+	uint32_t ne = rd_u32(&r);
+	for (uint32_t e = 0; e < ne && !r.bad; e++) {
+		tfx_encoder *enc = e == 0 ? &g_encoders[0] : tfx_encoder_begin();
+		uint32_t nr = rd_u32(&r);
+		if (!enc) {
+			TFX_WARN("%s", "out of encoders to replay frame");
+			return false;
 		}
-		else {
-			CHECK(tfx_glDisable(GL_DEPTH_TEST));
+		for (uint32_t i = 0; i < nr && !r.bad; i++) {
+			replay_draw(replay, &r, enc, base);
 		}
+		if (e > 0) {
+			tfx_encoder_end(enc);
+		}
+	}
 
+	if (r.bad) {
+		TFX_WARN("captured frame %u is corrupt", frame);
+	}
+	return !r.bad;
+}
 
-#define CHANGED(diff, mask) ((diff & mask) != 0)
-
-		uint64_t last_flags = 0;
-		for (int i = 0; i < nd; i++) {
-			tfx_draw draw = view->draws[i];
-			if (draw.program != program) {
-				CHECK(tfx_glUseProgram(draw.program));
-				program = draw.program;
-			}
-
-			// on first iteration of a pass, make sure to set everything.
-			if (i == 0) {
-				last_flags = ~draw.flags;
-			}
-
-			// simple flag diff cuts total GL calls by approx 20% in testing
-			uint64_t flags_diff = draw.flags ^ last_flags;
-			last_flags = draw.flags;
-
-			if (CHANGED(flags_diff, TFX_STATE_DEPTH_WRITE)) {
-				CHECK(tfx_glDepthMask((draw.flags & TFX_STATE_DEPTH_WRITE) > 0));
-			}
-
-			if (CHANGED(flags_diff, TFX_STATE_MSAA) && g_caps.multisample) {
-				if (draw.flags & TFX_STATE_MSAA) {
-					CHECK(tfx_glEnable(GL_MULTISAMPLE));
-				}
-				else {
-					CHECK(tfx_glDisable(GL_MULTISAMPLE));
-				}
-			}
-
-			if (CHANGED(flags_diff, TFX_STATE_CULL_MASK)) {
-				if (draw.flags & TFX_STATE_CULL_CW) {
-					CHECK(tfx_glEnable(GL_CULL_FACE));
-					CHECK(tfx_glFrontFace(GL_CW));
-				}
-				else if (draw.flags & TFX_STATE_CULL_CCW) {
-					CHECK(tfx_glEnable(GL_CULL_FACE));
-					CHECK(tfx_glFrontFace(GL_CCW));
-				}
-				else {
-					CHECK(tfx_glDisable(GL_CULL_FACE));
-				}
-			}
-
-			if (CHANGED(flags_diff, TFX_STATE_BLEND_MASK)) {
-				if (draw.flags & TFX_STATE_BLEND_MASK) {
-					CHECK(tfx_glEnable(GL_BLEND));
-					if (draw.flags & TFX_STATE_BLEND_ALPHA) {
-						CHECK(tfx_glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA));
-					}
-				}
-				else {
-					CHECK(tfx_glDisable(GL_BLEND));
-				}
-			}
-
-			if (CHANGED(flags_diff, TFX_STATE_RGB_WRITE) || CHANGED(flags_diff, TFX_STATE_ALPHA_WRITE)) {
-				bool write_rgb = draw.flags & TFX_STATE_RGB_WRITE;
-				bool write_alpha = draw.flags & TFX_STATE_ALPHA_WRITE;
-				CHECK(tfx_glColorMask(write_rgb, write_rgb, write_rgb, write_alpha));
-			}
-
-			if ((view->flags & TFX_VIEW_SCISSOR) || draw.use_scissor) {
-				CHECK(tfx_glEnable(GL_SCISSOR_TEST));
-				tfx_rect rect = view->scissor_rect;
-				if (draw.use_scissor) {
-					rect = draw.scissor_rect;
-				}
-				CHECK(tfx_glScissor(rect.x, canvas->height - rect.y - rect.h, rect.w, rect.h));
-			}
-			else {
-				CHECK(tfx_glDisable(GL_SCISSOR_TEST));
-			}
-
-			int nu = sb_count(draw.uniforms);
-			for (int j = 0; j < nu; j++) {
-				tfx_uniform uniform = draw.uniforms[j];
-
-				tfx_shadermap *val = tfx_proglookup(g_uniform_map, program);
-				tfx_locmap **locmap = val->value;
-				tfx_locmap *locval = tfx_loclookup(locmap, uniform.name);
-#ifdef TFX_DEBUG
-				assert(locval);
-#endif
-
-				GLint loc = locval->value;
-				if (loc < 0) {
-					continue;
-				}
-				switch (uniform.type) {
-					case TFX_UNIFORM_INT:   CHECK(tfx_glUniform1iv(loc, uniform.last_count, uniform.idata)); break;
-					case TFX_UNIFORM_FLOAT: CHECK(tfx_glUniform1fv(loc, uniform.last_count, uniform.fdata)); break;
-					case TFX_UNIFORM_VEC2:  CHECK(tfx_glUniform2fv(loc, uniform.last_count, uniform.fdata)); break;
-					case TFX_UNIFORM_VEC3:  CHECK(tfx_glUniform3fv(loc, uniform.last_count, uniform.fdata)); break;
-					case TFX_UNIFORM_VEC4:  CHECK(tfx_glUniform4fv(loc, uniform.last_count, uniform.fdata)); break;
-					case TFX_UNIFORM_MAT2:  CHECK(tfx_glUniformMatrix2fv(loc, uniform.last_count, 0, uniform.fdata)); break;
-					case TFX_UNIFORM_MAT3:  CHECK(tfx_glUniformMatrix3fv(loc, uniform.last_count, 0, uniform.fdata)); break;
-					case TFX_UNIFORM_MAT4:  CHECK(tfx_glUniformMatrix4fv(loc, uniform.last_count, 0, uniform.fdata)); break;
-					default: assert(false); break;
-				}
-			}
-
-			if (draw.callback != NULL) {
-				draw.callback();
-			}
+void tfx_replay_close(tfx_replay *replay) {
+	assert(replay != NULL);
+	int nr = sb_count(replay->resources);
+	for (int i = 0; i < nr; i++) {
+		tfx_replay_resource *res = &replay->resources[i];
+		if (res->tag == TFX_CHUNK_TEXTURE && res->texture.gl_ids[0]) {
+			tfx_texture_free(&res->texture);
+		}
+	}
+	for (int i = 1; i <= TFX_MAX_OCCLUSION; i++) {
+		if (replay->occlusion[i]) {
+			tfx_occlusion_free(replay->occlusion[i]);
+		}
+	}
+	if (replay->skipped > 0) {
+		TFX_WARN("replay: %u draws skipped for missing resources", replay->skipped);
+	}
+	// replayed view names point into the data, drop them before it goes.
+	// the render thread may still be labelling the last frame with them.
+	rt_wait_idle();
+	uintptr_t start = (uintptr_t)replay->data;
+	for (int i = 0; i < VIEW_MAX; i++) {
+		uintptr_t name = (uintptr_t)g_views[i].name;
+		if (name >= start && name < start + replay->size) {
+			g_views[i].name = NULL;
+		}
+	}
+	sb_free(replay->resources);
+	sb_free(replay->uniforms);
+	sb_free(replay->frames);
+	sb_free(replay->frame_sizes);
+	free(replay->data);
+	free(replay);
+}
 
-			if (!draw.use_vbo) {
-				continue;
-			}
+// draw lists keep their capacity and the arena is grown to the high-water
+// mark, so a steady workload stops allocating after the first few frames.
+static void frame_data_reset(tfx_frame_data *frame) {
+	for (uint32_t e = 0; e < frame->encoder_count; e++) {
+		for (int id = 0; id < VIEW_MAX; id++) {
+			sb_reset(frame->draws[e][id]);
+			sb_reset(frame->jobs[e][id]);
+		}
+	}
+	frame->encoder_count = 1;
 
-			GLenum mode = GL_TRIANGLES;
-			switch (draw.flags & TFX_STATE_DRAW_MASK) {
-				case TFX_STATE_DRAW_POINTS:     mode = GL_POINTS; break;
-				case TFX_STATE_DRAW_LINES:      mode = GL_LINES; break;
-				case TFX_STATE_DRAW_LINE_STRIP: mode = GL_LINE_STRIP; break;
-				case TFX_STATE_DRAW_LINE_LOOP:  mode = GL_LINE_LOOP; break;
-				case TFX_STATE_DRAW_TRI_STRIP:  mode = GL_TRIANGLE_STRIP; break;
-				case TFX_STATE_DRAW_TRI_FAN:    mode = GL_TRIANGLE_FAN; break;
-				default: break; // unspecified = triangles.
-			}
+	if (frame->arena_offset > frame->arena_size) {
+		// leave some headroom so slow growth doesn't realloc every frame.
+		frame->arena_size = frame->arena_offset + frame->arena_offset / 4;
+		free(frame->arena);
+		frame->arena = (uint8_t*)malloc(frame->arena_size);
+	}
+	int no = sb_count(frame->arena_overflow);
+	for (int i = 0; i < no; i++) {
+		free(frame->arena_overflow[i]);
+	}
+	sb_reset(frame->arena_overflow);
+	frame->arena_offset = 0;
+	sb_reset(frame->texture_updates);
+}
 
-			GLuint vbo = draw.vbo.gl_id;
+// close out recording of the submit frame.
+static void frame_data_submit(tfx_frame_data *frame) {
+	// every encoder must be finished before their draws get merged.
 #ifdef TFX_DEBUG
-			assert(vbo != 0);
+	for (int i = 1; i < TFX_MAX_ENCODERS; i++) {
+		assert(!g_encoders[i].active);
+	}
 #endif
+	frame->encoder_count = g_encoder_count < TFX_MAX_ENCODERS ? g_encoder_count : TFX_MAX_ENCODERS;
+
+	uint32_t ne = frame->encoder_count;
+	frame->submit_ns = 0;
+	for (uint32_t e = 0; e < ne; e++) {
+		tfx_encoder *enc = &g_encoders[e];
+		frame->submit_ns += enc->submit_ns;
+		enc->submit_ns = 0;
+		encoder_reset_uniforms(enc);
+		enc->ub_cursor = NULL;
+		enc->ub_end = NULL;
+	}
+	encoder_reset(&g_encoders[0]);
+	g_encoder_count = 1;
 
-			if (draw.vbo.dirty && tfx_glMemoryBarrier) {
-				CHECK(tfx_glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT));
-				draw.vbo.dirty = false;
-			}
-
-			uint32_t va_offset = 0;
-			if (draw.use_tvb) {
-				draw.vbo.format = draw.tvb_fmt;
-				va_offset = draw.offset;
+	int nt = sb_count(g_textures);
+	for (int i = 0; i < nt; i++) {
+		tfx_texture *tex = &g_textures[i];
+		tfx_texture_params *internal = tex->internal;
+		if (internal->update_data != NULL && (tex->flags & TFX_TEXTURE_CPU_WRITABLE) == TFX_TEXTURE_CPU_WRITABLE) {
+			tfx_texture_upload update;
+			update.texture = tex;
+			update.data = internal->update_data;
+			// the render thread uploads it after tfx_frame has returned.
+			if (g_rt.enabled) {
+				uint32_t size = texture_bytes(tex->width, tex->height, tex->format);
+				update.data = arena_chunk(frame, size);
+				memcpy(update.data, internal->update_data, size);
 			}
-			tfx_vertex_format *fmt = &draw.vbo.format;
-			assert(fmt != NULL);
-			assert(fmt->stride > 0);
-
-			CHECK(tfx_glBindBuffer(GL_ARRAY_BUFFER, vbo));
+			sb_push(frame->texture_updates, update);
+			internal->update_data = NULL;
+		}
+	}
 
-			int nc = fmt->count;
-#ifdef TFX_DEBUG
-			assert(nc < 8); // the mask is only 8 bits
-#endif
+	if (frame->views != g_views) {
+		memcpy(frame->views, g_views, sizeof(tfx_view) * VIEW_MAX);
+		// blits belong to the frame now
+		for (int id = 0; id < VIEW_MAX; id++) {
+			g_views[id].blits = NULL;
+		}
+	}
 
-			int real = 0;
-			for (int i = 0; i < nc; i++) {
-				if ((fmt->component_mask & (1 << i)) == 0) {
-					continue;
-				}
-				tfx_vertex_component vc = fmt->components[i];
-				GLenum gl_type = GL_FLOAT;
-				switch (vc.type) {
-					case TFX_TYPE_SKIP: continue;
-					case TFX_TYPE_UBYTE:  gl_type = GL_UNSIGNED_BYTE; break;
-					case TFX_TYPE_BYTE:   gl_type = GL_BYTE; break;
-					case TFX_TYPE_USHORT: gl_type = GL_UNSIGNED_SHORT; break;
-					case TFX_TYPE_SHORT:  gl_type = GL_SHORT; break;
-					case TFX_TYPE_FLOAT: break;
-					default: assert(false); break;
-				}
-				CHECK(tfx_glEnableVertexAttribArray(real));
-				CHECK(tfx_glVertexAttribPointer(real, (GLint)vc.size, gl_type, vc.normalized, (GLsizei)fmt->stride, (GLvoid*)(vc.offset + va_offset)));
-				real += 1;
-			}
-			nc = last_count - nc;
-			for (int i = 0; i <= nc; i++) {
-				CHECK(tfx_glDisableVertexAttribArray(last_count - i));
-			}
-			last_count = real;
+	if (g_capture.file) {
+		capture_submit(frame);
+	}
+}
 
-			for (int i = 0; i < 8; i++) {
-				tfx_texture *tex = &draw.textures[i];
-				if (tex->gl_ids[tex->gl_idx] != 0) {
-					CHECK(tfx_glActiveTexture(GL_TEXTURE0 + i));
+tfx_stats tfx_frame() {
+	uint64_t frame_zone = trace_begin();
+	if (!g_rt.enabled) {
+		uint64_t zone = trace_begin();
+		frame_data_submit(g_submit_frame);
+		trace_end(TFX_TRACE_SUBMIT, "Submit Frame", zone);
+		tfx_stats stats = render_frame(g_submit_frame);
+		frame_data_reset(g_submit_frame);
+		tvb_assign(g_submit_frame, g_transient_buffer.next_region);
+		trace_end(TFX_TRACE_SUBMIT, "tfx_frame", frame_zone);
+		return stats;
+	}
 
-					bool cube = (tex->flags & TFX_TEXTURE_CUBE) == TFX_TEXTURE_CUBE;
-					GLenum fmt = cube ? GL_TEXTURE_CUBE_MAP : GL_TEXTURE_2D;
-					CHECK(tfx_glBindTexture(fmt, tex->gl_ids[tex->gl_idx]));
-#ifdef TFX_DEBUG
-					assert(tex->gl_ids[tex->gl_idx] > 0);
-#endif
-				}
-			}
+	// wait for the render thread to finish the last frame, then swap.
+	uint64_t zone = trace_begin();
+	tfx_mutex_lock(&g_rt.lock);
+	while (g_rt.state != TFX_RT_IDLE) {
+		tfx_cond_wait(&g_rt.cond, &g_rt.lock);
+	}
+	trace_end(TFX_TRACE_SUBMIT, "Wait for Render Thread", zone);
+	zone = trace_begin();
+	frame_data_submit(g_submit_frame);
+	trace_end(TFX_TRACE_SUBMIT, "Submit Frame", zone);
+
+	tfx_frame_data *done = g_render_frame;
+	g_render_frame = g_submit_frame;
+	g_submit_frame = done;
+
+	g_rt.state = TFX_RT_SUBMITTED;
+	tfx_cond_broadcast(&g_rt.cond);
+	tfx_stats stats = g_rt.stats;
+	// the render thread moves this on once it's done with the new frame.
+	uint32_t region = g_transient_buffer.next_region;
+	tfx_mutex_unlock(&g_rt.lock);
+
+	frame_data_reset(done);
+	tvb_assign(done, region);
+	trace_end(TFX_TRACE_SUBMIT, "tfx_frame", frame_zone);
 
-			if (draw.use_ibo) {
-				if (draw.ibo.dirty && tfx_glMemoryBarrier) {
-					CHECK(tfx_glMemoryBarrier(GL_ELEMENT_ARRAY_BARRIER_BIT));
-					draw.ibo.dirty = false;
-				}
-				CHECK(tfx_glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, draw.ibo.gl_id));
-				CHECK(tfx_glDrawElementsInstanced(mode, draw.indices, GL_UNSIGNED_SHORT, (GLvoid*)draw.offset, 1));
-			}
-			else {
-				CHECK(tfx_glDrawArraysInstanced(mode, 0, (GLsizei)draw.indices, 1));
-			}
+	return stats;
+}
 
-			sb_free(draw.uniforms);
+bool tfx_trace_dump(const char *filename) {
+	// copy out what's still intact first, the ring keeps moving under us.
+	tfx_trace_zone *zones = NULL;
+	uint32_t head = tfx_atomic_load(&g_trace.head);
+	uint32_t count = head < TFX_TRACE_ZONES ? head : TFX_TRACE_ZONES;
+	uint64_t base = UINT64_MAX;
+	for (uint32_t idx = head - count; idx != head; idx++) {
+		tfx_trace_zone *src = &g_trace.zones[idx % TFX_TRACE_ZONES];
+		if (tfx_atomic_load(&src->seq) != idx + 1) {
+			continue;
+		}
+		tfx_trace_zone zone = *src;
+		tfx_atomic_fence();
+		if (tfx_atomic_load(&src->seq) != idx + 1) {
+			continue;
 		}
+		base = zone.start < base ? zone.start : base;
+		sb_push(zones, zone);
+	}
 
-#undef CHANGED
+	FILE *f = fopen(filename, "w");
+	if (!f) {
+		TFX_WARN("Unable to open %s for the trace", filename);
+		sb_free(zones);
+		return false;
+	}
 
-		sb_free(view->jobs);
-		view->jobs = NULL;
+	static const char *lanes[TFX_TRACE_LANES] = { "Submit", "Render", "GPU" };
+	fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"tinyfx\"}}");
+	for (int i = 0; i < TFX_TRACE_LANES; i++) {
+		fprintf(f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", i, lanes[i]);
+		fprintf(f, ",\n{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"sort_index\":%d}}", i, i);
+	}
+	int n = sb_count(zones);
+	for (int i = 0; i < n; i++) {
+		tfx_trace_zone *zone = &zones[i];
+		double ts = (double)(zone->start - base) / 1000.0;
+		double dur = zone->end > zone->start ? (double)(zone->end - zone->start) / 1000.0 : 0.0;
+		fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", zone->name, zone->lane, ts, dur);
+	}
+	fprintf(f, "\n]}\n");
 
-		sb_free(view->draws);
-		view->draws = NULL;
+	sb_free(zones);
+	bool ok = !ferror(f);
+	return fclose(f) == 0 && ok;
+}
 
-		sb_free(view->blits);
-		view->blits = NULL;
+bool tfx_render_frame() {
+	if (!g_rt.enabled) {
+		return false;
+	}
 
-		pop_group();
+	tfx_mutex_lock(&g_rt.lock);
+	if (!g_rt.has_thread && !g_rt.quit) {
+		g_rt.thread = tfx_thread_self();
+		g_rt.has_thread = true;
 	}
 
-	reset();
+	while (true) {
+		while (g_rt.state != TFX_RT_SUBMITTED && g_rt.call == NULL && !g_rt.quit) {
+			tfx_cond_wait(&g_rt.cond, &g_rt.lock);
+		}
 
-	tvb_reset();
+		if (g_rt.call != NULL) {
+			tfx_rt_call *call = g_rt.call;
+			tfx_mutex_unlock(&g_rt.lock);
+			call->fn(call->arg);
+			tfx_mutex_lock(&g_rt.lock);
+			call->done = true;
+			g_rt.call = NULL;
+			tfx_cond_broadcast(&g_rt.cond);
+			continue;
+		}
 
-	sb_free(g_uniforms);
-	g_uniforms = NULL;
+		if (g_rt.state == TFX_RT_SUBMITTED) {
+			g_rt.state = TFX_RT_RENDERING;
+			tfx_mutex_unlock(&g_rt.lock);
 
-	g_ub_cursor = g_uniform_buffer;
+			tfx_stats stats = render_frame(g_render_frame);
 
-	CHECK(tfx_glDisable(GL_SCISSOR_TEST));
-	CHECK(tfx_glColorMask(true, true, true, true));
+			tfx_mutex_lock(&g_rt.lock);
+			g_rt.stats = stats;
+			g_rt.state = TFX_RT_IDLE;
+			tfx_cond_broadcast(&g_rt.cond);
+			tfx_mutex_unlock(&g_rt.lock);
+			return true;
+		}
 
-	if (tfx_glDeleteVertexArrays) {
-		CHECK(tfx_glDeleteVertexArrays(1, &vao));
+		break;
 	}
 
-	return stats;
+	tfx_mutex_unlock(&g_rt.lock);
+	return false;
 }
 #undef MAX_VIEW
 #undef CHECK
@@ -17,6 +17,22 @@ typedef enum tfx_buffer_usage {
 	TFX_USAGE_STREAM
 } tfx_buffer_usage;
 
+// draw ordering within a view
+typedef enum tfx_sort_mode {
+	// keep submission order (default)
+	TFX_SORT_SEQUENTIAL = 0,
+	// sort by program, state, textures and buffers to minimize state changes
+	TFX_SORT_STATE,
+	// sort by depth, then state. depth is taken from tfx_submit_ordered,
+	// tfx_submit_depth or tfx_submit_at, lower values are closer to the camera.
+	TFX_SORT_FRONT_TO_BACK,
+	TFX_SORT_BACK_TO_FRONT,
+	// opaque views draw nearest first so the depth test rejects hidden
+	// fragments, transparent views draw farthest first so blending is correct.
+	TFX_SORT_OPAQUE = TFX_SORT_FRONT_TO_BACK,
+	TFX_SORT_TRANSPARENT = TFX_SORT_BACK_TO_FRONT
+} tfx_sort_mode;
+
 typedef enum tfx_depth_test {
 	TFX_DEPTH_TEST_NONE = 0,
 	TFX_DEPTH_TEST_LT,
@@ -83,6 +99,13 @@ enum {
 typedef enum tfx_reset_flags {
 	TFX_RESET_NONE = 0,
 	TFX_RESET_MAX_ANISOTROPY = 1 << 0,
+	// time each view on the GPU, see tfx_stats
+	TFX_RESET_GPU_TIMERS = 1 << 1,
+	// record a frame timeline for tfx_trace_dump
+	TFX_RESET_TRACE = 1 << 2,
+	// keep how every resource was created (a copy of its initial data
+	// included), so that frames can be captured with tfx_capture.
+	TFX_RESET_CAPTURE = 1 << 3,
 	// TFX_RESET_DEBUG...
 	// TFX_RESET_VR
 } tfx_reset_flags;
@@ -111,6 +134,7 @@ typedef enum tfx_format {
 } tfx_format;
 
 typedef unsigned tfx_program;
+typedef unsigned tfx_occlusion;
 
 typedef enum tfx_uniform_type {
 	TFX_UNIFORM_INT = 0,
@@ -133,6 +157,13 @@ typedef enum tfx_severity {
 typedef struct tfx_platform_data {
 	bool use_gles;
 	int context_version;
+	// execute frames on a render thread. the thread which owns the GL context
+	// must call tfx_render_frame in a loop, starting before tfx_reset.
+	bool use_render_thread;
+	// run without a GPU or window: GL goes to a built-in backend which does
+	// nothing but count the calls, see tfx_null_get_calls. no proc address
+	// is needed, and context_version picks what it claims to be (4.5 if 0).
+	bool use_null_backend;
 	void* (*gl_get_proc_address)(const char*);
 	void(*info_log)(const char* msg, tfx_severity level);
 } tfx_platform_data;
@@ -144,6 +175,11 @@ typedef struct tfx_uniform {
 		uint8_t *data;
 	};
 	const char *name;
+	// name interned by tfx_uniform_new
+	uint32_t id;
+	// uniform block this is a member of (0 for none), see tfx_uniform_new_block
+	uint32_t block;
+	uint32_t block_offset;
 	tfx_uniform_type type;
 	int count;
 	int last_count;
@@ -185,6 +221,8 @@ typedef struct tfx_vertex_component {
 	size_t size;
 	bool normalized;
 	tfx_component_type type;
+	// glVertexAttribDivisor, 0 = per vertex (per instance in instance data)
+	uint32_t divisor;
 } tfx_vertex_component;
 
 typedef struct tfx_vertex_format {
@@ -204,13 +242,21 @@ typedef struct tfx_buffer {
 typedef struct tfx_transient_buffer {
 	bool has_format;
 	tfx_vertex_format format;
+	// for index buffers (no format), 16 or 32 bit indices
+	bool index_32bit;
 	void *data;
-	uint16_t num;
+	uint32_t num;
 	uint32_t offset;
 } tfx_transient_buffer;
 
 typedef void (*tfx_draw_callback)(void);
 
+// per-thread draw recording, see tfx_encoder_begin.
+typedef struct tfx_encoder tfx_encoder;
+
+// draws recorded once and replayed every frame, see tfx_bundle_begin.
+typedef struct tfx_bundle tfx_bundle;
+
 typedef struct tfx_rect {
 	uint16_t x;
 	uint16_t y;
@@ -223,9 +269,45 @@ typedef struct tfx_blit_op {
 	tfx_rect rect;
 } tfx_blit_op;
 
+#define TFX_MAX_VIEWS 256
+
 typedef struct tfx_stats {
 	uint32_t draws;
 	uint32_t blits;
+	uint32_t dispatches;
+	// glMemoryBarrier calls for GPU written buffers
+	uint32_t barriers;
+	// glUniform calls made, and ones skipped because the program already
+	// had the same value.
+	uint32_t uniforms;
+	uint32_t uniforms_skipped;
+	// uniform data uploaded, through glUniform and uniform blocks
+	uint32_t uniform_bytes;
+	// transient vertex and index data used
+	uint32_t transient_bytes;
+	// GL state changes and binds issued, and those dropped as redundant
+	uint32_t state_changes;
+	uint32_t state_changes_skipped;
+	// the binds among state_changes
+	uint32_t program_binds;
+	uint32_t texture_binds;
+	uint32_t buffer_binds;
+	// draws dropped for having bounds outside their view's frustum
+	uint32_t culled;
+	// occlusion tested draws last seen hidden, which were skipped or only
+	// drawn if their proxy box passed.
+	uint32_t occluded;
+	// GPU milliseconds for the whole frame and each view, from the timer
+	// queries of a frame a few frames back. 0 until results arrive, or
+	// without TFX_RESET_GPU_TIMERS.
+	float gpu_ms;
+	float gpu_view_ms[TFX_MAX_VIEWS];
+	// CPU milliseconds spent in submit calls for the frame (summed over
+	// encoders), rendering it (in tfx_frame, or on the render thread) and
+	// on each view while rendering.
+	float cpu_submit_ms;
+	float cpu_frame_ms;
+	float cpu_view_ms[TFX_MAX_VIEWS];
 } tfx_stats;
 
 typedef struct tfx_caps {
@@ -238,6 +320,12 @@ typedef struct tfx_caps {
 	bool instancing;
 	bool seamless_cubemap;
 	bool anisotropic_filtering;
+	bool uniform_buffers;
+	bool buffer_storage;
+	bool multi_draw_indirect;
+	bool occlusion_query;
+	bool conditional_render;
+	bool timer_query;
 } tfx_caps;
 
 // TODO
@@ -255,13 +343,20 @@ TFX_API tfx_vertex_format tfx_vertex_format_start();
 TFX_API void tfx_vertex_format_add(tfx_vertex_format *fmt, uint8_t slot, size_t count, bool normalized, tfx_component_type type);
 TFX_API void tfx_vertex_format_end(tfx_vertex_format *fmt);
 TFX_API size_t tfx_vertex_format_offset(tfx_vertex_format *fmt, uint8_t slot);
+// advance this component once every `divisor` instances instead of per vertex.
+TFX_API void tfx_vertex_format_set_divisor(tfx_vertex_format *fmt, uint8_t slot, uint32_t divisor);
 
+// null format = available 16 bit indices
 TFX_API uint32_t tfx_transient_buffer_get_available(tfx_vertex_format *fmt);
+// null format = 16 bit index buffer
 TFX_API tfx_transient_buffer tfx_transient_buffer_new(tfx_vertex_format *fmt, uint16_t num_verts);
+TFX_API tfx_transient_buffer tfx_transient_index_buffer_new(uint32_t num_indices, bool use_32bit);
 
 TFX_API tfx_buffer tfx_buffer_new(void *data, size_t size, tfx_vertex_format *format, tfx_buffer_usage usage);
 
 TFX_API tfx_texture tfx_texture_new(uint16_t w, uint16_t h, void *data, tfx_format format, uint16_t flags);
+// data is read by the next tfx_frame, keep it around until then. with a
+// render thread it's copied there, so it may be reused straight after.
 TFX_API void tfx_texture_update(tfx_texture *tex, void *data);
 TFX_API void tfx_texture_free(tfx_texture *tex);
 TFX_API tfx_texture tfx_get_texture(tfx_canvas *canvas, uint8_t index);
@@ -274,17 +369,38 @@ TFX_API void tfx_view_set_clear_color(uint8_t id, int color);
 TFX_API void tfx_view_set_clear_depth(uint8_t id, float depth);
 TFX_API void tfx_view_set_depth_test(uint8_t id, tfx_depth_test mode);
 TFX_API void tfx_view_set_scissor(uint8_t id, uint16_t x, uint16_t y, uint16_t w, uint16_t h);
+TFX_API void tfx_view_set_sort(uint8_t id, tfx_sort_mode mode);
 TFX_API uint16_t tfx_view_get_width(uint8_t id);
 TFX_API uint16_t tfx_view_get_height(uint8_t id);
 TFX_API void tfx_view_get_dimensions(uint8_t id, uint16_t *w, uint16_t *h);
-// TFX_API void tfx_view_set_transform(uint8_t id, float *view, float *proj_l, float *proj_r);
+// column-major world to view matrix (identity by default), used by
+// tfx_submit_at. either projection may be NULL to leave it unchanged. once
+// proj_l is set, draws with bounds are culled against the view's frustum.
+TFX_API void tfx_view_set_transform(uint8_t id, float *view, float *proj_l, float *proj_r);
+// culling is on once the view has a projection, this turns it off (or back
+// on). tfx_reset clears it along with the rest of the view.
+TFX_API void tfx_view_set_culling(uint8_t id, bool enabled);
 
 TFX_API tfx_program tfx_program_new(const char *vss, const char *fss, const char *attribs[]);
 TFX_API tfx_program tfx_program_cs_new(const char *css);
 
+// returns 0 if occlusion queries aren't supported or all handles are in use.
+TFX_API tfx_occlusion tfx_occlusion_new();
+TFX_API void tfx_occlusion_free(tfx_occlusion occ);
+
 TFX_API tfx_uniform tfx_uniform_new(const char *name, tfx_uniform_type type, int count);
+// declares a member of a std140 uniform block, for shaders using
+// `layout(std140) uniform <block> { ... };`. members are laid out in the order
+// they are declared, which must match the shader, and every member must be
+// declared before linking programs which use the block. set them like any
+// other uniform: values are packed into one buffer uploaded per frame, and
+// each draw binds its range. without caps.uniform_buffers, shaders should
+// declare them as plain uniforms instead, and they are set one by one.
+// with a render thread, this waits for the frame in flight to finish.
+TFX_API tfx_uniform tfx_uniform_new_block(const char *block, const char *name, tfx_uniform_type type, int count);
 
 // TFX_API void tfx_set_transform(float *mtx, uint8_t count);
+// transient vertices and transient indices can be set on the same draw.
 TFX_API void tfx_set_transient_buffer(tfx_transient_buffer tb);
 // pass -1 to update maximum uniform size
 TFX_API void tfx_set_uniform(tfx_uniform *uniform, const float *data, const int count);
@@ -293,19 +409,133 @@ TFX_API void tfx_set_uniform_int(tfx_uniform *uniform, const int *data, const in
 TFX_API void tfx_set_callback(tfx_draw_callback cb);
 TFX_API void tfx_set_state(uint64_t flags);
 TFX_API void tfx_set_scissor(uint16_t x, uint16_t y, uint16_t w, uint16_t h);
+// world space bounds for frustum culling, as a box or a sphere.
+TFX_API void tfx_set_bounds_aabb(const float *min, const float *max);
+TFX_API void tfx_set_bounds_sphere(const float *center, float radius);
+// occlusion test the draw using a handle that persists across frames. it
+// needs bounds and a view projection. while the draw passes it is queried
+// directly; once a query reports it hidden, only its bounding box is drawn
+// (with a query) and the draw itself is skipped, or left to the GPU with
+// conditional rendering when available.
+TFX_API void tfx_set_occlusion(tfx_occlusion occ);
 TFX_API void tfx_set_texture(tfx_uniform *uniform, tfx_texture *tex, uint8_t slot);
 TFX_API void tfx_set_buffer(tfx_buffer *buf, uint8_t slot, bool write);
 // TFX_API void tfx_set_image(tfx_texture *tex, uint8_t slot, bool write);
 TFX_API void tfx_set_vertices(tfx_buffer *vbo, int count);
 TFX_API void tfx_set_indices(tfx_buffer *ibo, int count);
+// per-instance attributes, following the vertex attributes in the program's
+// attribs list. they advance once per instance unless a divisor is set.
+// sets the instance count to `count`.
+TFX_API void tfx_set_instance_data(tfx_buffer *buf, uint32_t count);
+// instance count is the transient buffer's vertex count.
+TFX_API void tfx_set_transient_instance_data(tfx_transient_buffer tb);
+TFX_API void tfx_set_instance_count(uint32_t count);
 TFX_API void tfx_dispatch(uint8_t id, tfx_program program, uint32_t x, uint32_t y, uint32_t z);
-// TFX_API void tfx_submit_ordered(uint8_t id, tfx_program program, uint32_t depth, bool retain);
+TFX_API void tfx_submit_ordered(uint8_t id, tfx_program program, uint32_t depth, bool retain);
+// depth is the view space distance in front of the camera.
+TFX_API void tfx_submit_depth(uint8_t id, tfx_program program, float depth, bool retain);
+// depth is taken from a world space position (xyz) and the view's transform
+// as it is when the frame is submitted.
+TFX_API void tfx_submit_at(uint8_t id, tfx_program program, const float *pos, bool retain);
 TFX_API void tfx_submit(uint8_t id, tfx_program program, bool retain);
 TFX_API void tfx_touch(uint8_t id);
 
-TFX_API void tfx_blit(uint8_t src, uint8_t dst, uint16_t x, uint16_t y, uint16_t w, uint16_t h);
-
+// encoders let worker threads record draws in parallel. each thread takes its
+// own encoder for the frame and must end it before tfx_frame is called, which
+// merges their draws into the views. returns NULL if all are in use.
+TFX_API tfx_encoder *tfx_encoder_begin();
+TFX_API void tfx_encoder_end(tfx_encoder *enc);
+TFX_API void tfx_encoder_set_transient_buffer(tfx_encoder *enc, tfx_transient_buffer tb);
+TFX_API void tfx_encoder_set_uniform(tfx_encoder *enc, tfx_uniform *uniform, const float *data, const int count);
+TFX_API void tfx_encoder_set_uniform_int(tfx_encoder *enc, tfx_uniform *uniform, const int *data, const int count);
+TFX_API void tfx_encoder_set_callback(tfx_encoder *enc, tfx_draw_callback cb);
+TFX_API void tfx_encoder_set_state(tfx_encoder *enc, uint64_t flags);
+TFX_API void tfx_encoder_set_scissor(tfx_encoder *enc, uint16_t x, uint16_t y, uint16_t w, uint16_t h);
+TFX_API void tfx_encoder_set_bounds_aabb(tfx_encoder *enc, const float *min, const float *max);
+TFX_API void tfx_encoder_set_bounds_sphere(tfx_encoder *enc, const float *center, float radius);
+TFX_API void tfx_encoder_set_occlusion(tfx_encoder *enc, tfx_occlusion occ);
+TFX_API void tfx_encoder_set_texture(tfx_encoder *enc, tfx_uniform *uniform, tfx_texture *tex, uint8_t slot);
+TFX_API void tfx_encoder_set_buffer(tfx_encoder *enc, tfx_buffer *buf, uint8_t slot, bool write);
+TFX_API void tfx_encoder_set_vertices(tfx_encoder *enc, tfx_buffer *vbo, int count);
+TFX_API void tfx_encoder_set_indices(tfx_encoder *enc, tfx_buffer *ibo, int count);
+TFX_API void tfx_encoder_set_instance_data(tfx_encoder *enc, tfx_buffer *buf, uint32_t count);
+TFX_API void tfx_encoder_set_transient_instance_data(tfx_encoder *enc, tfx_transient_buffer tb);
+TFX_API void tfx_encoder_set_instance_count(tfx_encoder *enc, uint32_t count);
+TFX_API void tfx_encoder_dispatch(tfx_encoder *enc, uint8_t id, tfx_program program, uint32_t x, uint32_t y, uint32_t z);
+TFX_API void tfx_encoder_submit_ordered(tfx_encoder *enc, uint8_t id, tfx_program program, uint32_t depth, bool retain);
+TFX_API void tfx_encoder_submit_depth(tfx_encoder *enc, uint8_t id, tfx_program program, float depth, bool retain);
+TFX_API void tfx_encoder_submit_at(tfx_encoder *enc, uint8_t id, tfx_program program, const float *pos, bool retain);
+TFX_API void tfx_encoder_submit(tfx_encoder *enc, uint8_t id, tfx_program program, bool retain);
+TFX_API void tfx_encoder_touch(tfx_encoder *enc, uint8_t id);
+TFX_API void tfx_encoder_submit_bundle(tfx_encoder *enc, uint8_t id, tfx_bundle *bundle);
+
+// bundles hold draws for geometry that doesn't change between frames. record
+// into one with the encoder from tfx_bundle_begin (view ids passed to submit
+// are ignored, transient buffers and compute can't be used), then replay it
+// into any view every frame with tfx_submit_bundle. uniforms set at replay
+// override the recorded ones. don't re-record or free a bundle which has been
+// submitted since the last tfx_frame.
+TFX_API tfx_bundle *tfx_bundle_new();
+TFX_API void tfx_bundle_free(tfx_bundle *bundle);
+TFX_API tfx_encoder *tfx_bundle_begin(tfx_bundle *bundle);
+TFX_API void tfx_bundle_end(tfx_bundle *bundle);
+TFX_API void tfx_submit_bundle(uint8_t id, tfx_bundle *bundle);
+
+// draw `count` commands from `commands`, starting `offset` bytes in. commands
+// are tightly packed DrawElementsIndirectCommand structs when indices are
+// set, DrawArraysIndirectCommand otherwise, and may be written by compute.
+// the counts set by tfx_set_vertices/tfx_set_indices are ignored.
+TFX_API void tfx_submit_indirect(uint8_t id, tfx_program program, tfx_buffer *commands, uint32_t offset, uint32_t count, bool retain);
+TFX_API void tfx_encoder_submit_indirect(tfx_encoder *enc, uint8_t id, tfx_program program, tfx_buffer *commands, uint32_t offset, uint32_t count, bool retain);
+
+// copy a rect of src's canvas into dst's after it is cleared.
+// needs glBlitFramebuffer, so GLES 3 or GL 3: on ES2 blits are skipped, with a
+// warning the first time.
+TFX_API void tfx_blit(uint8_t dst, uint8_t src, uint16_t x, uint16_t y, uint16_t w, uint16_t h);
+
+// with a render thread, this hands the frame over and returns the stats of
+// the last frame the render thread finished.
 TFX_API tfx_stats tfx_frame();
+// render thread only: executes the next frame, plus any GL work forwarded
+// from other threads in the meantime. swap buffers after it returns true.
+// returns false once tfx_shutdown has been called.
+TFX_API bool tfx_render_frame();
+// write the last few hundred frames of TFX_RESET_TRACE zones to a file as
+// Chrome trace json (chrome://tracing, ui.perfetto.dev). GPU zones need
+// TFX_RESET_GPU_TIMERS too. safe to call from any thread at any time.
+TFX_API bool tfx_trace_dump(const char *filename);
+
+// write `frames` frames to a file, along with every live resource created
+// since TFX_RESET_CAPTURE was set: views, draws, uniform values, transient
+// data and texture updates, in native byte order. starts with the frame being
+// recorded if nothing was submitted to it yet, otherwise the next one. bundles
+// are written out as their draws, draw callbacks are dropped. call from the
+// thread calling tfx_frame.
+TFX_API bool tfx_capture(const char *filename, uint32_t frames);
+
+// plays back a capture, see tfx_replay_open.
+typedef struct tfx_replay tfx_replay;
+
+// load a capture and create its resources, after tfx_reset. returns NULL if
+// the file can't be read.
+TFX_API tfx_replay *tfx_replay_open(const char *filename);
+TFX_API uint32_t tfx_replay_frames(tfx_replay *replay);
+// submit captured frame `frame` as the app did, then call tfx_frame. draws
+// using resources missing from the capture are skipped.
+TFX_API bool tfx_replay_submit(tfx_replay *replay, uint32_t frame);
+// frees the replay's textures, other resources live until tfx_shutdown.
+TFX_API void tfx_replay_close(tfx_replay *replay);
+
+typedef struct tfx_gl_call_count {
+	const char *name;
+	uint64_t count;
+} tfx_gl_call_count;
+
+// null backend: GL calls made since startup or tfx_null_reset_calls, for
+// each function called at least once. fills up to max entries and returns
+// how many there are. read between frames.
+TFX_API int tfx_null_get_calls(tfx_gl_call_count *calls, int max);
+TFX_API void tfx_null_reset_calls();
 
 #undef TFX_API
 
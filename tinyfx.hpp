@@ -36,6 +36,10 @@ namespace tfx {
 		TransientBuffer(VertexFormat &fmt, uint16_t num) {
 			tvb = tfx_transient_buffer_new(&fmt.fmt, num);
 		}
+		// index buffer
+		TransientBuffer(uint32_t num, bool use_32bit = false) {
+			tvb = tfx_transient_index_buffer_new(num, use_32bit);
+		}
 	};
 
 	struct Uniform {
@@ -72,6 +76,15 @@ namespace tfx {
 		inline void set_scissor(uint16_t x, uint16_t y, uint16_t w, uint16_t h) {
 			tfx_view_set_scissor(this->id, x, y, w, h);
 		}
+		inline void set_sort(tfx_sort_mode mode = TFX_SORT_STATE) {
+			tfx_view_set_sort(this->id, mode);
+		}
+		inline void set_transform(float *view, float *proj_l = NULL, float *proj_r = NULL) {
+			tfx_view_set_transform(this->id, view, proj_l, proj_r);
+		}
+		inline void set_culling(bool enabled = true) {
+			tfx_view_set_culling(this->id, enabled);
+		}
 		// inline void set_rect(uint16_t x, uint16_t y, uint16_t w, uint16_t h) {
 		// 	tfx_view_set_rect(this->id, x, y, w, h);
 		// }
@@ -103,6 +116,120 @@ namespace tfx {
 		}
 	};
 
+	// record with the tfx_encoder_* functions between begin() and end().
+	struct Bundle {
+		tfx_bundle *bundle;
+		Bundle() {
+			this->bundle = tfx_bundle_new();
+		}
+		~Bundle() {
+			tfx_bundle_free(this->bundle);
+		}
+		inline tfx_encoder *begin() {
+			return tfx_bundle_begin(this->bundle);
+		}
+		inline void end() {
+			tfx_bundle_end(this->bundle);
+		}
+	};
+
+	struct Occlusion {
+		tfx_occlusion occlusion;
+		Occlusion() {
+			this->occlusion = tfx_occlusion_new();
+		}
+		~Occlusion() {
+			if (this->occlusion) {
+				tfx_occlusion_free(this->occlusion);
+			}
+		}
+	};
+
+	struct Replay {
+		tfx_replay *replay;
+		Replay(const char *filename) {
+			this->replay = tfx_replay_open(filename);
+		}
+		~Replay() {
+			if (this->replay) {
+				tfx_replay_close(this->replay);
+			}
+		}
+		inline uint32_t frames() {
+			return tfx_replay_frames(this->replay);
+		}
+		inline bool submit(uint32_t frame) {
+			return tfx_replay_submit(this->replay, frame);
+		}
+	};
+
+	// ends itself when it goes out of scope, which must happen before frame().
+	struct Encoder {
+		tfx_encoder *encoder;
+		Encoder() {
+			this->encoder = tfx_encoder_begin();
+		}
+		~Encoder() {
+			if (this->encoder) {
+				tfx_encoder_end(this->encoder);
+			}
+		}
+		inline void set_uniform(Uniform &uniform, float *data) {
+			tfx_encoder_set_uniform(this->encoder, &uniform.uniform, data, -1);
+		}
+		inline void set_texture(Uniform &uniform, Texture &texture, uint8_t slot) {
+			tfx_encoder_set_texture(this->encoder, &uniform.uniform, &texture.texture, slot);
+		}
+		inline void set_state(uint64_t flags) {
+			tfx_encoder_set_state(this->encoder, flags);
+		}
+		inline void set_transient_buffer(TransientBuffer &tvb) {
+			tfx_encoder_set_transient_buffer(this->encoder, tvb.tvb);
+		}
+		inline void set_vertices(Buffer &vbo, int count = 0) {
+			tfx_encoder_set_vertices(this->encoder, &vbo.buffer, count);
+		}
+		inline void set_indices(Buffer &ibo, int count) {
+			tfx_encoder_set_indices(this->encoder, &ibo.buffer, count);
+		}
+		inline void set_instance_data(Buffer &buf, uint32_t count) {
+			tfx_encoder_set_instance_data(this->encoder, &buf.buffer, count);
+		}
+		inline void set_instance_data(TransientBuffer &tb) {
+			tfx_encoder_set_transient_instance_data(this->encoder, tb.tvb);
+		}
+		inline void set_instance_count(uint32_t count) {
+			tfx_encoder_set_instance_count(this->encoder, count);
+		}
+		inline void set_bounds_aabb(const float *min, const float *max) {
+			tfx_encoder_set_bounds_aabb(this->encoder, min, max);
+		}
+		inline void set_bounds_sphere(const float *center, float radius) {
+			tfx_encoder_set_bounds_sphere(this->encoder, center, radius);
+		}
+		inline void set_occlusion(Occlusion &occlusion) {
+			tfx_encoder_set_occlusion(this->encoder, occlusion.occlusion);
+		}
+		inline void submit(View &view, Program &program, bool retain = false) {
+			tfx_encoder_submit(this->encoder, view.id, program.program, retain);
+		}
+		inline void submit_ordered(View &view, Program &program, uint32_t depth, bool retain = false) {
+			tfx_encoder_submit_ordered(this->encoder, view.id, program.program, depth, retain);
+		}
+		inline void submit_depth(View &view, Program &program, float depth, bool retain = false) {
+			tfx_encoder_submit_depth(this->encoder, view.id, program.program, depth, retain);
+		}
+		inline void submit_at(View &view, Program &program, const float *pos, bool retain = false) {
+			tfx_encoder_submit_at(this->encoder, view.id, program.program, pos, retain);
+		}
+		inline void submit_bundle(View &view, Bundle &bundle) {
+			tfx_encoder_submit_bundle(this->encoder, view.id, bundle.bundle);
+		}
+		inline void submit_indirect(View &view, Program &program, Buffer &commands, uint32_t offset, uint32_t count, bool retain = false) {
+			tfx_encoder_submit_indirect(this->encoder, view.id, program.program, &commands.buffer, offset, count, retain);
+		}
+	};
+
 	inline void dump_caps() {
 		tfx_dump_caps();
 	}
@@ -124,6 +251,18 @@ namespace tfx {
 	inline tfx_stats frame() {
 		return tfx_frame();
 	}
+	inline bool trace_dump(const char *filename) {
+		return tfx_trace_dump(filename);
+	}
+	inline bool capture(const char *filename, uint32_t frames) {
+		return tfx_capture(filename, frames);
+	}
+	inline int null_get_calls(tfx_gl_call_count *calls, int max) {
+		return tfx_null_get_calls(calls, max);
+	}
+	inline void null_reset_calls() {
+		tfx_null_reset_calls();
+	}
 	inline void set_uniform(Uniform &uniform, float data) {
 		float tmp = data;
 		tfx_set_uniform(&uniform.uniform, &tmp, -1);
@@ -152,21 +291,54 @@ namespace tfx {
 	inline void set_indices(Buffer &ibo, int count) {
 		tfx_set_indices(&ibo.buffer, count);
 	}
+	inline void set_instance_data(Buffer &buf, uint32_t count) {
+		tfx_set_instance_data(&buf.buffer, count);
+	}
+	inline void set_instance_data(TransientBuffer &tb) {
+		tfx_set_transient_instance_data(tb.tvb);
+	}
+	inline void set_instance_count(uint32_t count) {
+		tfx_set_instance_count(count);
+	}
+	inline void set_bounds_aabb(const float *min, const float *max) {
+		tfx_set_bounds_aabb(min, max);
+	}
+	inline void set_bounds_sphere(const float *center, float radius) {
+		tfx_set_bounds_sphere(center, radius);
+	}
+	inline void set_occlusion(Occlusion &occlusion) {
+		tfx_set_occlusion(occlusion.occlusion);
+	}
 	inline void dispatch(uint8_t id, Program &program, uint32_t x, uint32_t y, uint32_t z) {
 		tfx_dispatch(id, program.program, x, y, z);
 	}
 	inline void dispatch(View &view, Program &program, uint32_t x, uint32_t y, uint32_t z) {
 		tfx_dispatch(view.id, program.program, x, y, z);
 	}
-	// inline void submit(uint8_t id, Program &program, uint32_t depth = 0, bool retain = false) {
-	// 	tfx_submit_ordered(id, program.program, depth, retain);
-	// }
+	inline void submit_ordered(uint8_t id, Program &program, uint32_t depth, bool retain = false) {
+		tfx_submit_ordered(id, program.program, depth, retain);
+	}
+	inline void submit_ordered(View &view, Program &program, uint32_t depth, bool retain = false) {
+		tfx_submit_ordered(view.id, program.program, depth, retain);
+	}
+	inline void submit_depth(View &view, Program &program, float depth, bool retain = false) {
+		tfx_submit_depth(view.id, program.program, depth, retain);
+	}
+	inline void submit_at(View &view, Program &program, const float *pos, bool retain = false) {
+		tfx_submit_at(view.id, program.program, pos, retain);
+	}
 	inline void submit(uint8_t id, Program &program, bool retain = false) {
 		tfx_submit(id, program.program, retain);
 	}
 	inline void submit(View &view, Program &program, bool retain = false) {
 		tfx_submit(view.id, program.program, retain);
 	}
+	inline void submit_bundle(View &view, Bundle &bundle) {
+		tfx_submit_bundle(view.id, bundle.bundle);
+	}
+	inline void submit_indirect(View &view, Program &program, Buffer &commands, uint32_t offset, uint32_t count, bool retain = false) {
+		tfx_submit_indirect(view.id, program.program, &commands.buffer, offset, count, retain);
+	}
 	// inline void blit(tfx_view *src, tfx_view *dst, uint16_t x, uint16_t y, uint16_t w, uint16_t h);
 
 } // tfx
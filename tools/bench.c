@@ -0,0 +1,585 @@
+// tinyfx-bench: runs synthetic scenes through tinyfx and reports what the
+// CPU side costs. every scene runs on the null backend, and again on
+// headless Mesa (EGL, surfaceless) when libEGL can be loaded.
+//
+// usage: tinyfx-bench [--frames N] [--draws N] [--null | --mesa] [--capture file]
+//                     [--budgets file] [scene...]
+//
+// --capture writes the measured frames of the first scene run to a file for
+// tinyfx-replay.
+//
+// --budgets runs the scenes on the null backend only and checks the GL calls
+// they make per frame against a budgets file (tools/budgets.txt), exiting
+// with 1 if any scene goes over. lines look like
+//   draws 100
+//   static programs 1
+//   textures textures <=32
+// a bare count must match exactly, <= is an upper bound. the groups are
+// programs (glUseProgram), textures (glBindTexture), uniforms (glUniform*)
+// and attributes (vertex array and attribute setup).
+//
+// allocations are counted by wrapping malloc at link time, see the Makefile.
+#include "tinyfx.h"
+#include "headless.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+static uint64_t g_allocs = 0;
+
+void *__wrap_malloc(size_t size) {
+	g_allocs++;
+	return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size) {
+	g_allocs++;
+	return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+	g_allocs++;
+	return __real_realloc(ptr, size);
+}
+
+static uint64_t now_ns() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void quiet_log(const char *msg, tfx_severity level) {
+	if (level >= TFX_SEVERITY_WARNING) {
+		fprintf(stderr, "%s\n", msg);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// scenes
+
+#define BENCH_VIEW 1
+#define BENCH_VIEWS 64
+#define BENCH_TEXTURES 16
+#define BENCH_TEXTURE_SIZE 128
+#define BENCH_TRANSIENT_VERTS 96
+#define BENCH_COMPUTE_SIZE (64 * 256)
+
+static const char *g_vss = ""
+	"in vec3 a_position;\n"
+	"uniform vec4 u_tint;\n"
+	"out vec4 v_col;\n"
+	"out vec2 v_uv;\n"
+	"void main() {\n"
+	"	v_col = u_tint;\n"
+	"	v_uv = a_position.xy;\n"
+	"	gl_Position = vec4(a_position, 1.0);\n"
+	"}\n"
+;
+
+static const char *g_fss = ""
+	"in vec4 v_col;\n"
+	"in vec2 v_uv;\n"
+	"out vec4 out_color;\n"
+	"void main() {\n"
+	"	out_color = v_col;\n"
+	"}\n"
+;
+
+static const char *g_textured_fss = ""
+	"in vec4 v_col;\n"
+	"in vec2 v_uv;\n"
+	"uniform sampler2D s_tex;\n"
+	"out vec4 out_color;\n"
+	"void main() {\n"
+	"	out_color = v_col * texture(s_tex, v_uv);\n"
+	"}\n"
+;
+
+static const char *g_css = ""
+	"#version 430\n"
+	"layout(local_size_x = 64) in;\n"
+	"layout(std430, binding = 0) buffer Src { float src[]; };\n"
+	"layout(std430, binding = 1) buffer Dst { float dst[]; };\n"
+	"void main() {\n"
+	"	uint i = gl_GlobalInvocationID.x;\n"
+	"	dst[i] = src[i] * 0.5 + 1.0;\n"
+	"}\n"
+;
+
+static struct {
+	int draws;
+	tfx_canvas canvas;
+	tfx_vertex_format fmt;
+	tfx_program program;
+	tfx_program textured;
+	tfx_program compute;
+	tfx_buffer vbo;
+	tfx_buffer ssbos[2];
+	tfx_uniform tint;
+	tfx_uniform sampler;
+	tfx_texture textures[BENCH_TEXTURES];
+	uint8_t *pixels;
+} g_res;
+
+static void resources_init(int draws) {
+	memset(&g_res, 0, sizeof(g_res));
+	g_res.draws = draws;
+
+	g_res.canvas = tfx_canvas_new(256, 256, TFX_FORMAT_RGBA8_D16, 0);
+	for (int i = 0; i <= BENCH_VIEWS; i++) {
+		tfx_view_set_canvas(BENCH_VIEW + i, &g_res.canvas, 0);
+		tfx_view_set_sort(BENCH_VIEW + i, TFX_SORT_STATE);
+	}
+	tfx_view_set_clear_color(BENCH_VIEW, 0x555555ff);
+	tfx_view_set_clear_depth(BENCH_VIEW, 1.0f);
+
+	const char *attribs[] = { "a_position", NULL };
+	g_res.program = tfx_program_new(g_vss, g_fss, attribs);
+	g_res.textured = tfx_program_new(g_vss, g_textured_fss, attribs);
+	g_res.compute = tfx_program_cs_new(g_css);
+
+	float verts[] = {
+		 0.0f,  0.5f, 0.0f,
+		-0.5f, -0.5f, 0.0f,
+		 0.5f, -0.5f, 0.0f
+	};
+	g_res.fmt = tfx_vertex_format_start();
+	tfx_vertex_format_add(&g_res.fmt, 0, 3, false, TFX_TYPE_FLOAT);
+	tfx_vertex_format_end(&g_res.fmt);
+	g_res.vbo = tfx_buffer_new(verts, sizeof(verts), &g_res.fmt, TFX_USAGE_STATIC);
+
+	float *zero = calloc(BENCH_COMPUTE_SIZE, sizeof(float));
+	g_res.ssbos[0] = tfx_buffer_new(zero, BENCH_COMPUTE_SIZE * sizeof(float), NULL, TFX_USAGE_DYNAMIC);
+	g_res.ssbos[1] = tfx_buffer_new(zero, BENCH_COMPUTE_SIZE * sizeof(float), NULL, TFX_USAGE_DYNAMIC);
+	free(zero);
+
+	g_res.tint = tfx_uniform_new("u_tint", TFX_UNIFORM_VEC4, 1);
+	g_res.sampler = tfx_uniform_new("s_tex", TFX_UNIFORM_INT, 1);
+
+	size_t bytes = BENCH_TEXTURE_SIZE * BENCH_TEXTURE_SIZE * 4;
+	g_res.pixels = malloc(bytes);
+	memset(g_res.pixels, 0xff, bytes);
+	for (int i = 0; i < BENCH_TEXTURES; i++) {
+		g_res.textures[i] = tfx_texture_new(BENCH_TEXTURE_SIZE, BENCH_TEXTURE_SIZE, g_res.pixels, TFX_FORMAT_RGBA8, TFX_TEXTURE_CPU_WRITABLE | TFX_TEXTURE_FILTER_LINEAR);
+	}
+}
+
+static void resources_free() {
+	free(g_res.pixels);
+	g_res.pixels = NULL;
+}
+
+static const float g_white[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+
+static void scene_static(int frame) {
+	for (int i = 0; i < g_res.draws; i++) {
+		tfx_set_uniform(&g_res.tint, g_white, 1);
+		tfx_set_vertices(&g_res.vbo, 3);
+		tfx_set_state(TFX_STATE_RGB_WRITE | TFX_STATE_DEPTH_WRITE);
+		tfx_submit(BENCH_VIEW, g_res.program, false);
+	}
+}
+
+static void scene_uniforms(int frame) {
+	for (int i = 0; i < g_res.draws; i++) {
+		float tint[4] = { (float)i / g_res.draws, (float)frame, 0.0f, 1.0f };
+		tfx_set_uniform(&g_res.tint, tint, 1);
+		tfx_set_vertices(&g_res.vbo, 3);
+		tfx_set_state(TFX_STATE_RGB_WRITE | TFX_STATE_DEPTH_WRITE);
+		tfx_submit(BENCH_VIEW, g_res.program, false);
+	}
+}
+
+static void scene_transient(int frame) {
+	for (int i = 0; i < g_res.draws; i++) {
+		if (tfx_transient_buffer_get_available(&g_res.fmt) < BENCH_TRANSIENT_VERTS) {
+			break;
+		}
+		tfx_transient_buffer tb = tfx_transient_buffer_new(&g_res.fmt, BENCH_TRANSIENT_VERTS);
+		float *v = (float*)tb.data;
+		for (int j = 0; j < BENCH_TRANSIENT_VERTS * 3; j++) {
+			v[j] = (float)((i + j) % 3) * 0.25f;
+		}
+		tfx_set_uniform(&g_res.tint, g_white, 1);
+		tfx_set_transient_buffer(tb);
+		tfx_set_state(TFX_STATE_RGB_WRITE);
+		tfx_submit(BENCH_VIEW, g_res.program, false);
+	}
+}
+
+static void scene_views(int frame) {
+	for (int i = 0; i < g_res.draws; i++) {
+		tfx_set_uniform(&g_res.tint, g_white, 1);
+		tfx_set_vertices(&g_res.vbo, 3);
+		tfx_set_state(TFX_STATE_RGB_WRITE | TFX_STATE_DEPTH_WRITE);
+		tfx_submit(BENCH_VIEW + 1 + (i % BENCH_VIEWS), g_res.program, false);
+	}
+}
+
+// each dispatch reads what the last one wrote.
+static void scene_compute(int frame) {
+	int n = g_res.draws / 16 > 0 ? g_res.draws / 16 : 1;
+	for (int i = 0; i < n; i++) {
+		tfx_set_buffer(&g_res.ssbos[i & 1], 0, false);
+		tfx_set_buffer(&g_res.ssbos[(i + 1) & 1], 1, true);
+		tfx_dispatch(BENCH_VIEW, g_res.compute, BENCH_COMPUTE_SIZE / 64, 1, 1);
+	}
+}
+
+static void scene_textures(int frame) {
+	for (int i = 0; i < BENCH_TEXTURES; i++) {
+		tfx_texture_update(&g_res.textures[i], g_res.pixels);
+	}
+	for (int i = 0; i < g_res.draws; i++) {
+		tfx_set_uniform(&g_res.tint, g_white, 1);
+		tfx_set_texture(&g_res.sampler, &g_res.textures[i % BENCH_TEXTURES], 0);
+		tfx_set_vertices(&g_res.vbo, 3);
+		tfx_set_state(TFX_STATE_RGB_WRITE | TFX_STATE_DEPTH_WRITE);
+		tfx_submit(BENCH_VIEW, g_res.textured, false);
+	}
+}
+
+typedef struct scene {
+	const char *name;
+	void (*submit)(int frame);
+} scene;
+
+static scene g_scenes[] = {
+	{ "static", scene_static },
+	{ "uniforms", scene_uniforms },
+	{ "transient", scene_transient },
+	{ "views", scene_views },
+	{ "compute", scene_compute },
+	{ "textures", scene_textures },
+};
+
+#define BENCH_SCENES (int)(sizeof(g_scenes) / sizeof(g_scenes[0]))
+#define BENCH_BACKENDS (int)(sizeof(g_backends) / sizeof(g_backends[0]))
+
+//////////////////////////////////////////////////////////////////////////////
+// measurement
+
+enum {
+	CALLS_PROGRAMS,
+	CALLS_TEXTURES,
+	CALLS_UNIFORMS,
+	CALLS_ATTRIBUTES,
+	CALLS_GROUPS
+};
+
+static const char *g_groups[CALLS_GROUPS] = {
+	"programs", "textures", "uniforms", "attributes"
+};
+
+static int call_group(const char *fn) {
+	if (strcmp(fn, "glUseProgram") == 0) {
+		return CALLS_PROGRAMS;
+	}
+	if (strcmp(fn, "glBindTexture") == 0) {
+		return CALLS_TEXTURES;
+	}
+	if (strncmp(fn, "glUniform", 9) == 0 && strcmp(fn, "glUniformBlockBinding") != 0) {
+		return CALLS_UNIFORMS;
+	}
+	if (strstr(fn, "VertexAttrib") || strcmp(fn, "glBindVertexArray") == 0) {
+		return CALLS_ATTRIBUTES;
+	}
+	return -1;
+}
+
+typedef struct result {
+	uint64_t submit_ns;
+	uint64_t frame_ns;
+	uint64_t submits;
+	uint64_t allocs;
+	uint64_t gl_calls;
+	// the most calls in each group made by a single frame
+	uint64_t groups[CALLS_GROUPS];
+	int frames;
+} result;
+
+static uint64_t gl_call_total(uint64_t *groups) {
+	tfx_gl_call_count calls[256];
+	int n = tfx_null_get_calls(calls, 256);
+	uint64_t total = 0;
+	for (int i = 0; i < n && i < 256; i++) {
+		total += calls[i].count;
+		int g = call_group(calls[i].name);
+		if (groups && g >= 0) {
+			groups[g] += calls[i].count;
+		}
+	}
+	return total;
+}
+
+static result run_scene(scene *s, int warmup, int frames, const char *capture) {
+	result r;
+	memset(&r, 0, sizeof(result));
+	for (int f = 0; f < warmup + frames; f++) {
+		bool measure = f >= warmup;
+		if (capture && f == warmup) {
+			tfx_capture(capture, frames);
+		}
+		tfx_null_reset_calls();
+		uint64_t allocs = g_allocs;
+		uint64_t t0 = now_ns();
+		s->submit(f);
+		uint64_t t1 = now_ns();
+		tfx_stats stats = tfx_frame();
+		uint64_t t2 = now_ns();
+		if (!measure) {
+			continue;
+		}
+		r.submit_ns += t1 - t0;
+		r.frame_ns += t2 - t1;
+		r.submits += stats.draws + stats.dispatches;
+		r.allocs += g_allocs - allocs;
+		uint64_t groups[CALLS_GROUPS] = { 0 };
+		r.gl_calls += gl_call_total(groups);
+		for (int g = 0; g < CALLS_GROUPS; g++) {
+			if (groups[g] > r.groups[g]) {
+				r.groups[g] = groups[g];
+			}
+		}
+		r.frames++;
+	}
+	return r;
+}
+
+static void print_result(backend *b, scene *s, result *r) {
+	double seconds = (double)(r->submit_ns + r->frame_ns) / 1e9;
+	double per_frame = (double)r->submits / r->frames;
+	printf("%-5s %-10s %9.0f %12.0f %10.1f %12.0f %8.2f ",
+		b->name, s->name,
+		per_frame,
+		seconds > 0.0 ? (double)r->submits / seconds : 0.0,
+		r->submits ? (double)r->submit_ns / (double)r->submits : 0.0,
+		(double)r->frame_ns / r->frames,
+		(double)r->allocs / r->frames
+	);
+	if (b->counts_calls && r->submits) {
+		printf("%8.2f\n", (double)r->gl_calls / (double)r->submits);
+	}
+	else {
+		printf("%8s\n", "-");
+	}
+}
+
+static bool wanted(const char *name, char **names, int count) {
+	if (count == 0) {
+		return true;
+	}
+	for (int i = 0; i < count; i++) {
+		if (strcmp(names[i], name) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// budgets
+
+#define BENCH_MAX_BUDGETS 128
+
+typedef struct budget {
+	const char *scene;
+	int group;
+	uint64_t limit;
+	bool at_most;
+} budget;
+
+static budget g_budgets[BENCH_MAX_BUDGETS];
+static int g_budget_count = 0;
+
+static scene *scene_find(const char *name) {
+	for (int i = 0; i < BENCH_SCENES; i++) {
+		if (strcmp(g_scenes[i].name, name) == 0) {
+			return &g_scenes[i];
+		}
+	}
+	return NULL;
+}
+
+static bool budgets_load(const char *filename, int *draws) {
+	FILE *f = fopen(filename, "r");
+	if (!f) {
+		printf("can't open %s\n", filename);
+		return false;
+	}
+	bool ok = true;
+	char line[256];
+	int n = 0;
+	while (fgets(line, sizeof(line), f)) {
+		n++;
+		char name[32], group[32], limit[32];
+		int fields = sscanf(line, "%31s %31s %31s", name, group, limit);
+		if (fields <= 0 || name[0] == '#') {
+			continue;
+		}
+		if (fields == 2 && strcmp(name, "draws") == 0) {
+			*draws = atoi(group);
+			continue;
+		}
+		scene *s = scene_find(name);
+		int g = -1;
+		for (int i = 0; fields == 3 && i < CALLS_GROUPS; i++) {
+			if (strcmp(group, g_groups[i]) == 0) {
+				g = i;
+			}
+		}
+		bool at_most = fields == 3 && strncmp(limit, "<=", 2) == 0;
+		const char *digits = at_most ? limit + 2 : limit;
+		char *end = NULL;
+		unsigned long long value = fields == 3 ? strtoull(digits, &end, 10) : 0;
+		if (!s || g < 0 || end == digits || (end && *end != '\0') || g_budget_count == BENCH_MAX_BUDGETS) {
+			printf("%s:%d: bad budget\n", filename, n);
+			ok = false;
+			continue;
+		}
+		budget *b = &g_budgets[g_budget_count++];
+		b->scene = s->name;
+		b->group = g;
+		b->limit = (uint64_t)value;
+		b->at_most = at_most;
+	}
+	fclose(f);
+	return ok;
+}
+
+// prints each group's calls for a frame next to its budget, if it has one.
+static bool budgets_check(scene *s, result *r) {
+	bool ok = true;
+	for (int g = 0; g < CALLS_GROUPS; g++) {
+		budget *b = NULL;
+		for (int i = 0; i < g_budget_count; i++) {
+			if (g_budgets[i].scene == s->name && g_budgets[i].group == g) {
+				b = &g_budgets[i];
+			}
+		}
+		uint64_t calls = r->groups[g];
+		char limit[32] = "-";
+		const char *status = "";
+		if (b) {
+			snprintf(limit, sizeof(limit), "%s%llu", b->at_most ? "<=" : "", (unsigned long long)b->limit);
+			if (calls > b->limit) {
+				status = "over";
+			}
+			else if (calls < b->limit && !b->at_most) {
+				// fewer is good news, but the budget should say so.
+				status = "under";
+			}
+			else {
+				status = "ok";
+			}
+			ok = ok && strcmp(status, "ok") == 0;
+		}
+		printf("%-10s %-10s %8llu %8s  %s\n", s->name, g_groups[g], (unsigned long long)calls, limit, status);
+	}
+	return ok;
+}
+
+int main(int argc, char **argv) {
+	int frames = 100;
+	int draws = 1000;
+	const char *only = NULL;
+	const char *capture = NULL;
+	const char *budgets = NULL;
+	char **names = calloc(argc, sizeof(char*));
+	int count = 0;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+			frames = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--draws") == 0 && i + 1 < argc) {
+			draws = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc) {
+			capture = argv[++i];
+		}
+		else if (strcmp(argv[i], "--budgets") == 0 && i + 1 < argc) {
+			budgets = argv[++i];
+		}
+		else if (strcmp(argv[i], "--null") == 0 || strcmp(argv[i], "--mesa") == 0) {
+			only = argv[i] + 2;
+		}
+		else if (argv[i][0] == '-') {
+			printf("usage: %s [--frames N] [--draws N] [--null | --mesa] [--capture file] [--budgets file] [scene...]\n", argv[0]);
+			free(names);
+			return 1;
+		}
+		else {
+			names[count++] = argv[i];
+		}
+	}
+	if (frames < 1) {
+		frames = 1;
+	}
+	// call counts only mean something on the null backend.
+	if (budgets) {
+		if (!budgets_load(budgets, &draws)) {
+			free(names);
+			return 1;
+		}
+		only = "null";
+	}
+
+	printf("%d frames, %d draws per scene\n", frames, draws);
+	if (budgets) {
+		printf("%-10s %-10s %8s %8s\n", "scene", "calls", "frame", "budget");
+	}
+	else {
+		printf("%-5s %-10s %9s %12s %10s %12s %8s %8s\n",
+			"gl", "scene", "draws", "draws/s", "ns/submit", "ns/tfx_frame", "allocs", "gl/draw"
+		);
+	}
+
+	bool ok = true;
+
+	for (int b = 0; b < BENCH_BACKENDS; b++) {
+		backend *be = &g_backends[b];
+		if (only && strcmp(only, be->name) != 0) {
+			continue;
+		}
+		for (int s = 0; s < BENCH_SCENES; s++) {
+			if (!wanted(g_scenes[s].name, names, count)) {
+				continue;
+			}
+			// a fresh start for each scene, so they can't skew each other.
+			tfx_platform_data pd;
+			memset(&pd, 0, sizeof(tfx_platform_data));
+			pd.info_log = quiet_log;
+			if (!be->init(&pd)) {
+				printf("%-5s (unavailable)\n", be->name);
+				break;
+			}
+			tfx_set_platform_data(pd);
+			tfx_reset(256, 256, capture ? TFX_RESET_CAPTURE : TFX_RESET_NONE);
+			resources_init(draws);
+
+			result r = run_scene(&g_scenes[s], 10, frames, capture);
+			capture = NULL;
+			if (budgets) {
+				ok = budgets_check(&g_scenes[s], &r) && ok;
+			}
+			else {
+				print_result(be, &g_scenes[s], &r);
+			}
+
+			tfx_shutdown();
+			resources_free();
+			be->shutdown();
+		}
+	}
+
+	free(names);
+	if (budgets) {
+		printf("%s\n", ok ? "within budget" : "over budget");
+	}
+	return ok ? 0 : 1;
+}
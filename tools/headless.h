@@ -0,0 +1,122 @@
+// headless backends for the tools: the built-in null GL, and Mesa through
+// EGL without a surface (loaded at runtime, so the tools build without it).
+#ifndef TINYFX_TOOLS_HEADLESS_H
+#define TINYFX_TOOLS_HEADLESS_H
+
+#include "tinyfx.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <dlfcn.h>
+
+// just enough EGL to get a surfaceless context.
+typedef void *(*egl_get_proc_address_fn)(const char*);
+typedef void *(*egl_get_platform_display_fn)(unsigned platform, void *native, const intptr_t *attribs);
+typedef unsigned (*egl_initialize_fn)(void *dpy, int32_t *major, int32_t *minor);
+typedef unsigned (*egl_bind_api_fn)(unsigned api);
+typedef void *(*egl_create_context_fn)(void *dpy, void *config, void *share, const int32_t *attribs);
+typedef unsigned (*egl_make_current_fn)(void *dpy, void *draw, void *read, void *ctx);
+typedef unsigned (*egl_destroy_context_fn)(void *dpy, void *ctx);
+typedef unsigned (*egl_terminate_fn)(void *dpy);
+
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#define EGL_OPENGL_API 0x30A2
+#define EGL_CONTEXT_MAJOR_VERSION 0x3098
+#define EGL_CONTEXT_MINOR_VERSION 0x30FB
+#define EGL_CONTEXT_OPENGL_PROFILE_MASK 0x30FD
+#define EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT 0x0001
+#define EGL_NONE 0x3038
+
+static struct {
+	void *lib;
+	void *dpy;
+	void *ctx;
+	egl_get_proc_address_fn get_proc_address;
+} g_egl;
+
+static void *egl_proc(const char *name) {
+	return g_egl.get_proc_address(name);
+}
+
+static bool mesa_init(tfx_platform_data *pd) {
+	if (!g_egl.lib) {
+		g_egl.lib = dlopen("libEGL.so.1", RTLD_NOW | RTLD_LOCAL);
+	}
+	if (!g_egl.lib) {
+		return false;
+	}
+	g_egl.get_proc_address = (egl_get_proc_address_fn)dlsym(g_egl.lib, "eglGetProcAddress");
+	egl_initialize_fn initialize = (egl_initialize_fn)dlsym(g_egl.lib, "eglInitialize");
+	egl_bind_api_fn bind_api = (egl_bind_api_fn)dlsym(g_egl.lib, "eglBindAPI");
+	egl_create_context_fn create_context = (egl_create_context_fn)dlsym(g_egl.lib, "eglCreateContext");
+	egl_make_current_fn make_current = (egl_make_current_fn)dlsym(g_egl.lib, "eglMakeCurrent");
+	if (!g_egl.get_proc_address || !initialize || !bind_api || !create_context || !make_current) {
+		return false;
+	}
+	egl_get_platform_display_fn get_display = (egl_get_platform_display_fn)g_egl.get_proc_address("eglGetPlatformDisplayEXT");
+	if (!get_display) {
+		return false;
+	}
+	g_egl.dpy = get_display(EGL_PLATFORM_SURFACELESS_MESA, NULL, NULL);
+	if (!g_egl.dpy || !initialize(g_egl.dpy, NULL, NULL) || !bind_api(EGL_OPENGL_API)) {
+		return false;
+	}
+	const int32_t attribs[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 4,
+		EGL_CONTEXT_MINOR_VERSION, 5,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE
+	};
+	// EGL_KHR_no_config_context: no config needed without surfaces
+	g_egl.ctx = create_context(g_egl.dpy, NULL, NULL, attribs);
+	if (!g_egl.ctx || !make_current(g_egl.dpy, NULL, NULL, g_egl.ctx)) {
+		return false;
+	}
+	pd->context_version = 45;
+	pd->gl_get_proc_address = egl_proc;
+	return true;
+}
+
+static void mesa_shutdown() {
+	egl_make_current_fn make_current = (egl_make_current_fn)dlsym(g_egl.lib, "eglMakeCurrent");
+	egl_destroy_context_fn destroy_context = (egl_destroy_context_fn)dlsym(g_egl.lib, "eglDestroyContext");
+	egl_terminate_fn terminate = (egl_terminate_fn)dlsym(g_egl.lib, "eglTerminate");
+	make_current(g_egl.dpy, NULL, NULL, NULL);
+	destroy_context(g_egl.dpy, g_egl.ctx);
+	terminate(g_egl.dpy);
+	g_egl.dpy = NULL;
+	g_egl.ctx = NULL;
+}
+
+static bool null_init(tfx_platform_data *pd) {
+	pd->use_null_backend = true;
+	pd->context_version = 45;
+	return true;
+}
+
+static void null_shutdown() {
+}
+
+typedef struct backend {
+	const char *name;
+	bool (*init)(tfx_platform_data *pd);
+	void (*shutdown)();
+	// GL calls can only be counted on the null backend
+	bool counts_calls;
+} backend;
+
+static backend g_backends[] = {
+	{ "null", null_init, null_shutdown, true },
+	{ "mesa", mesa_init, mesa_shutdown, false },
+};
+
+static backend *backend_find(const char *name) {
+	for (size_t i = 0; i < sizeof(g_backends) / sizeof(g_backends[0]); i++) {
+		if (strcmp(g_backends[i].name, name) == 0) {
+			return &g_backends[i];
+		}
+	}
+	return NULL;
+}
+
+#endif
@@ -0,0 +1,140 @@
+// tinyfx-replay: plays a capture written by tfx_capture back through
+// tfx_frame, on the null backend or headless Mesa, and reports what a pass
+// over it costs per frame: time spent submitting the captured draws, in
+// tfx_frame, and GL calls per draw on the null backend. the first pass is a
+// warm-up when there's more than one.
+//
+// usage: tinyfx-replay [--null | --mesa] [--loops N] [--size WxH] capture
+#include "tinyfx.h"
+#include "headless.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static uint64_t now_ns() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void quiet_log(const char *msg, tfx_severity level) {
+	if (level >= TFX_SEVERITY_WARNING) {
+		fprintf(stderr, "%s\n", msg);
+	}
+}
+
+static uint64_t gl_call_total() {
+	tfx_gl_call_count calls[256];
+	int n = tfx_null_get_calls(calls, 256);
+	uint64_t total = 0;
+	for (int i = 0; i < n && i < 256; i++) {
+		total += calls[i].count;
+	}
+	return total;
+}
+
+int main(int argc, char **argv) {
+	const char *path = NULL;
+	const char *name = "null";
+	int loops = 10;
+	int width = 1280;
+	int height = 720;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--loops") == 0 && i + 1 < argc) {
+			loops = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+			if (sscanf(argv[++i], "%dx%d", &width, &height) != 2) {
+				path = NULL;
+				break;
+			}
+		}
+		else if (strcmp(argv[i], "--null") == 0 || strcmp(argv[i], "--mesa") == 0) {
+			name = argv[i] + 2;
+		}
+		else if (argv[i][0] != '-' && !path) {
+			path = argv[i];
+		}
+		else {
+			path = NULL;
+			break;
+		}
+	}
+	if (!path) {
+		printf("usage: %s [--null | --mesa] [--loops N] [--size WxH] capture\n", argv[0]);
+		return 1;
+	}
+	if (loops < 1) {
+		loops = 1;
+	}
+
+	backend *be = backend_find(name);
+	tfx_platform_data pd;
+	memset(&pd, 0, sizeof(tfx_platform_data));
+	pd.info_log = quiet_log;
+	if (!be->init(&pd)) {
+		printf("%s backend unavailable\n", be->name);
+		return 1;
+	}
+	tfx_set_platform_data(pd);
+	tfx_reset((uint16_t)width, (uint16_t)height, TFX_RESET_NONE);
+
+	tfx_replay *replay = tfx_replay_open(path);
+	if (!replay) {
+		tfx_shutdown();
+		be->shutdown();
+		return 1;
+	}
+	uint32_t frames = tfx_replay_frames(replay);
+
+	uint64_t submit_ns = 0;
+	uint64_t frame_ns = 0;
+	uint64_t submits = 0;
+	uint64_t gl_calls = 0;
+	uint64_t measured = 0;
+	bool ok = frames > 0;
+	for (int loop = 0; loop < loops && ok; loop++) {
+		bool measure = loop > 0 || loops == 1;
+		for (uint32_t f = 0; f < frames && ok; f++) {
+			tfx_null_reset_calls();
+			uint64_t t0 = now_ns();
+			ok = tfx_replay_submit(replay, f);
+			uint64_t t1 = now_ns();
+			tfx_stats stats = tfx_frame();
+			uint64_t t2 = now_ns();
+			if (!measure) {
+				continue;
+			}
+			submit_ns += t1 - t0;
+			frame_ns += t2 - t1;
+			submits += stats.draws + stats.dispatches;
+			gl_calls += gl_call_total();
+			measured++;
+		}
+	}
+
+	if (ok && measured > 0) {
+		printf("%s: %u frames, %d loops on %s\n", path, frames, loops, be->name);
+		printf("%10s %14s %14s %10s\n", "draws", "ns/replay", "ns/tfx_frame", "gl/draw");
+		printf("%10.0f %14.0f %14.0f ",
+			(double)submits / measured,
+			(double)submit_ns / measured,
+			(double)frame_ns / measured
+		);
+		if (be->counts_calls && submits) {
+			printf("%10.2f\n", (double)gl_calls / (double)submits);
+		}
+		else {
+			printf("%10s\n", "-");
+		}
+	}
+	else if (frames == 0) {
+		printf("%s has no frames\n", path);
+	}
+
+	tfx_replay_close(replay);
+	tfx_shutdown();
+	be->shutdown();
+	return ok ? 0 : 1;
+}